@@ -4,6 +4,7 @@ import voluptuous as vol
 from esphome import automation, pins
 from esphome.const import CONF_ID, CONF_TRIGGER_ID
 from esphome.components import binary_sensor
+from esphome.core import CORE, coroutine_with_priority
 
 DEPENDENCIES = ["preferences"]
 MULTI_CONF = True
@@ -31,6 +32,13 @@ CONF_DISCRETE_CLOSE_PIN = "discrete_close_pin"
 
 CONF_RATGDO_ID = "ratgdo_id"
 
+CONF_RX_DRAIN_BUDGET = "rx_drain_budget"
+CONF_SECPLUS1_CONFIDENCE = "secplus1_confidence"
+CONF_DOOR_POSITION_REPORT_DELTA = "door_position_report_delta"
+CONF_DOOR_POSITION_REPORT_INTERVAL = "door_position_report_interval"
+CONF_WIRE_CAPTURE_SIZE = "wire_capture_size"
+CONF_PROFILE = "profile"
+
 CONF_ON_SYNC_FAILED = "on_sync_failed"
 
 CONF_PROTOCOL = "protocol"
@@ -38,7 +46,8 @@ CONF_PROTOCOL = "protocol"
 PROTOCOL_SECPLUSV1 = "secplusv1"
 PROTOCOL_SECPLUSV2 = "secplusv2"
 PROTOCOL_DRYCONTACT = "drycontact"
-SUPPORTED_PROTOCOLS = [PROTOCOL_SECPLUSV1, PROTOCOL_SECPLUSV2, PROTOCOL_DRYCONTACT]
+PROTOCOL_AUTO = "auto"
+SUPPORTED_PROTOCOLS = [PROTOCOL_SECPLUSV1, PROTOCOL_SECPLUSV2, PROTOCOL_DRYCONTACT, PROTOCOL_AUTO]
 
 CONF_DRY_CONTACT_OPEN_SENSOR = "dry_contact_open_sensor"
 CONF_DRY_CONTACT_CLOSE_SENSOR = "dry_contact_close_sensor"
@@ -68,6 +77,21 @@ CONFIG_SCHEMA = cv.All(
         ),
         cv.Optional(CONF_DISCRETE_OPEN_PIN): pins.gpio_output_pin_schema,
         cv.Optional(CONF_DISCRETE_CLOSE_PIN): pins.gpio_output_pin_schema,
+        cv.Optional(
+            CONF_RX_DRAIN_BUDGET, default="5ms"
+        ): cv.positive_time_period_microseconds,
+        cv.Optional(
+            CONF_DOOR_POSITION_REPORT_DELTA, default="1%"
+        ): cv.percentage,
+        # 0 accepts every reading, 100 waits for confirmation by a second identical one
+        cv.Optional(CONF_SECPLUS1_CONFIDENCE, default=60): cv.int_range(min=0, max=100),
+        cv.Optional(
+            CONF_DOOR_POSITION_REPORT_INTERVAL, default="500ms"
+        ): cv.positive_time_period_milliseconds,
+        # records of raw bytes kept for dump_wire_capture(), 5 bytes of RAM each
+        cv.Optional(CONF_WIRE_CAPTURE_SIZE, default=0): cv.int_range(min=0, max=4096),
+        # time the protocol and state paths, reported by dump_config
+        cv.Optional(CONF_PROFILE, default=False): cv.boolean,
         cv.Optional(CONF_ON_SYNC_FAILED): automation.validate_automation(
             {
                 cv.GenerateID(CONF_TRIGGER_ID): cv.declare_id(SyncFailed),
@@ -92,9 +116,40 @@ RATGDO_CLIENT_SCHMEA = cv.Schema(
 )
 
 
+def count_ratgdo_observer(key):
+    observers = CORE.data.setdefault("ratgdo_observers", {})
+    observers[key] = observers.get(key, 0) + 1
+
+
+def count_ratgdo_state_observer(ratgdo_id):
+    observers = CORE.data.setdefault("ratgdo_state_observers", {})
+    observers[ratgdo_id] = observers.get(ratgdo_id, 0) + 1
+
+
+# observer storage is inline, size it for the largest number of entities
+# subscribing to the same state of one ratgdo
+@coroutine_with_priority(-100.0)
+async def add_max_observers_define():
+    observers = CORE.data.get("ratgdo_observers", {})
+    cg.add_define("RATGDO_MAX_OBSERVERS", max(observers.values(), default=1))
+    # every child subscribes once to the state snapshot of its ratgdo
+    state_observers = CORE.data.get("ratgdo_state_observers", {})
+    cg.add_define(
+        "RATGDO_MAX_STATE_OBSERVERS", max(state_observers.values(), default=1)
+    )
+    # the capture buffer is sized for the largest one configured
+    wire_capture = CORE.data.get("ratgdo_wire_capture", 0)
+    if wire_capture > 0:
+        cg.add_define("RATGDO_WIRE_CAPTURE", wire_capture)
+
+
 async def register_ratgdo_child(var, config):
     parent = await cg.get_variable(config[CONF_RATGDO_ID])
     cg.add(var.set_parent(parent))
+    count_ratgdo_observer(
+        (str(config[CONF_RATGDO_ID]), str(config[CONF_ID].type), str(config.get("type")))
+    )
+    count_ratgdo_state_observer(str(config[CONF_RATGDO_ID]))
 
 
 async def to_code(config):
@@ -107,6 +162,16 @@ async def to_code(config):
     if CONF_INPUT_OBST in config and config[CONF_INPUT_OBST]:
         pin = await cg.gpio_pin_expression(config[CONF_INPUT_OBST])
         cg.add(var.set_input_obst_pin(pin))
+    cg.add(var.set_preference_key(cg.RawExpression(f'fnv1_hash("{config[CONF_ID]}")')))
+    cg.add(var.set_rx_drain_budget(config[CONF_RX_DRAIN_BUDGET]))
+    cg.add(var.set_secplus1_confidence(config[CONF_SECPLUS1_CONFIDENCE]))
+    cg.add(var.set_door_position_report_delta(config[CONF_DOOR_POSITION_REPORT_DELTA]))
+    cg.add(var.set_door_position_report_interval(config[CONF_DOOR_POSITION_REPORT_INTERVAL]))
+    if config[CONF_PROFILE]:
+        cg.add_define("RATGDO_PROFILE")
+    CORE.data["ratgdo_wire_capture"] = max(
+        CORE.data.get("ratgdo_wire_capture", 0), config[CONF_WIRE_CAPTURE_SIZE]
+    )
 
     if CONF_DRY_CONTACT_OPEN_SENSOR in config and config[CONF_DRY_CONTACT_OPEN_SENSOR]:
         dry_contact_open_sensor = await cg.get_variable(config[CONF_DRY_CONTACT_OPEN_SENSOR])
@@ -119,6 +184,12 @@ async def to_code(config):
     for conf in config.get(CONF_ON_SYNC_FAILED, []):
         trigger = cg.new_Pvariable(conf[CONF_TRIGGER_ID], var)
         await automation.build_automation(trigger, [], conf)
+        count_ratgdo_observer((str(config[CONF_ID]), CONF_ON_SYNC_FAILED))
+        count_ratgdo_state_observer(str(config[CONF_ID]))
+
+    if "ratgdo_observers_define" not in CORE.data:
+        CORE.data["ratgdo_observers_define"] = True
+        CORE.add_job(add_max_observers_define)
 
     cg.add_library(
         name="secplus",
@@ -137,6 +208,9 @@ async def to_code(config):
         cg.add_define("PROTOCOL_SECPLUSV2")
     elif config[CONF_PROTOCOL] == PROTOCOL_DRYCONTACT:
         cg.add_define("PROTOCOL_DRYCONTACT")
+    elif config[CONF_PROTOCOL] == PROTOCOL_AUTO:
+        # Sec+1 or Sec+2, detected on the wire
+        cg.add_define("PROTOCOL_AUTO")
     cg.add(var.init_protocol())
 
     if CONF_DISCRETE_OPEN_PIN in config and config[CONF_DISCRETE_OPEN_PIN]:
@@ -1,29 +1,75 @@
 #pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <utility>
-#include <vector>
 
 namespace esphome {
 namespace ratgdo {
 
-    template <typename... X>
+    template <typename F, size_t N>
     class OnceCallbacks;
 
-    template <typename... Ts>
-    class OnceCallbacks<void(Ts...)> {
+    // One-shot callbacks stored inline in N slots, each with the deadline
+    // after which expire() drops it untriggered. Callbacks registered while
+    // triggering are kept for the next trigger.
+    template <size_t N, typename... Ts>
+    class OnceCallbacks<void(Ts...), N> {
     public:
         template <typename Callback>
-        void operator()(Callback&& callback) { this->callbacks_.push_back(std::forward<Callback>(callback)); }
+        bool operator()(Callback&& callback, uint32_t deadline)
+        {
+            if (this->count_ == N) {
+                return false;
+            }
+            this->deadlines_[this->count_] = deadline;
+            this->callbacks_[this->count_++] = std::forward<Callback>(callback);
+            return true;
+        }
 
         void trigger(Ts... args)
         {
-            for (auto& cb : this->callbacks_)
-                cb(args...);
-            this->callbacks_.clear();
+            std::array<std::function<void(Ts...)>, N> callbacks;
+            size_t count = this->count_;
+            for (size_t i = 0; i < count; i++) {
+                callbacks[i] = std::move(this->callbacks_[i]);
+                this->callbacks_[i] = nullptr;
+            }
+            this->count_ = 0;
+            for (size_t i = 0; i < count; i++) {
+                callbacks[i](args...);
+            }
+        }
+
+        // drops the callbacks whose deadline passed, keeping the order of
+        // the others, and returns how many were dropped
+        size_t expire(uint32_t now)
+        {
+            size_t kept = 0;
+            for (size_t i = 0; i < this->count_; i++) {
+                if (int32_t(now - this->deadlines_[i]) >= 0) {
+                    this->callbacks_[i] = nullptr;
+                    continue;
+                }
+                if (kept != i) {
+                    this->callbacks_[kept] = std::move(this->callbacks_[i]);
+                    this->callbacks_[i] = nullptr;
+                    this->deadlines_[kept] = this->deadlines_[i];
+                }
+                kept++;
+            }
+            size_t dropped = this->count_ - kept;
+            this->count_ = kept;
+            return dropped;
         }
 
+        size_t size() const { return this->count_; }
+
     protected:
-        std::vector<std::function<void(Ts...)>> callbacks_;
+        std::array<std::function<void(Ts...)>, N> callbacks_;
+        std::array<uint32_t, N> deadlines_;
+        uint8_t count_ { 0 };
     };
 
 } // namespace ratgdo
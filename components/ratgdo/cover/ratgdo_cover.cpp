@@ -16,9 +16,15 @@ namespace ratgdo {
 
     void RATGDOCover::setup()
     {
-        auto state = this->restore_state_();
-        if (state.has_value()) {
-            this->parent_->set_door_position(state.value().position);
+        const auto& persisted = this->parent_->persisted_state();
+        if (persisted.valid & PERSIST_DOOR_POSITION) {
+            this->parent_->set_door_position(persisted.door_position);
+        } else {
+            // migrate the position saved by previous versions with the cover state
+            auto state = this->restore_state_();
+            if (state.has_value()) {
+                this->parent_->set_door_position(state.value().position);
+            }
         }
         this->parent_->subscribe_door_state([=](DoorState state, float position) {
             this->on_door_state(state, position);
@@ -58,7 +64,13 @@ namespace ratgdo {
             break;
         }
 
-        this->publish_state(save_to_flash);
+        // the position is persisted with the rest of the ratgdo state
+        this->publish_state(false);
+        auto& persisted = this->parent_->persisted_state();
+        if (save_to_flash && (!(persisted.valid & PERSIST_DOOR_POSITION) || persisted.door_position != this->position)) {
+            persisted.door_position = this->position;
+            this->parent_->persist(PERSIST_DOOR_POSITION);
+        }
     }
 
     CoverTraits RATGDOCover::get_traits()
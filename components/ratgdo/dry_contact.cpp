@@ -1,6 +1,7 @@
 
 #include "dry_contact.h"
 #include "esphome/core/gpio.h"
+#include "esphome/core/hal.h"
 #include "esphome/core/log.h"
 #include "esphome/core/scheduler.h"
 #include "ratgdo.h"
@@ -103,20 +104,20 @@ namespace ratgdo {
 
             if (action == DoorAction::OPEN) {
                 this->discrete_open_pin_->digital_write(1);
-                this->scheduler_->set_timeout(this->ratgdo_, "", 500, [=] {
+                this->scheduler_->set_timeout(this->ratgdo_, "", PULSE_TIME, [=] {
                     this->discrete_open_pin_->digital_write(0);
                 });
             }
 
             if (action == DoorAction::CLOSE) {
                 this->discrete_close_pin_->digital_write(1);
-                this->scheduler_->set_timeout(this->ratgdo_, "", 500, [=] {
+                this->scheduler_->set_timeout(this->ratgdo_, "", PULSE_TIME, [=] {
                     this->discrete_close_pin_->digital_write(0);
                 });
             }
 
             this->tx_pin_->digital_write(1); // Single button control
-            this->scheduler_->set_timeout(this->ratgdo_, "", 500, [=] {
+            this->scheduler_->set_timeout(this->ratgdo_, "", PULSE_TIME, [=] {
                 this->tx_pin_->digital_write(0);
             });
         }
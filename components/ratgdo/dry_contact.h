@@ -22,6 +22,8 @@ namespace ratgdo {
         using namespace esphome::ratgdo::protocol;
         using namespace esphome::gpio;
 
+        static const uint32_t PULSE_TIME = 500; // ms an output is held to press a button
+
         class DryContact : public Protocol {
         public:
             void setup(RATGDOComponent* ratgdo, Scheduler* scheduler, InternalGPIOPin* rx_pin, InternalGPIOPin* tx_pin);
@@ -54,6 +56,7 @@ namespace ratgdo {
             Result call(Args args);
 
             const Traits& traits() const { return this->traits_; }
+            bool rx_in_progress() { return false; }
 
         protected:
             Traits traits_;
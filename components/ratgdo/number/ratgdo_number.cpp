@@ -1,12 +1,14 @@
 #include "ratgdo_number.h"
 #include "../ratgdo_state.h"
 #include "esphome/core/log.h"
+#include "esphome/core/preferences.h"
+
+#include <cmath>
 
 namespace esphome {
 namespace ratgdo {
 
     using protocol::SetClientID;
-    using protocol::SetRollingCodeCounter;
 
     float normalize_client_id(float client_id)
     {
@@ -19,6 +21,9 @@ namespace ratgdo {
 
     static const char* const TAG = "ratgdo.number";
 
+    // the counter entity is published at most this often
+    static const uint32_t ROLLING_CODE_PUBLISH_INTERVAL = 10000;
+
     void RATGDONumber::dump_config()
     {
         LOG_NUMBER("", "RATGDO Number", this);
@@ -33,11 +38,77 @@ namespace ratgdo {
         }
     }
 
+    uint8_t RATGDONumber::persist_field() const
+    {
+        switch (this->number_type_) {
+        case RATGDO_CLIENT_ID:
+            return PERSIST_CLIENT_ID;
+        case RATGDO_ROLLING_CODE_COUNTER:
+            return PERSIST_ROLLING_CODE;
+        case RATGDO_OPENING_DURATION:
+            return PERSIST_OPENING_DURATION;
+        case RATGDO_CLOSING_DURATION:
+        default:
+            return PERSIST_CLOSING_DURATION;
+        }
+    }
+
+    // the value is kept in the persisted state of the parent
+    bool RATGDONumber::restore_value(float& value)
+    {
+        const auto& state = this->parent_->persisted_state();
+        if (!(state.valid & this->persist_field())) {
+            return false;
+        }
+        switch (this->number_type_) {
+        case RATGDO_CLIENT_ID:
+            value = state.client_id;
+            break;
+        case RATGDO_ROLLING_CODE_COUNTER:
+            return false; // the parent restores the counter
+        case RATGDO_OPENING_DURATION:
+            value = state.opening_duration;
+            break;
+        case RATGDO_CLOSING_DURATION:
+            value = state.closing_duration;
+            break;
+        }
+        return true;
+    }
+
+    void RATGDONumber::persist_value(float value)
+    {
+        auto& state = this->parent_->persisted_state();
+        switch (this->number_type_) {
+        case RATGDO_CLIENT_ID:
+            state.client_id = static_cast<uint32_t>(value);
+            break;
+        case RATGDO_ROLLING_CODE_COUNTER:
+            return; // the parent persists the counter
+        case RATGDO_OPENING_DURATION:
+            state.opening_duration = value;
+            break;
+        case RATGDO_CLOSING_DURATION:
+            state.closing_duration = value;
+            break;
+        }
+        this->parent_->persist(this->persist_field());
+    }
+
     void RATGDONumber::setup()
     {
+        if (this->number_type_ == RATGDO_ROLLING_CODE_COUNTER) {
+            this->setup_rolling_code_counter();
+            return;
+        }
         float value;
-        this->pref_ = global_preferences->make_preference<float>(this->get_object_id_hash());
-        if (!this->pref_.load(&value)) {
+        bool restored = this->restore_value(value);
+        if (!restored) {
+            // migrate the value saved by previous versions in a preference of its own
+            this->pref_ = global_preferences->make_preference<float>(this->get_object_id_hash());
+            restored = this->pref_.load(&value);
+        }
+        if (!restored) {
             if (this->number_type_ == RATGDO_CLIENT_ID) {
                 value = ((random_uint32() + 1) % 0x7FF) << 12 | 0x539; // max size limited to be precisely convertible to float
             } else {
@@ -48,17 +119,12 @@ namespace ratgdo {
                 uint32_t int_value = static_cast<uint32_t>(value);
                 if ((int_value & 0xFFF) != 0x539) {
                     value = ((random_uint32() + 1) % 0x7FF) << 12 | 0x539; // max size limited to be precisely convertible to float
-                    this->pref_.save(&value);
                 }
             }
         }
         this->control(value);
 
-        if (this->number_type_ == RATGDO_ROLLING_CODE_COUNTER) {
-            this->parent_->subscribe_rolling_code_counter([=](uint32_t value) {
-                this->update_state(value);
-            });
-        } else if (this->number_type_ == RATGDO_OPENING_DURATION) {
+        if (this->number_type_ == RATGDO_OPENING_DURATION) {
             this->parent_->subscribe_opening_duration([=](float value) {
                 this->update_state(value);
             });
@@ -85,19 +151,53 @@ namespace ratgdo {
         }
     }
 
+    // The parent persists the rolling code counter and restores it, only a
+    // value saved by previous versions in a preference of its own is
+    // migrated here
+    void RATGDONumber::setup_rolling_code_counter()
+    {
+        if (!(this->parent_->persisted_state().valid & PERSIST_ROLLING_CODE)) {
+            float value = 0;
+            this->pref_ = global_preferences->make_preference<float>(this->get_object_id_hash());
+            if (this->pref_.load(&value)) {
+                // the legacy counter was saved lazily and may be behind
+                value += ROLLING_CODE_LEASE;
+            }
+            this->parent_->set_rolling_code_counter(static_cast<uint32_t>(value));
+        }
+        this->parent_->subscribe_rolling_code_counter([=](uint32_t value) {
+            this->update_rolling_code_counter(value);
+        });
+    }
+
+    void RATGDONumber::update_rolling_code_counter(uint32_t value)
+    {
+        auto now = millis();
+        if (now - this->last_publish_ >= ROLLING_CODE_PUBLISH_INTERVAL) {
+            this->last_publish_ = now;
+            this->cancel_timeout("publish");
+            this->publish_state(value);
+        } else {
+            this->set_timeout("publish", ROLLING_CODE_PUBLISH_INTERVAL - (now - this->last_publish_), [=] {
+                this->last_publish_ = millis();
+                this->publish_state(value);
+            });
+        }
+    }
+
     void RATGDONumber::update_state(float value)
     {
         if (value == this->state) {
             return;
         }
-        this->pref_.save(&value);
+        this->persist_value(value);
         this->publish_state(value);
     }
 
     void RATGDONumber::control(float value)
     {
         if (this->number_type_ == RATGDO_ROLLING_CODE_COUNTER) {
-            this->parent_->call_protocol(SetRollingCodeCounter { static_cast<uint32_t>(value) });
+            this->parent_->set_rolling_code_counter(static_cast<uint32_t>(value));
         } else if (this->number_type_ == RATGDO_OPENING_DURATION) {
             this->parent_->set_opening_duration(value);
         } else if (this->number_type_ == RATGDO_CLOSING_DURATION) {
@@ -106,7 +206,11 @@ namespace ratgdo {
             value = normalize_client_id(value);
             this->parent_->call_protocol(SetClientID { static_cast<uint32_t>(value) });
         }
-        this->update_state(value);
+        if (this->number_type_ == RATGDO_ROLLING_CODE_COUNTER) {
+            this->update_rolling_code_counter(static_cast<uint32_t>(value));
+        } else {
+            this->update_state(value);
+        }
     }
 
 } // namespace ratgdo
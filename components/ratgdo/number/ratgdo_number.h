@@ -26,11 +26,18 @@ namespace ratgdo {
         float get_setup_priority() const override { return setup_priority::HARDWARE + 1; }
 
         void update_state(float value);
+        void setup_rolling_code_counter();
+        void update_rolling_code_counter(uint32_t value);
+
+        uint8_t persist_field() const;
+        bool restore_value(float& value);
+        void persist_value(float value);
         void control(float value) override;
 
     protected:
         NumberType number_type_;
-        ESPPreferenceObject pref_;
+        ESPPreferenceObject pref_; // legacy preference, only read for migration
+        uint32_t last_publish_ { 0 };
     };
 
 } // namespace ratgdo
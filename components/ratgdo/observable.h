@@ -1,12 +1,24 @@
 #pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <utility>
-#include <vector>
+
+#include "esphome/core/defines.h"
+
+// upper bound of observers per observable, generated from the configured
+// entities so storage stays inline and is sized exactly at compile time
+#ifndef RATGDO_MAX_OBSERVERS
+#define RATGDO_MAX_OBSERVERS 4
+#endif
 
 namespace esphome {
 namespace ratgdo {
 
-    template <typename T>
+    // Value holder that notifies its observers at most once per flush(),
+    // with the latest value, if it changed since the previous flush.
+    template <typename T, size_t N = RATGDO_MAX_OBSERVERS>
     class observable {
     public:
         observable(const T& value)
@@ -19,7 +31,7 @@ namespace ratgdo {
         {
             if (value != this->value_) {
                 this->value_ = value;
-                this->notify();
+                this->changed_ = true;
             }
             return *this;
         }
@@ -28,21 +40,41 @@ namespace ratgdo {
         T const& operator*() const { return this->value_; }
 
         template <typename Observer>
-        void subscribe(Observer&& observer)
+        bool subscribe(Observer&& observer)
+        {
+            if (this->count_ == N) {
+                return false;
+            }
+            this->observers_[this->count_++] = std::forward<Observer>(observer);
+            return true;
+        }
+
+        bool take_changed()
+        {
+            bool changed = this->changed_;
+            this->changed_ = false;
+            return changed;
+        }
+
+        void flush()
         {
-            this->observers_.push_back(std::forward<Observer>(observer));
+            if (this->take_changed()) {
+                this->notify();
+            }
         }
 
         void notify() const
         {
-            for (const auto& observer : this->observers_) {
-                observer(this->value_);
+            for (size_t i = 0; i < this->count_; i++) {
+                this->observers_[i](this->value_);
             }
         }
 
     private:
         T value_;
-        std::vector<std::function<void(T)>> observers_;
+        bool changed_ { false };
+        uint8_t count_ { 0 };
+        std::array<std::function<void(T)>, N> observers_;
     };
 
 } // namespace ratgdo
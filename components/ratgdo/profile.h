@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+
+#include "esphome/core/hal.h"
+
+// RATGDO_PROFILE_SCOPE("name") times the rest of the enclosing scope in CPU
+// cycles when built with RATGDO_PROFILE, and compiles to nothing otherwise
+#ifdef RATGDO_PROFILE
+#define RATGDO_PROFILE_SCOPE(name)                                 \
+    static esphome::ratgdo::ProfileStat ratgdo_profile_stat_(name); \
+    esphome::ratgdo::ProfileScope ratgdo_profile_scope_(ratgdo_profile_stat_)
+#else
+#define RATGDO_PROFILE_SCOPE(name)
+#endif
+
+namespace esphome {
+namespace ratgdo {
+
+    // Call statistics of one profiled scope, all of them are linked
+    // into one list for dump_profile()
+    struct ProfileStat {
+        explicit ProfileStat(const char* name)
+            : name(name)
+            , next(first())
+        {
+            first() = this;
+        }
+
+        static ProfileStat*& first()
+        {
+            static ProfileStat* first = nullptr;
+            return first;
+        }
+
+        const char* name;
+        ProfileStat* next;
+        uint32_t count { 0 };
+        uint64_t cycles { 0 };
+        uint32_t max { 0 }; // cycles
+    };
+
+    class ProfileScope {
+    public:
+        explicit ProfileScope(ProfileStat& stat)
+            : stat_(stat)
+            , start_(arch_get_cpu_cycle_count())
+        {
+        }
+
+        ~ProfileScope()
+        {
+            uint32_t cycles = arch_get_cpu_cycle_count() - this->start_;
+            this->stat_.count++;
+            this->stat_.cycles += cycles;
+            if (cycles > this->stat_.max) {
+                this->stat_.max = cycles;
+            }
+        }
+
+    private:
+        ProfileStat& stat_;
+        uint32_t start_;
+    };
+
+    void dump_profile();
+
+} // namespace ratgdo
+} // namespace esphome
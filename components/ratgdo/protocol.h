@@ -1,6 +1,7 @@
 #pragma once
 
 #include "common.h"
+#include "observable.h"
 #include "ratgdo_state.h"
 
 namespace esphome {
@@ -23,6 +24,12 @@ namespace ratgdo {
 
         const uint32_t HAS_LOCK_TOGGLE = 1 << 20;
 
+        // wire protocols that can be detected on the GDO line
+        ENUM(ProtocolType, uint8_t,
+            (UNKNOWN, 0),
+            (SECPLUSV1, 1),
+            (SECPLUSV2, 2))
+
         class Traits {
             uint32_t value;
 
@@ -95,27 +102,32 @@ namespace ratgdo {
         SUM_TYPE(Result,
             (RollingCodeCounter, rolling_code_counter), )
 
+        // implemented by every backend
         class Protocol {
         public:
-            virtual void setup(RATGDOComponent* ratgdo, Scheduler* scheduler, InternalGPIOPin* rx_pin, InternalGPIOPin* tx_pin);
-            virtual void loop();
-            virtual void dump_config();
+            virtual void setup(RATGDOComponent* ratgdo, Scheduler* scheduler, InternalGPIOPin* rx_pin, InternalGPIOPin* tx_pin) = 0;
+            virtual void loop() = 0;
+            virtual void dump_config() = 0;
 
-            virtual void sync();
+            virtual void sync() = 0;
 
             // dry contact methods
-            virtual void set_open_limit(bool);
-            virtual void set_close_limit(bool);
-            virtual void set_discrete_open_pin(InternalGPIOPin* pin);
-            virtual void set_discrete_close_pin(InternalGPIOPin* pin);
+            virtual void set_open_limit(bool) = 0;
+            virtual void set_close_limit(bool) = 0;
+            virtual void set_discrete_open_pin(InternalGPIOPin* pin) = 0;
+            virtual void set_discrete_close_pin(InternalGPIOPin* pin) = 0;
+
+            virtual const Traits& traits() const = 0;
 
-            virtual const Traits& traits() const;
+            // a frame from the GDO is arriving or waiting to be read, another
+            // door transmitting now would lose its bytes
+            virtual bool rx_in_progress() = 0;
 
-            virtual void light_action(LightAction action);
-            virtual void lock_action(LockAction action);
-            virtual void door_action(DoorAction action);
+            virtual void light_action(LightAction action) = 0;
+            virtual void lock_action(LockAction action) = 0;
+            virtual void door_action(DoorAction action) = 0;
 
-            virtual protocol::Result call(protocol::Args args);
+            virtual protocol::Result call(protocol::Args args) = 0;
         };
 
     }
@@ -14,14 +14,22 @@
 #include "ratgdo.h"
 #include "common.h"
 #include "dry_contact.h"
+#include "profile.h"
 #include "ratgdo_state.h"
 #include "secplus1.h"
 #include "secplus2.h"
 
 #include "esphome/core/application.h"
 #include "esphome/core/gpio.h"
+#include "esphome/core/hal.h"
+#include "esphome/core/helpers.h"
 #include "esphome/core/log.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
 namespace esphome {
 namespace ratgdo {
 
@@ -29,9 +37,24 @@ namespace ratgdo {
 
     static const char* const TAG = "ratgdo";
     static const int SYNC_DELAY = 1000;
+    static const uint32_t MOTION_CLEAR_DELAY = 3000; // ms after motion was detected
+    static const float DOOR_QUERY_STATE_MARGIN = 2; // s past the door travel time before its state is queried
+
+    RATGDOComponent::~RATGDOComponent()
+    {
+        for (auto** link = &instances_; *link != nullptr; link = &(*link)->next_instance_) {
+            if (*link == this) {
+                *link = this->next_instance_;
+                break;
+            }
+        }
+    }
 
     void RATGDOComponent::setup()
     {
+        this->next_instance_ = instances_;
+        instances_ = this;
+
         this->output_gdo_pin_->setup();
         this->output_gdo_pin_->pin_mode(gpio::FLAG_OUTPUT);
 
@@ -40,9 +63,13 @@ namespace ratgdo {
 
         this->input_obst_pin_->setup();
         this->input_obst_pin_->pin_mode(gpio::FLAG_INPUT);
-        this->input_obst_pin_->attach_interrupt(RATGDOStore::isr_obstruction, &this->isr_store_, gpio::INTERRUPT_FALLING_EDGE);
+        this->isr_store_.obst_pin = this->input_obst_pin_->to_isr();
+        this->input_obst_pin_->attach_interrupt(RATGDOStore::isr_obstruction, &this->isr_store_, gpio::INTERRUPT_ANY_EDGE);
 
         this->protocol_->setup(this, &App.scheduler, this->input_gdo_pin_, this->output_gdo_pin_);
+        this->protocol_detect_.started = millis();
+        this->restore_rolling_code_counter();
+        this->load_duration_estimates();
 
         // many things happening at startup, use some delay for sync
         set_timeout(SYNC_DELAY, [=] { this->sync(); });
@@ -66,12 +93,179 @@ namespace ratgdo {
 #ifdef PROTOCOL_DRYCONTACT
         this->protocol_ = new dry_contact::DryContact();
 #endif
+#ifdef PROTOCOL_AUTO
+        // start with the protocol found on the last boot, only that backend
+        // is instantiated, switching to the other one takes a reboot
+        auto& state = this->persisted_state();
+        auto type = ProtocolType::SECPLUSV2;
+        if ((state.valid & PERSIST_PROTOCOL) && state.protocol == static_cast<uint8_t>(ProtocolType::SECPLUSV1)) {
+            type = ProtocolType::SECPLUSV1;
+        }
+        if (type == ProtocolType::SECPLUSV1) {
+            this->protocol_ = new secplus1::Secplus1();
+            this->protocol_detect_.window = secplus1::WALL_PANEL_TIMEOUT + PROTOCOL_DETECT_WINDOW;
+        } else {
+            this->protocol_ = new secplus2::Secplus2();
+        }
+        this->protocol_detect_.type = type;
+        this->protocol_detect_.pending = true;
+        this->protocol_detect_.switching = true;
+#endif
+        auto counter = this->protocol_->call(GetRollingCodeCounter {});
+        if (counter.tag == Result::Tag::rolling_code_counter) {
+            this->rolling_code_counter_ = counter.value.rolling_code_counter.value;
+        }
+    }
+
+    void RATGDOComponent::protocol_frame_received(uint8_t frames)
+    {
+        auto& detect = this->protocol_detect_;
+        if (!detect.pending) {
+            return;
+        }
+        // frames too far apart to be a conversation with the GDO start over
+        auto now = millis();
+        if (detect.frames == 0 || now - detect.first_frame > PROTOCOL_DETECT_SPAN) {
+            detect.frames = 0;
+            detect.first_frame = now;
+        }
+        detect.frames = std::min<uint16_t>(detect.frames + frames, PROTOCOL_DETECT_FRAMES);
+        if (detect.frames < PROTOCOL_DETECT_FRAMES) {
+            return;
+        }
+        detect.pending = false;
+        detect.elapsed = millis() - detect.started;
+        ESP_LOGI(TAG, "Detected protocol %s in %" PRIu32 "ms", ProtocolType_to_string(detect.type), detect.elapsed);
+
+        auto& state = this->persisted_state();
+        auto type = static_cast<uint8_t>(detect.type);
+        if (!(state.valid & PERSIST_PROTOCOL) || state.protocol != type || state.protocol_attempts != 0) {
+            state.protocol = type;
+            state.protocol_attempts = 0;
+            this->persist(PERSIST_PROTOCOL);
+        }
+    }
+
+    void RATGDOComponent::protocol_frame_rejected()
+    {
+        auto& detect = this->protocol_detect_;
+        if (detect.pending) {
+            detect.frames = 0;
+            detect.rejected++;
+        }
+    }
+
+    // Sec+1 (1200 baud 8E1) and Sec+2 (9600 baud 8N1) frames don't decode
+    // under the other protocol, a GDO that stays silent to our queries or
+    // only sends what doesn't decode speaks the other one. A protocol
+    // confirmed on an earlier boot is kept while the wire stays silent, the
+    // GDO is more likely off or unplugged than replaced, and the switches
+    // without a confirmation in between are bounded, so an unconnected or
+    // noisy board doesn't keep rebooting
+    void RATGDOComponent::protocol_detect_loop(uint32_t now)
+    {
+        auto& detect = this->protocol_detect_;
+        if (now - detect.started < detect.window) {
+            return;
+        }
+        detect.switching = false;
+        auto& state = this->persisted_state();
+        bool confirmed = (state.valid & PERSIST_PROTOCOL) && state.protocol == static_cast<uint8_t>(detect.type) && state.protocol_attempts == 0;
+        if (confirmed && detect.rejected == 0) {
+            ESP_LOGW(TAG, "The GDO is silent, staying on %s", ProtocolType_to_string(detect.type));
+            return;
+        }
+        if (state.protocol_attempts >= PROTOCOL_DETECT_ATTEMPTS) {
+            ESP_LOGW(TAG, "No valid frames from the GDO, staying on %s", ProtocolType_to_string(detect.type));
+            return;
+        }
+        auto next = detect.type == ProtocolType::SECPLUSV2 ? ProtocolType::SECPLUSV1 : ProtocolType::SECPLUSV2;
+        ESP_LOGW(TAG, "No valid %s frames in %" PRIu32 "ms (%" PRIu32 " rejected), restarting with %s",
+            ProtocolType_to_string(detect.type), now - detect.started, detect.rejected, ProtocolType_to_string(next));
+        state.protocol = static_cast<uint8_t>(next);
+        state.protocol_attempts++;
+        this->persist(PERSIST_PROTOCOL, true);
+        App.safe_reboot();
     }
 
     void RATGDOComponent::loop()
     {
+        uint32_t start = micros();
+        uint32_t now = millis();
+        if (now < this->uptime_last_) {
+            this->uptime_wraps_++;
+        }
+        this->uptime_last_ = now;
         this->obstruction_loop();
         this->protocol_->loop();
+        if (this->protocol_detect_.switching && this->protocol_detect_.pending) {
+            this->protocol_detect_loop(millis());
+        }
+        this->door_position_loop();
+        if (this->on_door_state_.size() > 0) {
+            auto dropped = this->on_door_state_.expire(millis());
+            if (dropped > 0) {
+                ESP_LOGW(TAG, "Door state did not change, dropping %zu continuations", dropped);
+            }
+        }
+        this->flush_observers();
+
+        uint32_t elapsed = micros() - start;
+        this->loop_stats_.count++;
+        this->loop_stats_.total += elapsed;
+        this->loop_stats_.max = std::max(this->loop_stats_.max, elapsed);
+    }
+
+    float RATGDOComponent::uptime_days()
+    {
+        return (this->uptime_wraps_ * 4294967296.0f + millis()) / 86400000.0f;
+    }
+
+    RATGDOComponent* RATGDOComponent::instances_ = nullptr;
+
+    // Software serial sends with interrupts disabled, the bytes the other
+    // instances receive meanwhile are lost. A send waits while another door
+    // has a frame arriving. The write blocks the loop until the last bit is
+    // out, so no other instance runs, let alone sends, before it is done
+    bool RATGDOComponent::may_transmit()
+    {
+        for (auto* other = instances_; other != nullptr; other = other->next_instance_) {
+            if (other != this && other->protocol_->rx_in_progress()) {
+                this->tx_window_waits_++;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Logs the capture oldest record first, as hex with 5 bytes per record:
+    // the little endian timestamp in us carrying the WIRE_* flags in its low
+    // bits, then the byte. Replaying it only needs the lines concatenated
+    void RATGDOComponent::dump_wire_capture()
+    {
+#ifdef RATGDO_WIRE_CAPTURE
+        const auto& capture = this->wire_capture_;
+        uint32_t count = std::min<uint32_t>(capture.total, RATGDO_WIRE_CAPTURE);
+        ESP_LOGI(TAG, "Wire capture: %" PRIu32 " records, %" PRIu32 " overwritten", count, capture.total - count);
+        uint8_t line[WIRE_DUMP_RECORDS * 5];
+        size_t len = 0;
+        uint32_t at = (capture.head + RATGDO_WIRE_CAPTURE - count) % RATGDO_WIRE_CAPTURE;
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t time = capture.times[at];
+            line[len++] = time;
+            line[len++] = time >> 8;
+            line[len++] = time >> 16;
+            line[len++] = time >> 24;
+            line[len++] = capture.bytes[at];
+            at = at + 1 == RATGDO_WIRE_CAPTURE ? 0 : at + 1;
+            if (len == sizeof(line) || i + 1 == count) {
+                ESP_LOGI(TAG, "Wire capture %04" PRIu32 ": %s", i + 1 - len / 5, format_hex(line, len).c_str());
+                len = 0;
+            }
+        }
+#else
+        ESP_LOGW(TAG, "Wire capture is disabled, set wire_capture_size to enable it");
+#endif
     }
 
     void RATGDOComponent::dump_config()
@@ -80,12 +274,64 @@ namespace ratgdo {
         LOG_PIN("  Output GDO Pin: ", this->output_gdo_pin_);
         LOG_PIN("  Input GDO Pin: ", this->input_gdo_pin_);
         LOG_PIN("  Input Obstruction Pin: ", this->input_obst_pin_);
+        if (this->protocol_detect_.type != ProtocolType::UNKNOWN) {
+            if (this->protocol_detect_.pending) {
+                ESP_LOGCONFIG(TAG, "  Protocol: auto, detecting (trying %s)", ProtocolType_to_string(this->protocol_detect_.type));
+            } else {
+                ESP_LOGCONFIG(TAG, "  Protocol: auto, detected %s in %" PRIu32 "ms",
+                    ProtocolType_to_string(this->protocol_detect_.type), this->protocol_detect_.elapsed);
+            }
+        }
+        if (this->obstruction_sensor_detected_) {
+            ESP_LOGCONFIG(TAG, "  Obstruction pulses: period %.2fms, jitter %.0fus, %" PRIu32 " ring overflows",
+                this->obst_.period / 1000, this->obst_.jitter, this->isr_store_.obst_overflows);
+        }
+#ifdef RATGDO_WIRE_CAPTURE
+        ESP_LOGCONFIG(TAG, "  Wire capture: %" PRIu32 " bytes captured, %d records kept",
+            this->wire_capture_.total, RATGDO_WIRE_CAPTURE);
+#endif
+        ESP_LOGCONFIG(TAG, "  Door position report: delta %.1f%%, interval %" PRIu32 "ms",
+            this->position_report_delta_ * 100, this->position_report_interval_);
+        ESP_LOGCONFIG(TAG, "  Door cycle reports: last %d, max %d", this->door_cycle_reports_last_, this->door_cycle_reports_max_);
+        for (size_t i = 0; i < 2; i++) {
+            const auto& estimate = this->duration_estimate_[i];
+            ESP_LOGCONFIG(TAG, "  %s duration estimate: %.2fs, stddev %.2fs (%d runs, confidence %.0f%%)", i == MOTION_OPENING ? "Opening" : "Closing",
+                estimate.mean, sqrtf(estimate.variance), estimate.samples, this->duration_confidence(i) * 100);
+            ESP_LOGCONFIG(TAG, "  %s stop latency: %.0fms (%d samples)", i == MOTION_OPENING ? "Opening" : "Closing",
+                this->motion_profile_[i].stop_latency, this->motion_profile_[i].samples);
+        }
+        const auto& response = this->door_response_;
+        ESP_LOGCONFIG(TAG, "  Door state sync: %" PRIu32 "ms, door commands answered: avg %" PRIu32 "ms, max %" PRIu32 "ms (%" PRIu32 " commands, %" PRIu32 " unanswered)",
+            response.sync_time, response.count > 0 ? response.total / response.count : 0, response.max, response.count, response.unanswered);
+        ESP_LOGCONFIG(TAG, "  Move to position error: avg %.3f, max %.3f (%d moves)",
+            this->position_error_avg_, this->position_error_max_, this->position_error_count_);
+        // commits are an upper bound of the flash writes, the preferences
+        // backend batches them further
+        float days = std::max(this->uptime_days(), 1 / 24.0f);
+        float per_day = this->persist_commits_ / days;
+        ESP_LOGCONFIG(TAG, "  Persisted state: %zu bytes, %" PRIu32 " commits (%.1f/day, flash wear limit in %.0f years)",
+            sizeof(PersistedState), this->persist_commits_, per_day, per_day > 0 ? FLASH_ENDURANCE / per_day / 365 : INFINITY);
+        ESP_LOGCONFIG(TAG, "  Loop time: avg %" PRIu32 "us, max %" PRIu32 "us, %" PRIu32 " transmit window waits",
+            this->loop_stats_.count > 0 ? uint32_t(this->loop_stats_.total / this->loop_stats_.count) : 0, this->loop_stats_.max, this->tx_window_waits_);
         this->protocol_->dump_config();
+        dump_profile();
+    }
+
+    void dump_profile()
+    {
+#ifdef RATGDO_PROFILE
+        float ns_per_cycle = 1e9f / arch_get_cpu_freq_hz();
+        for (auto* stat = ProfileStat::first(); stat != nullptr; stat = stat->next) {
+            ESP_LOGCONFIG(TAG, "  Profile %s: %" PRIu32 " calls, avg %.0fns, max %.0fns", stat->name, stat->count,
+                stat->count > 0 ? stat->cycles * ns_per_cycle / stat->count : 0, stat->max * ns_per_cycle);
+        }
+#endif
     }
 
     void RATGDOComponent::received(const DoorState door_state)
     {
-        ESP_LOGD(TAG, "Door state=%s", DoorState_to_string(door_state));
+        RATGDO_PROFILE_SCOPE("received(DoorState)");
+        ESP_LOG1(TAG, "Door state=%s", DoorState_to_string(door_state));
 
         auto prev_door_state = *this->door_state;
 
@@ -93,31 +339,22 @@ namespace ratgdo {
             return;
         }
 
-        // opening duration calibration
-        if (*this->opening_duration == 0) {
-            if (door_state == DoorState::OPENING && prev_door_state == DoorState::CLOSED) {
-                this->start_opening = millis();
-            }
-            if (door_state == DoorState::OPEN && prev_door_state == DoorState::OPENING && this->start_opening > 0) {
-                auto duration = (millis() - this->start_opening) / 1000;
-                this->set_opening_duration(round(duration * 10) / 10);
-            }
-            if (door_state == DoorState::STOPPED) {
-                this->start_opening = -1;
-            }
+        // duration calibration from full, undisturbed runs
+        if (door_state == DoorState::OPENING && prev_door_state == DoorState::CLOSED) {
+            this->start_opening = millis();
+        } else if (door_state == DoorState::OPEN && prev_door_state == DoorState::OPENING && this->start_opening != 0) {
+            this->calibrate_duration(MOTION_OPENING, millis() - this->start_opening);
         }
-        // closing duration calibration
-        if (*this->closing_duration == 0) {
-            if (door_state == DoorState::CLOSING && prev_door_state == DoorState::OPEN) {
-                this->start_closing = millis();
-            }
-            if (door_state == DoorState::CLOSED && prev_door_state == DoorState::CLOSING && this->start_closing > 0) {
-                auto duration = (millis() - this->start_closing) / 1000;
-                this->set_closing_duration(round(duration * 10) / 10);
-            }
-            if (door_state == DoorState::STOPPED) {
-                this->start_closing = -1;
-            }
+        if (door_state == DoorState::CLOSING && prev_door_state == DoorState::OPEN) {
+            this->start_closing = millis();
+        } else if (door_state == DoorState::CLOSED && prev_door_state == DoorState::CLOSING && this->start_closing != 0) {
+            this->calibrate_duration(MOTION_CLOSING, millis() - this->start_closing);
+        }
+        if (door_state != DoorState::OPENING) {
+            this->start_opening = 0;
+        }
+        if (door_state != DoorState::CLOSING) {
+            this->start_closing = 0;
         }
 
         if (door_state == DoorState::OPENING) {
@@ -132,9 +369,6 @@ namespace ratgdo {
             if (this->door_move_delta == DOOR_DELTA_UNKNOWN) {
                 this->door_move_delta = 1.0 - this->door_start_position;
             }
-            if (*this->opening_duration != 0) {
-                this->schedule_door_position_sync();
-            }
         } else if (door_state == DoorState::CLOSING) {
             // door started closing
             if (prev_door_state == DoorState::OPENING) {
@@ -147,20 +381,21 @@ namespace ratgdo {
             if (this->door_move_delta == DOOR_DELTA_UNKNOWN) {
                 this->door_move_delta = 0.0 - this->door_start_position;
             }
-            if (*this->closing_duration != 0) {
-                this->schedule_door_position_sync();
-            }
         } else if (door_state == DoorState::STOPPED) {
             this->door_position_update();
             if (*this->door_position == DOOR_POSITION_UNKNOWN) {
                 this->door_position = 0.5; // best guess
+            } else if (this->door_stop_sent_ != 0) {
+                this->door_target_stopped();
             }
             this->cancel_position_sync_callbacks();
             cancel_timeout("door_query_state");
         } else if (door_state == DoorState::OPEN) {
+            this->door_stop_sent_ = 0;
             this->door_position = 1.0;
             this->cancel_position_sync_callbacks();
         } else if (door_state == DoorState::CLOSED) {
+            this->door_stop_sent_ = 0;
             this->door_position = 0.0;
             this->cancel_position_sync_callbacks();
         }
@@ -174,12 +409,25 @@ namespace ratgdo {
         }
 
         this->door_state = door_state;
-        this->on_door_state_.trigger(door_state);
+        if (this->on_door_state_.size() > 0) {
+            this->on_door_state_.trigger(door_state);
+        }
+    }
+
+    // Continuations waiting for the next door state. Each one is dropped
+    // when the GDO doesn't report a change within its own deadline,
+    // otherwise a command given long ago would run on whatever change
+    // comes next
+    void RATGDOComponent::on_next_door_state(std::function<void(DoorState)>&& f)
+    {
+        if (!this->on_door_state_(std::move(f), millis() + DOOR_STATE_CALLBACK_TIMEOUT)) {
+            ESP_LOGW(TAG, "Too many continuations waiting for the door state, dropping one");
+        }
     }
 
     void RATGDOComponent::received(const LearnState learn_state)
     {
-        ESP_LOGD(TAG, "Learn state=%s", LearnState_to_string(learn_state));
+        ESP_LOG1(TAG, "Learn state=%s", LearnState_to_string(learn_state));
 
         if (*this->learn_state == learn_state) {
             return;
@@ -194,20 +442,20 @@ namespace ratgdo {
 
     void RATGDOComponent::received(const LightState light_state)
     {
-        ESP_LOGD(TAG, "Light state=%s", LightState_to_string(light_state));
+        ESP_LOG1(TAG, "Light state=%s", LightState_to_string(light_state));
         this->light_state = light_state;
     }
 
     void RATGDOComponent::received(const LockState lock_state)
     {
-        ESP_LOGD(TAG, "Lock state=%s", LockState_to_string(lock_state));
+        ESP_LOG1(TAG, "Lock state=%s", LockState_to_string(lock_state));
         this->lock_state = lock_state;
     }
 
     void RATGDOComponent::received(const ObstructionState obstruction_state)
     {
         if (!this->obstruction_sensor_detected_) {
-            ESP_LOGD(TAG, "Obstruction: state=%s", ObstructionState_to_string(*this->obstruction_state));
+            ESP_LOG1(TAG, "Obstruction: state=%s", ObstructionState_to_string(*this->obstruction_state));
 
             this->obstruction_state = obstruction_state;
             // This isn't very fast to update, but its still better
@@ -226,6 +474,9 @@ namespace ratgdo {
     {
         ESP_LOGD(TAG, "Button state=%s", ButtonState_to_string(*this->button_state));
         this->button_state = button_state;
+        // press and release often arrive within one loop, publish each
+        // edge instead of letting the release overwrite the press
+        this->flush_observers();
     }
 
     void RATGDOComponent::received(const MotionState motion_state)
@@ -233,7 +484,7 @@ namespace ratgdo {
         ESP_LOGD(TAG, "Motion: %s", MotionState_to_string(*this->motion_state));
         this->motion_state = motion_state;
         if (motion_state == MotionState::DETECTED) {
-            this->set_timeout("clear_motion", 3000, [=] {
+            this->set_timeout("clear_motion", MOTION_CLEAR_DELAY, [=] {
                 this->motion_state = MotionState::CLEAR;
             });
             if (*this->light_state == LightState::OFF) {
@@ -293,34 +544,207 @@ namespace ratgdo {
         ESP_LOGD(TAG, "Battery state=%s", BatteryState_to_string(battery_state));
     }
 
-    void RATGDOComponent::schedule_door_position_sync(float update_period)
+    float RATGDOComponent::door_position_at(uint32_t now) const
     {
-        ESP_LOG1(TAG, "Schedule position sync: delta %f, start position: %f, start moving: %d",
-            this->door_move_delta, this->door_start_position, this->door_start_moving);
-        auto duration = this->door_move_delta > 0 ? *this->opening_duration : *this->closing_duration;
+        if (this->door_start_moving == 0 || this->door_start_position == DOOR_POSITION_UNKNOWN || this->door_move_delta == DOOR_DELTA_UNKNOWN) {
+            return *this->door_position;
+        }
+        auto duration = this->door_move_delta > 0 ? *this->opening_duration : -*this->closing_duration;
         if (duration == 0) {
-            return;
+            return *this->door_position;
         }
-        auto count = int(1000 * duration / update_period);
-        set_retry("position_sync_while_moving", update_period, count, [=](uint8_t r) {
-            this->door_position_update();
-            return RetryResult::RETRY;
-        });
+        auto position = this->door_start_position + (now - this->door_start_moving) / (1000 * duration);
+        return clamp(position, 0.0f, 1.0f);
     }
 
-    void RATGDOComponent::door_position_update()
+    // Called every loop, reports the position of a moving door when it
+    // changed enough and the report interval has passed
+    void RATGDOComponent::door_position_loop()
     {
-        if (this->door_start_moving == 0 || this->door_start_position == DOOR_POSITION_UNKNOWN || this->door_move_delta == DOOR_DELTA_UNKNOWN) {
+        if (this->door_start_moving == 0) {
             return;
         }
         auto now = millis();
-        auto duration = this->door_move_delta > 0 ? *this->opening_duration : -*this->closing_duration;
-        if (duration == 0) {
+        if (this->door_target_position_ != DOOR_POSITION_UNKNOWN) {
+            this->door_target_loop(now);
+        }
+        if (now - this->position_last_report_ < this->position_report_interval_) {
             return;
         }
-        auto position = this->door_start_position + (now - this->door_start_moving) / (1000 * duration);
+        auto position = this->door_position_at(now);
+        auto reported = *this->door_position;
+        if (position == reported) {
+            return;
+        }
+        // the end of travel is always reported
+        if (fabsf(position - reported) < this->position_report_delta_ && position != 0.0f && position != 1.0f) {
+            return;
+        }
+        ESP_LOG2(TAG, "[%d] Position update: %f", now, position);
+        this->position_last_report_ = now;
+        this->door_position = position;
+    }
+
+    void RATGDOComponent::door_position_update()
+    {
+        auto now = millis();
+        auto position = this->door_position_at(now);
         ESP_LOG2(TAG, "[%d] Position update: %f", now, position);
-        this->door_position = clamp(position, 0.0f, 1.0f);
+        this->position_last_report_ = now;
+        this->door_position = position;
+    }
+
+    // Updates the running estimate of a full travel duration with one run,
+    // runs far from the estimate (interrupted, obstructed) are rejected
+    // unless they keep coming, then the opener changed and the estimate restarts
+    void RATGDOComponent::calibrate_duration(uint8_t direction, uint32_t elapsed)
+    {
+        auto& estimate = this->duration_estimate_[direction];
+        auto name = direction == MOTION_OPENING ? "opening" : "closing";
+        float sample = elapsed / 1000.0f;
+        if (sample < DURATION_MIN || sample > DURATION_MAX || *this->obstruction_state == ObstructionState::OBSTRUCTED) {
+            ESP_LOGD(TAG, "Ignoring %s run of %.2fs", name, sample);
+            return;
+        }
+        if (estimate.samples >= DURATION_OUTLIER_MIN_SAMPLES) {
+            float band = std::max(DURATION_OUTLIER_SIGMA * sqrtf(estimate.variance), DURATION_OUTLIER_MIN_BAND);
+            if (fabsf(sample - estimate.mean) > band) {
+                estimate.rejected++;
+                ESP_LOGD(TAG, "Rejected %s run of %.2fs, estimate %.2fs +/- %.2fs", name, sample, estimate.mean, band);
+                if (estimate.rejected < DURATION_OUTLIER_RESET) {
+                    return;
+                }
+                ESP_LOGW(TAG, "Restarting %s duration calibration after %d rejected runs", name, estimate.rejected);
+                estimate = DurationEstimate {};
+            }
+        }
+        estimate.rejected = 0;
+        if (estimate.samples < UINT16_MAX) {
+            estimate.samples++;
+        }
+        // cumulative average for the first runs, then exponentially weighted
+        float alpha = 1.0f / std::min<uint16_t>(estimate.samples, DURATION_WEIGHT);
+        float diff = sample - estimate.mean;
+        estimate.mean += alpha * diff;
+        estimate.variance = (1 - alpha) * (estimate.variance + alpha * diff * diff);
+        ESP_LOGD(TAG, "Calibrated %s duration: %.2fs (run %.2fs, stddev %.2fs, %d runs, confidence %.0f%%)",
+            name, estimate.mean, sample, sqrtf(estimate.variance), estimate.samples, this->duration_confidence(direction) * 100);
+        this->save_duration_estimates();
+
+        auto duration = roundf(estimate.mean * 10) / 10;
+        if (direction == MOTION_OPENING && duration != *this->opening_duration) {
+            this->set_opening_duration(duration);
+        } else if (direction == MOTION_CLOSING && duration != *this->closing_duration) {
+            this->set_closing_duration(duration);
+        }
+    }
+
+    // 0..1, grows with the number of runs and shrinks with their spread
+    float RATGDOComponent::duration_confidence(uint8_t direction) const
+    {
+        const auto& estimate = this->duration_estimate_[direction];
+        if (estimate.samples == 0 || estimate.mean <= 0) {
+            return 0;
+        }
+        float coverage = std::min(1.0f, float(estimate.samples) / DURATION_WEIGHT);
+        float spread = sqrtf(estimate.variance) / estimate.mean;
+        return coverage * std::max(0.0f, 1.0f - DURATION_CONFIDENCE_SPREAD * spread);
+    }
+
+    void RATGDOComponent::load_duration_estimates()
+    {
+        const auto& state = this->persisted_state();
+        if (!(state.valid & PERSIST_DURATION_ESTIMATES)) {
+            return;
+        }
+        for (size_t i = 0; i < 2; i++) {
+            auto& estimate = this->duration_estimate_[i];
+            estimate.mean = state.durations[i].mean / 100.0f;
+            float stddev = state.durations[i].stddev / 100.0f;
+            estimate.variance = stddev * stddev;
+            estimate.samples = state.durations[i].samples;
+        }
+        // the number entities restore the durations, fill in the ones that are not configured
+        if (*this->opening_duration == 0 && this->duration_estimate_[MOTION_OPENING].samples > 0) {
+            this->set_opening_duration(roundf(this->duration_estimate_[MOTION_OPENING].mean * 10) / 10);
+        }
+        if (*this->closing_duration == 0 && this->duration_estimate_[MOTION_CLOSING].samples > 0) {
+            this->set_closing_duration(roundf(this->duration_estimate_[MOTION_CLOSING].mean * 10) / 10);
+        }
+    }
+
+    void RATGDOComponent::save_duration_estimates()
+    {
+        auto& state = this->persisted_state();
+        for (size_t i = 0; i < 2; i++) {
+            const auto& estimate = this->duration_estimate_[i];
+            state.durations[i].mean = roundf(estimate.mean * 100);
+            state.durations[i].stddev = std::min(roundf(sqrtf(estimate.variance) * 100), float(UINT16_MAX));
+            state.durations[i].samples = estimate.samples;
+        }
+        this->persist(PERSIST_DURATION_ESTIMATES);
+    }
+
+    static uint16_t persisted_state_crc(const PersistedState& state)
+    {
+        return crc16(reinterpret_cast<const uint8_t*>(&state), offsetof(PersistedState, crc));
+    }
+
+    // The persisted state is loaded on first use, children restore from it
+    // in their setup() which runs before the setup() of the component
+    PersistedState& RATGDOComponent::persisted_state()
+    {
+        if (this->persisted_loaded_) {
+            return this->persisted_;
+        }
+        this->persisted_loaded_ = true;
+        this->persisted_pref_ = global_preferences->make_preference<PersistedState>(fnv1_hash("ratgdo_state") ^ this->preference_key_);
+        PersistedState state;
+        if (this->persisted_pref_.load(&state) && state.version == PERSIST_VERSION && state.crc == persisted_state_crc(state)) {
+            ESP_LOGD(TAG, "Restored persisted state (fields 0x%02x)", state.valid);
+            this->persisted_ = state;
+        } else {
+            // children migrate their own legacy preferences into the record
+            ESP_LOGD(TAG, "No persisted state, starting a new record");
+            memset(&this->persisted_, 0, sizeof(this->persisted_));
+            this->persisted_.version = PERSIST_VERSION;
+        }
+        return this->persisted_;
+    }
+
+    // Marks fields as changed, they are committed together at the end of
+    // the write window. Urgent fields are committed and synced to flash at once
+    void RATGDOComponent::persist(uint8_t fields, bool urgent)
+    {
+        this->persisted_.valid |= fields;
+        this->persist_dirty_ |= fields;
+        if (urgent) {
+            this->commit_persisted_state(true);
+            return;
+        }
+        if (!this->persist_scheduled_) {
+            this->persist_scheduled_ = true;
+            set_timeout("persist", PERSIST_WINDOW, [=] { this->commit_persisted_state(false); });
+        }
+    }
+
+    void RATGDOComponent::commit_persisted_state(bool sync)
+    {
+        if (this->persist_scheduled_) {
+            this->persist_scheduled_ = false;
+            cancel_timeout("persist");
+        }
+        if (this->persist_dirty_ == 0) {
+            return;
+        }
+        ESP_LOG1(TAG, "Committing persisted state (changed 0x%02x)", this->persist_dirty_);
+        this->persisted_.crc = persisted_state_crc(this->persisted_);
+        this->persisted_pref_.save(&this->persisted_);
+        if (sync) {
+            global_preferences->sync();
+        }
+        this->persist_dirty_ = 0;
+        this->persist_commits_++;
     }
 
     void RATGDOComponent::set_opening_duration(float duration)
@@ -342,48 +766,70 @@ namespace ratgdo {
 
     /*************************** OBSTRUCTION DETECTION ***************************/
 
+    // Drains the edges captured by the ISR. The sensor is clear while
+    // pulses keep their period, when they stop the line level tells
+    // asleep (LOW) from obstructed (HIGH). Only the falling edges are
+    // timed, pulse widths aren't looked at. With the OBST_MISSING_MIN
+    // floor an obstruction is reported about 50ms after the last pulse,
+    // about as soon as the 50ms poll this replaced did
     void RATGDOComponent::obstruction_loop()
     {
-        long current_millis = millis();
-        static unsigned long last_millis = 0;
-        static unsigned long last_asleep = 0;
-
-        // the obstruction sensor has 3 states: clear (HIGH with LOW pulse every 7ms), obstructed (HIGH), asleep (LOW)
-        // the transitions between awake and asleep are tricky because the voltage drops slowly when falling asleep
-        // and is high without pulses when waking up
-
-        // If at least 3 low pulses are counted within 50ms, the door is awake, not obstructed and we don't have to check anything else
-
-        const long CHECK_PERIOD = 50;
-        const long PULSES_LOWER_LIMIT = 3;
-
-        if (current_millis - last_millis > CHECK_PERIOD) {
-            // ESP_LOGD(TAG, "%ld: Obstruction count: %d, expected: %d, since asleep: %ld",
-            //     current_millis, this->isr_store_.obstruction_low_count, PULSES_EXPECTED,
-            //     current_millis - last_asleep
-            // );
-
-            // check to see if we got more then PULSES_LOWER_LIMIT pulses
-            if (this->isr_store_.obstruction_low_count > PULSES_LOWER_LIMIT) {
-                this->obstruction_state = ObstructionState::CLEAR;
-                this->obstruction_sensor_detected_ = true;
-            } else if (this->isr_store_.obstruction_low_count == 0) {
-                // if there have been no pulses the line is steady high or low
-                if (!this->input_obst_pin_->digital_read()) {
-                    // asleep
-                    last_asleep = current_millis;
-                } else {
-                    // if the line is high and was last asleep more than 700ms ago, then there is an obstruction present
-                    if (current_millis - last_asleep > 700) {
-                        this->obstruction_state = ObstructionState::OBSTRUCTED;
-                    }
-                }
+        auto& store = this->isr_store_;
+        while (store.obst_tail != store.obst_head) {
+            uint32_t edge = store.obst_edges[store.obst_tail];
+            store.obst_tail = (store.obst_tail + 1) & (OBST_EDGE_RING - 1);
+            this->obstruction_edge(edge & ~1u, edge & 1);
+        }
+
+        auto& obst = this->obst_;
+        uint32_t quiet = micros() - obst.last_edge;
+        if (quiet < std::max<uint32_t>(obst.period * OBST_MISSING_PERIODS, OBST_MISSING_MIN)) {
+            return;
+        }
+        obst.pulses = 0;
+        auto now = millis();
+        if (!this->input_obst_pin_->digital_read()) {
+            obst.last_asleep = now;
+            obst.pulsing = false;
+            return;
+        }
+        // the line goes high without pulses both when an obstruction interrupts
+        // the pulse train and when the sensor wakes up, only the latter comes
+        // from a low line and needs the wake up guard
+        if (obst.pulsing || now - obst.last_asleep > OBST_WAKE_GUARD) {
+            if (*this->obstruction_state != ObstructionState::OBSTRUCTED) {
+                ESP_LOGD(TAG, "Obstruction detected %" PRIu32 "ms after the last pulse", quiet / 1000);
             }
-            last_millis = current_millis;
-            this->isr_store_.obstruction_low_count = 0;
+            this->obstruction_state = ObstructionState::OBSTRUCTED;
         }
     }
 
+    void RATGDOComponent::obstruction_edge(uint32_t time, bool level)
+    {
+        auto& obst = this->obst_;
+        obst.last_edge = time;
+        // the period is measured between falling edges
+        if (level) {
+            return;
+        }
+        uint32_t period = time - obst.last_fall;
+        obst.last_fall = time;
+        if (period < OBST_PERIOD_MIN || period > OBST_PERIOD_MAX) {
+            obst.pulses = 0;
+            return;
+        }
+        float deviation = fabsf(float(period) - obst.period);
+        obst.period += (float(period) - obst.period) / OBST_PERIOD_WEIGHT;
+        obst.jitter += (deviation - obst.jitter) / OBST_PERIOD_WEIGHT;
+        if (obst.pulses < OBST_PULSES_CLEAR) {
+            obst.pulses++;
+            return;
+        }
+        obst.pulsing = true;
+        this->obstruction_state = ObstructionState::CLEAR;
+        this->obstruction_sensor_detected_ = true;
+    }
+
     void RATGDOComponent::query_status()
     {
         this->protocol_->call(QueryStatus {});
@@ -411,6 +857,10 @@ namespace ratgdo {
 
     void RATGDOComponent::sync()
     {
+        if (*this->door_state == DoorState::UNKNOWN) {
+            this->door_response_.syncing = true;
+            this->door_response_.sync_start = millis();
+        }
         this->protocol_->sync();
 
         // dry contact protocol:
@@ -424,6 +874,7 @@ namespace ratgdo {
 
     void RATGDOComponent::door_open()
     {
+        this->cancel_door_target();
         if (*this->door_state == DoorState::OPENING) {
             return; // gets ignored by opener
         }
@@ -432,7 +883,7 @@ namespace ratgdo {
 
         if (*this->opening_duration > 0) {
             // query state in case we don't get a status message
-            set_timeout("door_query_state", (*this->opening_duration + 2) * 1000, [=]() {
+            set_timeout("door_query_state", (*this->opening_duration + DOOR_QUERY_STATE_MARGIN) * 1000, [=]() {
                 if (*this->door_state != DoorState::OPEN && *this->door_state != DoorState::STOPPED) {
                     this->received(DoorState::OPEN); // probably missed a status mesage, assume it's open
                     this->query_status(); // query in case we're wrong and it's stopped
@@ -443,6 +894,7 @@ namespace ratgdo {
 
     void RATGDOComponent::door_close()
     {
+        this->cancel_door_target();
         if (*this->door_state == DoorState::CLOSING) {
             return; // gets ignored by opener
         }
@@ -450,7 +902,7 @@ namespace ratgdo {
         if (*this->door_state == DoorState::OPENING) {
             // have to stop door first, otherwise close command is ignored
             this->door_action(DoorAction::STOP);
-            this->on_door_state_([=](DoorState s) {
+            this->on_next_door_state([=](DoorState s) {
                 if (s == DoorState::STOPPED) {
                     this->door_action(DoorAction::CLOSE);
                 } else {
@@ -469,7 +921,7 @@ namespace ratgdo {
 
         if (*this->closing_duration > 0) {
             // query state in case we don't get a status message
-            set_timeout("door_query_state", (*this->closing_duration + 2) * 1000, [=]() {
+            set_timeout("door_query_state", (*this->closing_duration + DOOR_QUERY_STATE_MARGIN) * 1000, [=]() {
                 if (*this->door_state != DoorState::CLOSED && *this->door_state != DoorState::STOPPED) {
                     this->received(DoorState::CLOSED); // probably missed a status mesage, assume it's closed
                     this->query_status(); // query in case we're wrong and it's stopped
@@ -480,6 +932,7 @@ namespace ratgdo {
 
     void RATGDOComponent::door_stop()
     {
+        this->cancel_door_target();
         if (*this->door_state != DoorState::OPENING && *this->door_state != DoorState::CLOSING) {
             ESP_LOGW(TAG, "The door is not moving.");
             return;
@@ -489,11 +942,23 @@ namespace ratgdo {
 
     void RATGDOComponent::door_toggle()
     {
+        this->cancel_door_target();
         this->door_action(DoorAction::TOGGLE);
     }
 
     void RATGDOComponent::door_action(DoorAction action)
     {
+        auto& response = this->door_response_;
+        auto now = millis();
+        if (response.command_pending && now - response.command_sent > DOOR_RESPONSE_TIMEOUT) {
+            response.unanswered++;
+        }
+        // a command sent while the previous one is unanswered is timed
+        // from the first, that is when the user started waiting
+        if (!response.command_pending || now - response.command_sent > DOOR_RESPONSE_TIMEOUT) {
+            response.command_pending = true;
+            response.command_sent = now;
+        }
         this->protocol_->door_action(action);
     }
 
@@ -501,7 +966,7 @@ namespace ratgdo {
     {
         if (*this->door_state == DoorState::OPENING || *this->door_state == DoorState::CLOSING) {
             this->door_action(DoorAction::STOP);
-            this->on_door_state_([=](DoorState s) {
+            this->on_next_door_state([=](DoorState s) {
                 if (s == DoorState::STOPPED) {
                     this->door_move_to_position(position);
                 }
@@ -509,7 +974,7 @@ namespace ratgdo {
             return;
         }
 
-        auto delta = position - *this->door_position;
+        auto delta = position - this->get_door_position();
         if (delta == 0) {
             ESP_LOGD(TAG, "Door is already at position %.2f", position);
             return;
@@ -525,19 +990,90 @@ namespace ratgdo {
         this->door_move_delta = delta;
         ESP_LOGD(TAG, "Moving to position %.2f in %.1fs", position, operation_time / 1000.0);
 
+        // STOP is sent from door_target_loop() once the door is reported moving
+        this->door_target_position_ = position;
         this->door_action(delta > 0 ? DoorAction::OPEN : DoorAction::CLOSE);
-        set_timeout("move_to_position", operation_time, [=] {
-            this->door_action(DoorAction::STOP);
+        set_timeout("door_target", DOOR_RESPONSE_TIMEOUT, [=]() {
+            if (this->door_start_moving == 0) {
+                ESP_LOGW(TAG, "Door did not start moving, dropping target %.2f", position);
+                this->cancel_door_target();
+            }
         });
     }
 
+    // Sends STOP when the remaining travel to the target takes no longer than
+    // the learned stop latency of the current direction, so the door coasts
+    // to the target instead of past it
+    void RATGDOComponent::door_target_loop(uint32_t now)
+    {
+        if (this->door_start_moving == 0 || this->door_move_delta == DOOR_DELTA_UNKNOWN) {
+            return;
+        }
+        auto duration = this->door_move_delta > 0 ? *this->opening_duration : -*this->closing_duration;
+        if (duration == 0) {
+            return;
+        }
+        auto direction = this->door_move_delta > 0 ? MOTION_OPENING : MOTION_CLOSING;
+        auto remaining = 1000 * duration * (this->door_target_position_ - this->door_position_at(now));
+        if (remaining > this->motion_profile_[direction].stop_latency) {
+            return;
+        }
+        ESP_LOG1(TAG, "Stopping %.0fms before target %.2f", remaining, this->door_target_position_);
+        this->door_stop_sent_ = now;
+        this->door_stop_direction_ = direction;
+        this->door_stop_target_ = this->door_target_position_;
+        this->door_target_position_ = DOOR_POSITION_UNKNOWN;
+        this->door_action(DoorAction::STOP);
+    }
+
+    // The door stopped after a move to position, learn how long it kept moving
+    // after STOP was sent and how far from the target it ended up
+    void RATGDOComponent::door_target_stopped()
+    {
+        auto latency = millis() - this->door_stop_sent_;
+        this->door_stop_sent_ = 0;
+        if (latency > MOTION_STOP_LATENCY_MAX) {
+            ESP_LOGW(TAG, "Ignoring stop latency of %" PRIu32 "ms", latency);
+            return;
+        }
+        auto& profile = this->motion_profile_[this->door_stop_direction_];
+        if (profile.samples == 0) {
+            profile.stop_latency = latency;
+        } else {
+            profile.stop_latency += (float(latency) - profile.stop_latency) / MOTION_PROFILE_WEIGHT;
+        }
+        profile.samples++;
+
+        auto error = *this->door_position - this->door_stop_target_;
+        if (this->position_error_count_ == 0) {
+            this->position_error_avg_ = fabsf(error);
+        } else {
+            this->position_error_avg_ += (fabsf(error) - this->position_error_avg_) / MOTION_PROFILE_WEIGHT;
+        }
+        this->position_error_count_++;
+        this->position_error_max_ = std::max(this->position_error_max_, fabsf(error));
+        ESP_LOGD(TAG, "Stopped at %.3f, target %.3f (error %+.3f), stop latency %" PRIu32 "ms (%s avg %.0fms)",
+            *this->door_position, this->door_stop_target_, error, latency,
+            this->door_stop_direction_ == MOTION_OPENING ? "opening" : "closing", profile.stop_latency);
+    }
+
+    // Drops a move to position that hasn't reached its target. The delta
+    // it set for the door to start moving on goes too, unless the door is
+    // already moving and its position estimate runs on it
+    void RATGDOComponent::cancel_door_target()
+    {
+        cancel_timeout("door_target");
+        this->door_target_position_ = DOOR_POSITION_UNKNOWN;
+        if (this->door_start_moving == 0) {
+            this->door_move_delta = DOOR_DELTA_UNKNOWN;
+        }
+    }
+
     void RATGDOComponent::cancel_position_sync_callbacks()
     {
+        this->cancel_door_target();
         if (this->door_start_moving != 0) {
             ESP_LOGD(TAG, "Cancelling position callbacks");
-            cancel_timeout("move_to_position");
-            cancel_retry("position_sync_while_moving");
-
             this->door_start_moving = 0;
             this->door_start_position = DOOR_POSITION_UNKNOWN;
             this->door_move_delta = DOOR_DELTA_UNKNOWN;
@@ -597,87 +1133,243 @@ namespace ratgdo {
         this->protocol_->call(InactivateLearn {});
     }
 
+    /*************************** ROLLING CODE ***************************/
+
+    // The rolling code counter is persisted as the end of a lease of codes,
+    // a new lease is only taken when the counter reaches it. After a reboot
+    // the counter resumes from the lease end, so no code is ever reused.
+    // This is independent of the rolling code counter entity
+    void RATGDOComponent::restore_rolling_code_counter()
+    {
+        if (this->rolling_code_counter_ == nullptr) {
+            return;
+        }
+        const auto& state = this->persisted_state();
+        if (state.valid & PERSIST_ROLLING_CODE) {
+            ESP_LOGD(TAG, "Rolling code counter resumes at %" PRIu32, state.rolling_code_lease);
+            this->protocol_->call(SetRollingCodeCounter { state.rolling_code_lease });
+        }
+        // the first code sent takes a lease from wherever the counter starts
+        this->rolling_code_lease_end_ = **this->rolling_code_counter_;
+    }
+
+    // The lease is taken before the code is encoded, so a code is in flash
+    // before the GDO can see it, whatever happens to the board after
+    void RATGDOComponent::use_rolling_code(uint32_t counter)
+    {
+        if (rolling_code_reached(counter, this->rolling_code_lease_end_)) {
+            this->lease_rolling_codes(counter);
+        }
+    }
+
+    void RATGDOComponent::lease_rolling_codes(uint32_t counter)
+    {
+        this->rolling_code_lease_end_ = (counter + ROLLING_CODE_LEASE) & ROLLING_CODE_MASK;
+        auto& state = this->persisted_state();
+        state.rolling_code_lease = this->rolling_code_lease_end_;
+        this->persist(PERSIST_ROLLING_CODE, true);
+        ESP_LOGD(TAG, "Rolling code counter leased up to %" PRIu32, this->rolling_code_lease_end_);
+    }
+
+    // A counter set by the user, possibly below the current lease, takes a
+    // lease of its own right away so it survives a reboot
+    void RATGDOComponent::set_rolling_code_counter(uint32_t counter)
+    {
+        this->protocol_->call(SetRollingCodeCounter { counter });
+        if (this->rolling_code_counter_ != nullptr) {
+            this->lease_rolling_codes(**this->rolling_code_counter_);
+        }
+    }
+
     void RATGDOComponent::subscribe_rolling_code_counter(std::function<void(uint32_t)>&& f)
     {
-        // change update to children is defered until after component loop
-        // if multiple changes occur during component loop, only the last one is notified
+        // notified from the protocol loop, if multiple changes occur
+        // during the loop only the last one is notified
         auto counter = this->protocol_->call(GetRollingCodeCounter {});
         if (counter.tag == Result::Tag::rolling_code_counter) {
-            counter.value.rolling_code_counter.value->subscribe([=](uint32_t state) { defer("rolling_code_counter", [=] { f(state); }); });
+            counter.value.rolling_code_counter.value->subscribe(std::move(f));
         }
     }
     void RATGDOComponent::subscribe_opening_duration(std::function<void(float)>&& f)
     {
-        this->opening_duration.subscribe([=](float state) { defer("opening_duration", [=] { f(state); }); });
+        this->subscribe_state(STATE_OPENING_DURATION, [f](const GdoStateSnapshot& s, uint32_t) { f(s.opening_duration); });
     }
     void RATGDOComponent::subscribe_closing_duration(std::function<void(float)>&& f)
     {
-        this->closing_duration.subscribe([=](float state) { defer("closing_duration", [=] { f(state); }); });
+        this->subscribe_state(STATE_CLOSING_DURATION, [f](const GdoStateSnapshot& s, uint32_t) { f(s.closing_duration); });
     }
     void RATGDOComponent::subscribe_openings(std::function<void(uint16_t)>&& f)
     {
-        this->openings.subscribe([=](uint16_t state) { defer("openings", [=] { f(state); }); });
+        this->subscribe_state(STATE_OPENINGS, [f](const GdoStateSnapshot& s, uint32_t) { f(s.openings); });
     }
     void RATGDOComponent::subscribe_paired_devices_total(std::function<void(uint16_t)>&& f)
     {
-        this->paired_total.subscribe([=](uint16_t state) { defer("paired_total", [=] { f(state); }); });
+        this->subscribe_state(STATE_PAIRED_TOTAL, [f](const GdoStateSnapshot& s, uint32_t) { f(s.paired_total); });
     }
     void RATGDOComponent::subscribe_paired_remotes(std::function<void(uint16_t)>&& f)
     {
-        this->paired_remotes.subscribe([=](uint16_t state) { defer("paired_remotes", [=] { f(state); }); });
+        this->subscribe_state(STATE_PAIRED_REMOTES, [f](const GdoStateSnapshot& s, uint32_t) { f(s.paired_remotes); });
     }
     void RATGDOComponent::subscribe_paired_keypads(std::function<void(uint16_t)>&& f)
     {
-        this->paired_keypads.subscribe([=](uint16_t state) { defer("paired_keypads", [=] { f(state); }); });
+        this->subscribe_state(STATE_PAIRED_KEYPADS, [f](const GdoStateSnapshot& s, uint32_t) { f(s.paired_keypads); });
     }
     void RATGDOComponent::subscribe_paired_wall_controls(std::function<void(uint16_t)>&& f)
     {
-        this->paired_wall_controls.subscribe([=](uint16_t state) { defer("paired_wall_controls", [=] { f(state); }); });
+        this->subscribe_state(STATE_PAIRED_WALL_CONTROLS, [f](const GdoStateSnapshot& s, uint32_t) { f(s.paired_wall_controls); });
     }
     void RATGDOComponent::subscribe_paired_accessories(std::function<void(uint16_t)>&& f)
     {
-        this->paired_accessories.subscribe([=](uint16_t state) { defer("paired_accessories", [=] { f(state); }); });
+        this->subscribe_state(STATE_PAIRED_ACCESSORIES, [f](const GdoStateSnapshot& s, uint32_t) { f(s.paired_accessories); });
     }
     void RATGDOComponent::subscribe_door_state(std::function<void(DoorState, float)>&& f)
     {
-        this->door_state.subscribe([=](DoorState state) {
-            defer("door_state", [=] { f(state, *this->door_position); });
-        });
-        this->door_position.subscribe([=](float position) {
-            defer("door_state", [=] { f(*this->door_state, position); });
-        });
+        this->subscribe_state(STATE_DOOR | STATE_DOOR_POSITION, [f](const GdoStateSnapshot& s, uint32_t) { f(s.door_state, s.door_position); });
     }
     void RATGDOComponent::subscribe_light_state(std::function<void(LightState)>&& f)
     {
-        this->light_state.subscribe([=](LightState state) { defer("light_state", [=] { f(state); }); });
+        this->subscribe_state(STATE_LIGHT, [f](const GdoStateSnapshot& s, uint32_t) { f(s.light_state); });
     }
     void RATGDOComponent::subscribe_lock_state(std::function<void(LockState)>&& f)
     {
-        this->lock_state.subscribe([=](LockState state) { defer("lock_state", [=] { f(state); }); });
+        this->subscribe_state(STATE_LOCK, [f](const GdoStateSnapshot& s, uint32_t) { f(s.lock_state); });
     }
     void RATGDOComponent::subscribe_obstruction_state(std::function<void(ObstructionState)>&& f)
     {
-        this->obstruction_state.subscribe([=](ObstructionState state) { defer("obstruction_state", [=] { f(state); }); });
+        this->subscribe_state(STATE_OBSTRUCTION, [f](const GdoStateSnapshot& s, uint32_t) { f(s.obstruction_state); });
     }
     void RATGDOComponent::subscribe_motor_state(std::function<void(MotorState)>&& f)
     {
-        this->motor_state.subscribe([=](MotorState state) { defer("motor_state", [=] { f(state); }); });
+        this->subscribe_state(STATE_MOTOR, [f](const GdoStateSnapshot& s, uint32_t) { f(s.motor_state); });
     }
     void RATGDOComponent::subscribe_button_state(std::function<void(ButtonState)>&& f)
     {
-        this->button_state.subscribe([=](ButtonState state) { defer("button_state", [=] { f(state); }); });
+        this->subscribe_state(STATE_BUTTON, [f](const GdoStateSnapshot& s, uint32_t) { f(s.button_state); });
     }
     void RATGDOComponent::subscribe_motion_state(std::function<void(MotionState)>&& f)
     {
-        this->motion_state.subscribe([=](MotionState state) { defer("motion_state", [=] { f(state); }); });
+        this->subscribe_state(STATE_MOTION, [f](const GdoStateSnapshot& s, uint32_t) { f(s.motion_state); });
     }
     void RATGDOComponent::subscribe_sync_failed(std::function<void(bool)>&& f)
     {
-        this->sync_failed.subscribe(std::move(f));
+        this->subscribe_state(STATE_SYNC_FAILED, [f](const GdoStateSnapshot& s, uint32_t) { f(s.sync_failed); });
     }
     void RATGDOComponent::subscribe_learn_state(std::function<void(LearnState)>&& f)
     {
-        this->learn_state.subscribe([=](LearnState state) { defer("learn_state", [=] { f(state); }); });
+        this->subscribe_state(STATE_LEARN, [f](const GdoStateSnapshot& s, uint32_t) { f(s.learn_state); });
+    }
+
+    // f is called with the snapshot and the changed-field mask whenever one of fields changed
+    void RATGDOComponent::subscribe_state(uint32_t fields, StateObserver&& f)
+    {
+        if (this->state_observer_count_ == RATGDO_MAX_STATE_OBSERVERS) {
+            ESP_LOGE(TAG, "Too many state observers");
+            return;
+        }
+        auto& observer = this->state_observers_[this->state_observer_count_++];
+        observer.fields = fields;
+        observer.f = std::move(f);
+    }
+
+    template <typename T, typename U>
+    static void take_field(state_field<T>& field, U& value, uint32_t bit, uint32_t& changed)
+    {
+        if (field.take_changed()) {
+            value = *field;
+            changed |= bit;
+        }
+    }
+
+    // Counts the door state/position publishes from the start of a movement
+    // until the door comes to rest, each one is a cover update sent to the API
+    void RATGDOComponent::count_door_cycle_report()
+    {
+        auto door_state = this->state_.door_state;
+        bool moving = door_state == DoorState::OPENING || door_state == DoorState::CLOSING;
+        if (!moving && this->door_cycle_reports_ == 0) {
+            return;
+        }
+        this->door_cycle_reports_++;
+        if (!moving) {
+            ESP_LOGD(TAG, "Door cycle ended %s after %d state/position reports", DoorState_to_string(door_state), this->door_cycle_reports_);
+            this->door_cycle_reports_last_ = this->door_cycle_reports_;
+            this->door_cycle_reports_max_ = std::max(this->door_cycle_reports_max_, this->door_cycle_reports_);
+            this->door_cycle_reports_ = 0;
+        }
+    }
+
+    void RATGDOComponent::record_door_response(uint32_t now)
+    {
+        auto& response = this->door_response_;
+        if (response.syncing && this->state_.door_state != DoorState::UNKNOWN) {
+            response.syncing = false;
+            response.sync_time = now - response.sync_start;
+            ESP_LOGD(TAG, "Door state synced in %" PRIu32 "ms", response.sync_time);
+        }
+        if (!response.command_pending) {
+            return;
+        }
+        response.command_pending = false;
+        uint32_t elapsed = now - response.command_sent;
+        if (elapsed > DOOR_RESPONSE_TIMEOUT) {
+            // the change was not caused by the command
+            response.unanswered++;
+            return;
+        }
+        ESP_LOG1(TAG, "Door command answered in %" PRIu32 "ms", elapsed);
+        response.count++;
+        response.total += elapsed;
+        response.max = std::max(response.max, elapsed);
+    }
+
+    // All received() calls within one loop update the state fields, the
+    // snapshot is then published to the children once, with the changed-field mask
+    void RATGDOComponent::flush_observers()
+    {
+        auto& s = this->state_;
+        uint32_t changed = 0;
+        take_field(this->door_state, s.door_state, STATE_DOOR, changed);
+        take_field(this->door_position, s.door_position, STATE_DOOR_POSITION, changed);
+        take_field(this->light_state, s.light_state, STATE_LIGHT, changed);
+        take_field(this->lock_state, s.lock_state, STATE_LOCK, changed);
+        take_field(this->obstruction_state, s.obstruction_state, STATE_OBSTRUCTION, changed);
+        take_field(this->motor_state, s.motor_state, STATE_MOTOR, changed);
+        take_field(this->button_state, s.button_state, STATE_BUTTON, changed);
+        take_field(this->motion_state, s.motion_state, STATE_MOTION, changed);
+        take_field(this->learn_state, s.learn_state, STATE_LEARN, changed);
+        take_field(this->openings, s.openings, STATE_OPENINGS, changed);
+        take_field(this->opening_duration, s.opening_duration, STATE_OPENING_DURATION, changed);
+        take_field(this->closing_duration, s.closing_duration, STATE_CLOSING_DURATION, changed);
+        take_field(this->paired_total, s.paired_total, STATE_PAIRED_TOTAL, changed);
+        take_field(this->paired_remotes, s.paired_remotes, STATE_PAIRED_REMOTES, changed);
+        take_field(this->paired_keypads, s.paired_keypads, STATE_PAIRED_KEYPADS, changed);
+        take_field(this->paired_wall_controls, s.paired_wall_controls, STATE_PAIRED_WALL_CONTROLS, changed);
+        take_field(this->paired_accessories, s.paired_accessories, STATE_PAIRED_ACCESSORIES, changed);
+        take_field(this->sync_failed, s.sync_failed, STATE_SYNC_FAILED, changed);
+        if (changed == 0) {
+            return;
+        }
+        RATGDO_PROFILE_SCOPE("flush_observers");
+
+        if (changed & (STATE_DOOR | STATE_DOOR_POSITION)) {
+            this->count_door_cycle_report();
+        }
+        if (changed & STATE_DOOR) {
+            this->record_door_response(millis());
+        }
+
+        if (changed & (STATE_DOOR | STATE_LIGHT | STATE_LOCK | STATE_OBSTRUCTION | STATE_MOTOR | STATE_MOTION | STATE_LEARN)) {
+            ESP_LOGD(TAG, "State: door=%s light=%s lock=%s obstruction=%s motor=%s motion=%s learn=%s",
+                DoorState_to_string(s.door_state), LightState_to_string(s.light_state), LockState_to_string(s.lock_state),
+                ObstructionState_to_string(s.obstruction_state), MotorState_to_string(s.motor_state),
+                MotionState_to_string(s.motion_state), LearnState_to_string(s.learn_state));
+        }
+        for (uint8_t i = 0; i < this->state_observer_count_; i++) {
+            const auto& observer = this->state_observers_[i];
+            if (observer.fields & changed) {
+                observer.f(s, changed);
+            }
+        }
     }
 
     // dry contact methods
@@ -16,6 +16,7 @@
 #include "esphome/components/binary_sensor/binary_sensor.h"
 #include "esphome/core/component.h"
 #include "esphome/core/defines.h"
+#include "esphome/core/gpio.h"
 #include "esphome/core/hal.h"
 #include "esphome/core/preferences.h"
 
@@ -24,6 +25,12 @@
 #include "observable.h"
 #include "protocol.h"
 #include "ratgdo_state.h"
+#include "rolling_code.h"
+
+// upper bound of children observing one ratgdo, generated from the configuration
+#ifndef RATGDO_MAX_STATE_OBSERVERS
+#define RATGDO_MAX_STATE_OBSERVERS 16
+#endif
 
 namespace esphome {
 class InternalGPIOPin;
@@ -36,12 +43,157 @@ namespace ratgdo {
     const float DOOR_DELTA_UNKNOWN = -2.0;
     const uint16_t PAIRED_DEVICES_UNKNOWN = 0xFF;
 
+    const uint8_t MOTION_OPENING = 0;
+    const uint8_t MOTION_CLOSING = 1;
+    const uint32_t MOTION_STOP_LATENCY_MAX = 5000; // ms, longer means the STOP was not what stopped the door
+    const uint8_t MOTION_PROFILE_WEIGHT = 4; // EWMA weight of the previous samples
+
+    const float DURATION_MIN = 1; // s, shorter runs are not full travels
+    const float DURATION_MAX = 180; // s, same limit as the duration numbers
+    const uint16_t DURATION_WEIGHT = 8; // EWMA weight once there are enough runs
+    const uint16_t DURATION_OUTLIER_MIN_SAMPLES = 3; // runs before outliers are rejected
+    const float DURATION_OUTLIER_SIGMA = 3;
+    const float DURATION_OUTLIER_MIN_BAND = 1; // s
+    const uint8_t DURATION_OUTLIER_RESET = 3; // consecutive outliers that restart the estimate
+    const float DURATION_CONFIDENCE_SPREAD = 10; // no confidence at a stddev of 10% of the duration
+
+    // fields of GdoStateSnapshot, used as the changed-field mask
+    enum StateField : uint32_t {
+        STATE_DOOR = 1 << 0,
+        STATE_DOOR_POSITION = 1 << 1,
+        STATE_LIGHT = 1 << 2,
+        STATE_LOCK = 1 << 3,
+        STATE_OBSTRUCTION = 1 << 4,
+        STATE_MOTOR = 1 << 5,
+        STATE_BUTTON = 1 << 6,
+        STATE_MOTION = 1 << 7,
+        STATE_LEARN = 1 << 8,
+        STATE_OPENINGS = 1 << 9,
+        STATE_OPENING_DURATION = 1 << 10,
+        STATE_CLOSING_DURATION = 1 << 11,
+        STATE_PAIRED_TOTAL = 1 << 12,
+        STATE_PAIRED_REMOTES = 1 << 13,
+        STATE_PAIRED_KEYPADS = 1 << 14,
+        STATE_PAIRED_WALL_CONTROLS = 1 << 15,
+        STATE_PAIRED_ACCESSORIES = 1 << 16,
+        STATE_SYNC_FAILED = 1 << 17,
+    };
+
+    // Consistent view of the opener state, published once per loop
+    struct GdoStateSnapshot {
+        DoorState door_state { DoorState::UNKNOWN };
+        float door_position { DOOR_POSITION_UNKNOWN };
+        LightState light_state { LightState::UNKNOWN };
+        LockState lock_state { LockState::UNKNOWN };
+        ObstructionState obstruction_state { ObstructionState::UNKNOWN };
+        MotorState motor_state { MotorState::UNKNOWN };
+        ButtonState button_state { ButtonState::UNKNOWN };
+        MotionState motion_state { MotionState::UNKNOWN };
+        LearnState learn_state { LearnState::UNKNOWN };
+        uint16_t openings { 0 };
+        float opening_duration { 0 };
+        float closing_duration { 0 };
+        uint16_t paired_total { PAIRED_DEVICES_UNKNOWN };
+        uint16_t paired_remotes { PAIRED_DEVICES_UNKNOWN };
+        uint16_t paired_keypads { PAIRED_DEVICES_UNKNOWN };
+        uint16_t paired_wall_controls { PAIRED_DEVICES_UNKNOWN };
+        uint16_t paired_accessories { PAIRED_DEVICES_UNKNOWN };
+        bool sync_failed { false };
+    };
+
+    // fields of PersistedState
+    enum PersistField : uint8_t {
+        PERSIST_ROLLING_CODE = 1 << 0,
+        PERSIST_CLIENT_ID = 1 << 1,
+        PERSIST_OPENING_DURATION = 1 << 2,
+        PERSIST_CLOSING_DURATION = 1 << 3,
+        PERSIST_DOOR_POSITION = 1 << 4,
+        PERSIST_DURATION_ESTIMATES = 1 << 5,
+        PERSIST_PROTOCOL = 1 << 6,
+    };
+
+    const uint8_t PERSIST_VERSION = 1;
+    const uint32_t PERSIST_WINDOW = 10000; // ms, changes within the window are committed together
+    const uint32_t FLASH_ENDURANCE = 100000; // erase cycles of a flash sector
+
+    const uint32_t DOOR_RESPONSE_TIMEOUT = 5000; // ms, a door command without a state change by then went unanswered
+    const uint32_t DOOR_STATE_CALLBACK_TIMEOUT = 10000; // ms a continuation waits for the next door state
+
+    const uint32_t PROTOCOL_DETECT_WINDOW = 10000; // ms without valid frames before trying the other protocol
+    // a Sec+1 GDO without a wall panel stays silent until the emulated panel
+    // starts polling it, the window is counted from then
+    const uint8_t PROTOCOL_DETECT_FRAMES = 3; // valid frames that confirm a protocol
+    const uint32_t PROTOCOL_DETECT_SPAN = 3000; // ms the confirming frames have to fall within
+    const uint8_t PROTOCOL_DETECT_ATTEMPTS = 2; // switches without ever seeing a valid frame before giving up
+
+    // Everything a ratgdo keeps across reboots, stored as one preference
+    // record. Fields are only meaningful when their bit is set in valid
+    struct PersistedState {
+        uint8_t version;
+        uint8_t valid;
+        // protocol.h ProtocolType found by auto detection, these two take
+        // what used to be padding so older records still load
+        uint8_t protocol;
+        uint8_t protocol_attempts;
+        uint32_t rolling_code_lease;
+        uint32_t client_id;
+        float opening_duration;
+        float closing_duration;
+        float door_position;
+        // running duration estimates per direction, in 10ms units
+        struct {
+            uint16_t mean;
+            uint16_t stddev;
+            uint16_t samples;
+        } durations[2];
+        uint16_t crc;
+    };
+
+    // flags of a wire capture record, kept in the low bits of its timestamp
+    const uint32_t WIRE_TX = 1 << 0;
+    const uint32_t WIRE_PARITY_ERROR = 1 << 1;
+    const uint32_t WIRE_FLAGS = WIRE_TX | WIRE_PARITY_ERROR;
+    const uint8_t WIRE_DUMP_RECORDS = 16; // records per log line
+
+    using StateObserver = std::function<void(const GdoStateSnapshot&, uint32_t)>;
+
+    // state fields only hold the value and a changed flag,
+    // children observe them through the snapshot
+    template <typename T>
+    using state_field = observable<T, 0>;
+
+    // obstruction sensor: clear is HIGH with a LOW pulse every ~7ms,
+    // obstructed is steady HIGH, asleep is steady LOW
+    const uint8_t OBST_EDGE_RING = 32; // power of two
+    const uint32_t OBST_PERIOD = 7000; // us, nominal pulse period
+    const uint32_t OBST_PERIOD_MIN = 4000; // us
+    const uint32_t OBST_PERIOD_MAX = 12000; // us
+    const uint8_t OBST_PERIOD_WEIGHT = 16; // EWMA weight of period and jitter
+    const uint8_t OBST_PULSES_CLEAR = 2; // regular periods in a row that mean clear
+    const uint8_t OBST_MISSING_PERIODS = 3; // the pulse train stopped after this many periods without a pulse
+    const uint32_t OBST_MISSING_MIN = 50000; // us, a line decaying slowly to LOW still reads HIGH for a while
+    const uint32_t OBST_WAKE_GUARD = 700; // ms the line may stay high without pulses when waking up
+
     struct RATGDOStore {
-        int obstruction_low_count = 0; // count obstruction low pulses
+        ISRInternalGPIOPin obst_pin;
+        // single producer (ISR), single consumer (loop) ring of edge
+        // timestamps in us, the LSB holds the line level after the edge
+        volatile uint32_t obst_edges[OBST_EDGE_RING];
+        volatile uint8_t obst_head { 0 }; // only written by the ISR
+        volatile uint8_t obst_tail { 0 }; // only written by the loop
+        volatile uint32_t obst_overflows { 0 };
 
         static void IRAM_ATTR HOT isr_obstruction(RATGDOStore* arg)
         {
-            arg->obstruction_low_count++;
+            uint32_t now = micros();
+            uint8_t head = arg->obst_head;
+            uint8_t next = (head + 1) & (OBST_EDGE_RING - 1);
+            if (next == arg->obst_tail) {
+                arg->obst_overflows++;
+                return;
+            }
+            arg->obst_edges[head] = (now & ~1u) | (arg->obst_pin.digital_read() ? 1 : 0);
+            arg->obst_head = next;
         }
     };
 
@@ -50,6 +202,7 @@ namespace ratgdo {
 
     class RATGDOComponent : public Component {
     public:
+        ~RATGDOComponent();
         void setup() override;
         void loop() override;
         void dump_config() override;
@@ -57,41 +210,55 @@ namespace ratgdo {
         void init_protocol();
 
         void obstruction_loop();
+        void obstruction_edge(uint32_t time, bool level);
 
-        float start_opening { -1 };
-        observable<float> opening_duration { 0 };
-        float start_closing { -1 };
-        observable<float> closing_duration { 0 };
+        uint32_t start_opening { 0 };
+        state_field<float> opening_duration { 0 };
+        uint32_t start_closing { 0 };
+        state_field<float> closing_duration { 0 };
 
-        observable<uint16_t> openings { 0 }; // number of times the door has been opened
-        observable<uint16_t> paired_total { PAIRED_DEVICES_UNKNOWN };
-        observable<uint16_t> paired_remotes { PAIRED_DEVICES_UNKNOWN };
-        observable<uint16_t> paired_keypads { PAIRED_DEVICES_UNKNOWN };
-        observable<uint16_t> paired_wall_controls { PAIRED_DEVICES_UNKNOWN };
-        observable<uint16_t> paired_accessories { PAIRED_DEVICES_UNKNOWN };
+        state_field<uint16_t> openings { 0 }; // number of times the door has been opened
+        state_field<uint16_t> paired_total { PAIRED_DEVICES_UNKNOWN };
+        state_field<uint16_t> paired_remotes { PAIRED_DEVICES_UNKNOWN };
+        state_field<uint16_t> paired_keypads { PAIRED_DEVICES_UNKNOWN };
+        state_field<uint16_t> paired_wall_controls { PAIRED_DEVICES_UNKNOWN };
+        state_field<uint16_t> paired_accessories { PAIRED_DEVICES_UNKNOWN };
 
-        observable<DoorState> door_state { DoorState::UNKNOWN };
-        observable<float> door_position { DOOR_POSITION_UNKNOWN };
+        state_field<DoorState> door_state { DoorState::UNKNOWN };
+        state_field<float> door_position { DOOR_POSITION_UNKNOWN };
 
-        unsigned long door_start_moving { 0 };
+        uint32_t door_start_moving { 0 }; // ms, millis() when the door started moving
         float door_start_position { DOOR_POSITION_UNKNOWN };
         float door_move_delta { DOOR_DELTA_UNKNOWN };
 
-        observable<LightState> light_state { LightState::UNKNOWN };
-        observable<LockState> lock_state { LockState::UNKNOWN };
-        observable<ObstructionState> obstruction_state { ObstructionState::UNKNOWN };
-        observable<MotorState> motor_state { MotorState::UNKNOWN };
-        observable<ButtonState> button_state { ButtonState::UNKNOWN };
-        observable<MotionState> motion_state { MotionState::UNKNOWN };
-        observable<LearnState> learn_state { LearnState::UNKNOWN };
+        state_field<LightState> light_state { LightState::UNKNOWN };
+        state_field<LockState> lock_state { LockState::UNKNOWN };
+        state_field<ObstructionState> obstruction_state { ObstructionState::UNKNOWN };
+        state_field<MotorState> motor_state { MotorState::UNKNOWN };
+        state_field<ButtonState> button_state { ButtonState::UNKNOWN };
+        state_field<MotionState> motion_state { MotionState::UNKNOWN };
+        state_field<LearnState> learn_state { LearnState::UNKNOWN };
 
-        OnceCallbacks<void(DoorState)> on_door_state_;
+        OnceCallbacks<void(DoorState), 4> on_door_state_;
+        void on_next_door_state(std::function<void(DoorState)>&& f);
 
-        observable<bool> sync_failed { false };
+        state_field<bool> sync_failed { false };
 
         void set_output_gdo_pin(InternalGPIOPin* pin) { this->output_gdo_pin_ = pin; }
         void set_input_gdo_pin(InternalGPIOPin* pin) { this->input_gdo_pin_ = pin; }
         void set_input_obst_pin(InternalGPIOPin* pin) { this->input_obst_pin_ = pin; }
+        void set_preference_key(uint32_t key) { this->preference_key_ = key; }
+        void set_rx_drain_budget(uint32_t budget_us) { this->rx_drain_budget_ = budget_us; }
+        uint32_t get_rx_drain_budget() const { return this->rx_drain_budget_; }
+        void set_secplus1_confidence(uint8_t threshold) { this->secplus1_confidence_ = threshold; }
+        uint8_t get_secplus1_confidence() const { return this->secplus1_confidence_; }
+        // protocol: auto, UNKNOWN until the protocol is confirmed
+        protocol::ProtocolType get_detected_protocol() const
+        {
+            return this->protocol_detect_.pending ? protocol::ProtocolType::UNKNOWN : this->protocol_detect_.type;
+        }
+        void set_door_position_report_delta(float delta) { this->position_report_delta_ = delta; }
+        void set_door_position_report_interval(uint32_t interval) { this->position_report_interval_ = interval; }
 
         // dry contact methods
         void set_dry_contact_open_sensor(esphome::binary_sensor::BinarySensor* dry_contact_open_sensor_);
@@ -127,8 +294,23 @@ namespace ratgdo {
         void set_door_position(float door_position) { this->door_position = door_position; }
         void set_opening_duration(float duration);
         void set_closing_duration(float duration);
-        void schedule_door_position_sync(float update_period = 500);
+        void calibrate_duration(uint8_t direction, uint32_t elapsed);
+        float duration_confidence(uint8_t direction) const;
+        void load_duration_estimates();
+        void save_duration_estimates();
+
+        // persistence
+        PersistedState& persisted_state();
+        void persist(uint8_t fields, bool urgent = false);
+        void commit_persisted_state(bool sync);
+        void set_rolling_code_counter(uint32_t counter);
+        float door_position_at(uint32_t now) const;
+        float get_door_position() const { return this->door_position_at(millis()); }
+        void door_position_loop();
         void door_position_update();
+        void door_target_loop(uint32_t now);
+        void door_target_stopped();
+        void cancel_door_target();
         void cancel_position_sync_callbacks();
 
         // light
@@ -173,11 +355,161 @@ namespace ratgdo {
         void subscribe_motion_state(std::function<void(MotionState)>&& f);
         void subscribe_sync_failed(std::function<void(bool)>&& f);
         void subscribe_learn_state(std::function<void(LearnState)>&& f);
+        void subscribe_state(uint32_t fields, StateObserver&& f);
+        void flush_observers();
+        void count_door_cycle_report();
+        void record_door_response(uint32_t now);
+
+        const GdoStateSnapshot& get_state() const { return this->state_; }
+
+        // called by the protocol with the rolling code it is about to encode
+        void use_rolling_code(uint32_t counter);
+
+        // false while another instance is receiving a frame
+        bool may_transmit();
+
+        // called by the protocol with the number of frames that decoded cleanly
+        void protocol_frame_received(uint8_t frames = 1);
+        // a frame or byte on the wire that doesn't decode
+        void protocol_frame_rejected();
+
+        // raw bytes on the GDO line, only kept when wire_capture_size is set
+        void capture_wire(const uint8_t* data, size_t len, uint32_t flags)
+        {
+#ifdef RATGDO_WIRE_CAPTURE
+            uint32_t now = micros() & ~WIRE_FLAGS;
+            auto& capture = this->wire_capture_;
+            for (size_t i = 0; i < len; i++) {
+                capture.times[capture.head] = now | flags;
+                capture.bytes[capture.head] = data[i];
+                capture.head = capture.head + 1 == RATGDO_WIRE_CAPTURE ? 0 : capture.head + 1;
+                capture.total++;
+            }
+#endif
+        }
+        void capture_wire(uint8_t byte, uint32_t flags) { this->capture_wire(&byte, 1, flags); }
+        void dump_wire_capture();
 
     protected:
+        // every instance that has been set up, may_transmit() checks the others
+        static RATGDOComponent* instances_;
+        RATGDOComponent* next_instance_ { nullptr };
+        uint32_t tx_window_waits_ { 0 };
+
+        struct {
+            uint32_t count { 0 };
+            uint64_t total { 0 }; // us
+            uint32_t max { 0 }; // us
+        } loop_stats_;
+
+        // protocol: auto, the backend of the last boot is confirmed by
+        // valid frames or the other one is tried after a reboot
+        struct {
+            protocol::ProtocolType type { protocol::ProtocolType::UNKNOWN };
+            bool pending { false }; // still waiting for valid frames
+            bool switching { false }; // switch protocols when the window expires
+            uint8_t frames { 0 }; // valid frames in a row
+            uint32_t first_frame { 0 }; // ms, of the ones counted
+            uint32_t rejected { 0 }; // frames and bytes that didn't decode
+            uint32_t started { 0 }; // ms
+            uint32_t window { PROTOCOL_DETECT_WINDOW }; // ms
+            uint32_t elapsed { 0 }; // ms until the protocol was confirmed
+        } protocol_detect_;
+
+        // millis() wraps after 49.7 days, uptime counts the wraps
+        uint32_t uptime_last_ { 0 };
+        uint32_t uptime_wraps_ { 0 };
+        float uptime_days();
+        void protocol_detect_loop(uint32_t now);
+
+#ifdef RATGDO_WIRE_CAPTURE
+        struct {
+            uint32_t times[RATGDO_WIRE_CAPTURE]; // us, the low bits hold WIRE_* flags
+            uint8_t bytes[RATGDO_WIRE_CAPTURE];
+            uint16_t head { 0 };
+            uint32_t total { 0 }; // records ever captured
+        } wire_capture_;
+#endif
+
+        GdoStateSnapshot state_;
+        struct {
+            uint32_t fields;
+            StateObserver f;
+        } state_observers_[RATGDO_MAX_STATE_OBSERVERS];
+        uint8_t state_observer_count_ { 0 };
+
         RATGDOStore isr_store_ {};
+        struct {
+            uint32_t last_fall { 0 }; // us
+            uint32_t last_edge { 0 }; // us
+            float period { OBST_PERIOD }; // us
+            float jitter { 0 }; // us, mean deviation from the period
+            uint8_t pulses { 0 }; // regular periods in a row
+            bool pulsing { false }; // pulse train seen since the sensor last slept
+            uint32_t last_asleep { 0 }; // ms
+        } obst_;
         protocol::Protocol* protocol_;
+        // the protocol's counter, null for protocols without rolling codes
+        observable<uint32_t>* rolling_code_counter_ { nullptr };
+        uint32_t rolling_code_lease_end_ { 0 };
+        void restore_rolling_code_counter();
+        void lease_rolling_codes(uint32_t counter);
         bool obstruction_sensor_detected_ { false };
+        uint32_t rx_drain_budget_ { 5000 }; // us spent decoding buffered frames per loop
+        uint8_t secplus1_confidence_ { 60 }; // score a Sec+1 status reading needs to be accepted
+
+        // while the door moves its position is computed on read, it is
+        // reported when it changed by at least the delta, at most once per interval
+        float position_report_delta_ { 0.01 };
+        uint32_t position_report_interval_ { 500 };
+        uint32_t position_last_report_ { 0 };
+        uint16_t door_cycle_reports_ { 0 }; // door state/position publishes in the current cycle
+        uint16_t door_cycle_reports_last_ { 0 };
+        uint16_t door_cycle_reports_max_ { 0 };
+
+        // how fast the GDO answers: sync until the door state is known,
+        // door commands until the door state changes
+        struct {
+            bool syncing { false };
+            uint32_t sync_start { 0 }; // ms
+            uint32_t sync_time { 0 }; // ms
+            bool command_pending { false };
+            uint32_t command_sent { 0 }; // ms
+            uint32_t count { 0 };
+            uint32_t total { 0 }; // ms
+            uint32_t max { 0 }; // ms
+            uint32_t unanswered { 0 };
+        } door_response_;
+
+        // learned per direction from moves to position, the time the door
+        // keeps moving after STOP is sent, STOP is sent that much earlier
+        struct MotionProfile {
+            float stop_latency { 0 };
+            uint16_t samples { 0 };
+        } motion_profile_[2];
+        float door_target_position_ { DOOR_POSITION_UNKNOWN };
+        float door_stop_target_ { DOOR_POSITION_UNKNOWN };
+        uint32_t door_stop_sent_ { 0 };
+        uint8_t door_stop_direction_ { MOTION_OPENING };
+        // running estimates of the full travel durations, per direction
+        struct DurationEstimate {
+            float mean { 0 }; // s
+            float variance { 0 }; // s^2
+            uint16_t samples { 0 };
+            uint8_t rejected { 0 }; // consecutive outliers
+        } duration_estimate_[2];
+
+        PersistedState persisted_ {};
+        ESPPreferenceObject persisted_pref_;
+        bool persisted_loaded_ { false };
+        bool persist_scheduled_ { false };
+        uint8_t persist_dirty_ { 0 };
+        uint32_t persist_commits_ { 0 };
+        uint32_t preference_key_ { 0 };
+
+        float position_error_avg_ { 0 };
+        float position_error_max_ { 0 };
+        uint16_t position_error_count_ { 0 };
 
         InternalGPIOPin* output_gdo_pin_;
         InternalGPIOPin* input_gdo_pin_;
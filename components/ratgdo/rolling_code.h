@@ -0,0 +1,19 @@
+#pragma once
+#include <cstdint>
+
+namespace esphome {
+namespace ratgdo {
+
+    const uint32_t ROLLING_CODE_MASK = 0xfffffff; // the counter is 28 bits and wraps
+    const uint32_t ROLLING_CODE_LEASE = 64; // codes reserved by each persisted lease, a lease costs one flash write
+
+    // True when the counter has reached the end of its lease. Shifting the
+    // 28 bit difference into the sign bit compares modulo 2^28, so the
+    // counter wrapping to 0 still counts as past a lease ending near the top
+    inline bool rolling_code_reached(uint32_t counter, uint32_t lease_end)
+    {
+        return int32_t((counter - lease_end) << 4) >= 0;
+    }
+
+} // namespace ratgdo
+} // namespace esphome
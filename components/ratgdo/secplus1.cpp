@@ -1,11 +1,15 @@
 
 #include "secplus1.h"
+#include "profile.h"
 #include "ratgdo.h"
 
 #include "esphome/core/gpio.h"
+#include "esphome/core/hal.h"
 #include "esphome/core/log.h"
 #include "esphome/core/scheduler.h"
 
+#include <algorithm>
+
 namespace esphome {
 namespace ratgdo {
     namespace secplus1 {
@@ -20,20 +24,43 @@ namespace ratgdo {
             this->rx_pin_ = rx_pin;
 
             this->sw_serial_.begin(1200, SWSERIAL_8E1, rx_pin->get_pin(), tx_pin->get_pin(), true);
+            this->bus_stats_start_ = millis();
 
             this->traits_.set_features(HAS_DOOR_STATUS | HAS_LIGHT_TOGGLE | HAS_LOCK_TOGGLE);
         }
 
         void Secplus1::loop()
         {
+            if (this->wall_panel_next_ != 0 && int32_t(millis() - this->wall_panel_next_) >= 0) {
+                this->wall_panel_emulation(millis());
+            }
+            if (this->on_door_state_.size() > 0) {
+                auto dropped = this->on_door_state_.expire(millis());
+                if (dropped > 0) {
+                    ESP_LOGW(TAG, "Door state did not change, dropping %zu toggle sequences", dropped);
+                }
+            }
+
+            const uint32_t read_start = micros();
             auto rx_cmd = this->read_command();
             if (rx_cmd) {
+                if (rx_cmd->clean && rx_cmd->req != CommandType::UNKNOWN) {
+                    this->ratgdo_->protocol_frame_received();
+                } else {
+                    this->ratgdo_->protocol_frame_rejected();
+                }
                 this->handle_command(rx_cmd.value());
             }
+            this->rx_.max_time = std::max(this->rx_.max_time, micros() - read_start);
+            // nothing to do until the next command is due
+            auto now = millis();
+            if (this->pending_tx_.time_until_next(now) > 0) {
+                return;
+            }
             auto tx_cmd = this->pending_tx();
             if (
-                (millis() - this->last_tx_) > 200 && // don't send twice in a period
-                (millis() - this->last_rx_) > 50 && // time to send it
+                (now - this->last_tx_) > TX_MIN_INTERVAL && // don't send twice in a period
+                (now - this->last_rx_) > TX_RX_GAP && // time to send it
                 tx_cmd && // have pending command
                 !(this->is_0x37_panel_ && tx_cmd.value() == CommandType::TOGGLE_LOCK_PRESS) && this->wall_panel_emulation_state_ != WallPanelEmulationState::RUNNING) {
                 this->do_transmit_if_pending();
@@ -43,6 +70,14 @@ namespace ratgdo {
         void Secplus1::dump_config()
         {
             ESP_LOGCONFIG(TAG, "  Protocol: SEC+ v1");
+            auto elapsed = millis() - this->bus_stats_start_;
+            ESP_LOGCONFIG(TAG, "  Bus utilization: %.1f%% (%" PRIu32 " bytes)",
+                elapsed > 0 ? 100.0f * this->bus_bytes_ * BYTE_TIME / (elapsed * 1000.0f) : 0, this->bus_bytes_);
+            ESP_LOGCONFIG(TAG, "  Status readings: confidence threshold %d, %" PRIu32 " accepted, %" PRIu32 " rejected, %" PRIu32 " flipped back",
+                this->ratgdo_->get_secplus1_confidence(), this->readings_accepted_, this->readings_rejected_, this->readings_flipped_);
+            ESP_LOGCONFIG(TAG, "  RX worst case: %" PRIu32 "us per read, %" PRIu32 " incomplete packets discarded", this->rx_.max_time, this->rx_.discarded);
+            ESP_LOGCONFIG(TAG, "  Door status refresh: avg %" PRIu32 "ms, max %" PRIu32 "ms",
+                this->status_refresh_.count > 0 ? this->status_refresh_.total / this->status_refresh_.count : 0, this->status_refresh_.max);
         }
 
         void Secplus1::sync()
@@ -51,10 +86,9 @@ namespace ratgdo {
             this->wall_panel_emulation_start_ = millis();
             this->door_state = DoorState::UNKNOWN;
             this->light_state = LightState::UNKNOWN;
-            this->scheduler_->cancel_timeout(this->ratgdo_, "wall_panel_emulation");
-            this->wall_panel_emulation();
+            this->wall_panel_emulation(millis());
 
-            this->scheduler_->set_timeout(this->ratgdo_, "", 45000, [=] {
+            this->scheduler_->set_timeout(this->ratgdo_, "sync", SYNC_TIMEOUT, [=] {
                 if (this->door_state == DoorState::UNKNOWN) {
                     ESP_LOGW(TAG, "Triggering sync failed actions.");
                     this->ratgdo_->sync_failed = true;
@@ -62,8 +96,12 @@ namespace ratgdo {
             });
         }
 
-        void Secplus1::wall_panel_emulation(size_t index)
+        // Runs from loop() when due, without a panel the GDO has to be polled
+        // for its state: fast while the door moves or a command is pending,
+        // slow when idle
+        void Secplus1::wall_panel_emulation(uint32_t now)
         {
+            this->wall_panel_next_ = 0;
             if (this->wall_panel_starting_) {
                 this->wall_panel_emulation_state_ = WallPanelEmulationState::WAITING;
             } else if (this->wall_panel_emulation_state_ == WallPanelEmulationState::WAITING) {
@@ -73,38 +111,36 @@ namespace ratgdo {
                     ESP_LOG1(TAG, "Wall panel detected");
                     return;
                 }
-                if (millis() - this->wall_panel_emulation_start_ > 35000 && !this->wall_panel_starting_) {
+                if (now - this->wall_panel_emulation_start_ > WALL_PANEL_TIMEOUT && !this->wall_panel_starting_) {
                     ESP_LOGD(TAG, "No wall panel detected. Switching to emulation mode.");
                     this->wall_panel_emulation_state_ = WallPanelEmulationState::RUNNING;
+                    this->wall_panel_index_ = 0;
                 }
-                this->scheduler_->set_timeout(this->ratgdo_, "wall_panel_emulation", 2000, [=] {
-                    this->wall_panel_emulation();
-                });
-                return;
+                this->schedule_wall_panel_emulation(now + WALL_PANEL_DETECT_PERIOD);
             } else if (this->wall_panel_emulation_state_ == WallPanelEmulationState::RUNNING) {
-                // ESP_LOG2(TAG, "[Wall panel emulation] Sending byte: [%02X]", secplus1_states[index]);
-
+                auto& index = this->wall_panel_index_;
+                bool deferred = false;
                 if (index < 15 || !this->do_transmit_if_pending()) {
-                    this->transmit_byte(secplus1_states[index]);
-                    // gdo response simulation for testing
-                    // auto resp = secplus1_states[index] == 0x39 ? 0x00 :
-                    //             secplus1_states[index] == 0x3A ? 0x5C :
-                    //             secplus1_states[index] == 0x38 ? 0x52 : 0xFF;
-                    // if (resp != 0xFF) {
-                    //     this->transmit_byte(resp, true);
-                    // }
-
-                    index += 1;
-                    if (index == 18) {
-                        index = 15;
+                    // the same step is sent again on the next pass while the window is busy
+                    if (this->transmit_byte(secplus1_states[index])) {
+                        index += 1;
+                        if (index == 18) {
+                            index = 15;
+                        }
+                    } else {
+                        deferred = true;
                     }
                 }
-                this->scheduler_->set_timeout(this->ratgdo_, "wall_panel_emulation", 250, [=] {
-                    this->wall_panel_emulation(index);
-                });
+                bool busy = deferred || index < 15 || this->door_moving_ || !this->pending_tx_.empty();
+                this->schedule_wall_panel_emulation(now + (busy ? WALL_PANEL_FAST_POLL : WALL_PANEL_SLOW_POLL));
             }
         }
 
+        void Secplus1::schedule_wall_panel_emulation(uint32_t at)
+        {
+            this->wall_panel_next_ = at != 0 ? at : 1; // 0 means not scheduled
+        }
+
         void Secplus1::light_action(LightAction action)
         {
             ESP_LOG1(TAG, "Light action: %s", LightAction_to_string(action));
@@ -144,11 +180,11 @@ namespace ratgdo {
                     this->toggle_door();
                 } else if (this->door_state == DoorState::STOPPED) {
                     this->toggle_door(); // this starts closing door
-                    this->on_door_state_([=](DoorState s) {
+                    this->on_next_door_state([=](DoorState s) {
                         if (s == DoorState::CLOSING) {
                             // this changes direction of the door on some openers, on others it stops it
                             this->toggle_door();
-                            this->on_door_state_([=](DoorState s) {
+                            this->on_next_door_state([=](DoorState s) {
                                 if (s == DoorState::STOPPED) {
                                     this->toggle_door();
                                 }
@@ -162,7 +198,7 @@ namespace ratgdo {
                 } else if (this->door_state == DoorState::OPENING) {
                     this->toggle_door(); // this switches to stopped
                     // another toggle needed to close
-                    this->on_door_state_([=](DoorState s) {
+                    this->on_next_door_state([=](DoorState s) {
                         if (s == DoorState::STOPPED) {
                             this->toggle_door();
                         }
@@ -177,7 +213,7 @@ namespace ratgdo {
                     this->toggle_door(); // this switches to opening
 
                     // another toggle needed to stop
-                    this->on_door_state_([=](DoorState s) {
+                    this->on_next_door_state([=](DoorState s) {
                         if (s == DoorState::OPENING) {
                             this->toggle_door();
                         }
@@ -186,6 +222,15 @@ namespace ratgdo {
             }
         }
 
+        // toggle sequences wait for the door state, a step the GDO doesn't
+        // answer by its deadline is dropped instead of resuming on a later change
+        void Secplus1::on_next_door_state(std::function<void(DoorState)>&& f)
+        {
+            if (!this->on_door_state_(std::move(f), millis() + DOOR_STATE_CALLBACK_TIMEOUT)) {
+                ESP_LOGW(TAG, "Too many toggle sequences waiting for the door state, dropping one");
+            }
+        }
+
         void Secplus1::toggle_light()
         {
             this->enqueue_transmit(CommandType::TOGGLE_LIGHT_PRESS);
@@ -212,21 +257,28 @@ namespace ratgdo {
 
         optional<RxCommand> Secplus1::read_command()
         {
-            static bool reading_msg = false;
-            static uint32_t msg_start = 0;
-            static uint16_t byte_count = 0;
-            static RxPacket rx_packet;
+            RATGDO_PROFILE_SCOPE("secplus1.read_command");
+            // parser state is per instance, several openers may be connected
+            auto& reading_msg = this->rx_.reading_msg;
+            auto& byte_count = this->rx_.byte_count;
+            auto& rx_packet = this->rx_.packet;
 
             if (!reading_msg) {
                 while (this->sw_serial_.available()) {
                     uint8_t ser_byte = this->sw_serial_.read();
+                    bool parity_ok = this->sw_serial_.readParity() == SoftwareSerial::parityEven(ser_byte);
+                    this->ratgdo_->capture_wire(ser_byte, parity_ok ? 0 : WIRE_PARITY_ERROR);
                     this->last_rx_ = millis();
+                    this->bus_bytes_++;
 
                     if (ser_byte < 0x30 || ser_byte > 0x3A) {
                         ESP_LOG2(TAG, "[%d] Ignoring byte [%02X], baud: %d", millis(), ser_byte, this->sw_serial_.baudRate());
+                        this->ratgdo_->protocol_frame_rejected();
                         byte_count = 0;
                         continue;
                     }
+                    this->rx_.clean = parity_ok;
+                    byte_count = 0;
                     rx_packet[byte_count++] = ser_byte;
                     ESP_LOG2(TAG, "[%d] Received byte: [%02X]", millis(), ser_byte);
                     reading_msg = true;
@@ -236,7 +288,7 @@ namespace ratgdo {
                         reading_msg = false;
                         byte_count = 0;
                         ESP_LOG2(TAG, "[%d] Received command: [%02X]", millis(), rx_packet[0]);
-                        return this->decode_packet(rx_packet);
+                        return this->decode_packet(rx_packet, this->rx_.clean);
                     }
 
                     break;
@@ -245,7 +297,11 @@ namespace ratgdo {
             if (reading_msg) {
                 while (this->sw_serial_.available()) {
                     uint8_t ser_byte = this->sw_serial_.read();
+                    bool parity_ok = this->sw_serial_.readParity() == SoftwareSerial::parityEven(ser_byte);
+                    this->ratgdo_->capture_wire(ser_byte, parity_ok ? 0 : WIRE_PARITY_ERROR);
                     this->last_rx_ = millis();
+                    this->bus_bytes_++;
+                    this->rx_.clean &= parity_ok;
                     rx_packet[byte_count++] = ser_byte;
                     ESP_LOG2(TAG, "[%d] Received byte: [%02X]", millis(), ser_byte);
 
@@ -253,17 +309,18 @@ namespace ratgdo {
                         reading_msg = false;
                         byte_count = 0;
                         this->print_rx_packet(rx_packet);
-                        return this->decode_packet(rx_packet);
+                        return this->decode_packet(rx_packet, this->rx_.clean);
                     }
                 }
 
-                if (millis() - this->last_rx_ > 100) {
+                if (millis() - this->last_rx_ > RX_PACKET_TIMEOUT) {
                     // if we have a partial packet and it's been over 100ms since last byte was read,
                     // the rest is not coming (a full packet should be received in ~20ms),
                     // discard it so we can read the following packet correctly
                     ESP_LOGW(TAG, "[%d] Discard incomplete packet: [%02X ...]", millis(), rx_packet[0]);
                     reading_msg = false;
                     byte_count = 0;
+                    this->rx_.discarded++;
                 }
             }
 
@@ -280,10 +337,50 @@ namespace ratgdo {
             ESP_LOG2(TAG, "[%d] Sending packet: [%02X %02X]", millis(), packet[0], packet[1]);
         }
 
-        optional<RxCommand> Secplus1::decode_packet(const RxPacket& packet) const
+        optional<RxCommand> Secplus1::decode_packet(const RxPacket& packet, bool clean) const
         {
             CommandType cmd_type = to_CommandType(packet[0], CommandType::UNKNOWN);
-            return RxCommand { cmd_type, packet[1] };
+            RxCommand cmd { cmd_type, packet[1] };
+            cmd.clean = clean;
+            return cmd;
+        }
+
+        // Scores a status reading, with the default threshold a reading without
+        // parity errors that answers our own query is accepted at once, others
+        // need confirmation by the next identical reading. Confirmation alone
+        // passes any threshold, at 100 every reading waits for it
+        uint8_t Secplus1::score_reading(const RxCommand& cmd) const
+        {
+            if (this->is_0x37_panel_) {
+                return CONFIDENCE_MAX;
+            }
+            bool echo = static_cast<uint8_t>(cmd.req) == this->last_query_ && millis() - this->last_tx_ < RESPONSE_WINDOW;
+            return reading_score(cmd.clean, echo);
+        }
+
+        template <typename T>
+        bool Secplus1::filter_reading(StateFilter<T>& filter, T value, uint8_t score)
+        {
+            bool confirmed = value == filter.candidate;
+            filter.candidate = value;
+            if (!reading_accepted(score, confirmed, this->ratgdo_->get_secplus1_confidence())) {
+                if (value != filter.accepted) {
+                    this->readings_rejected_++;
+                }
+                return false;
+            }
+            if (value != filter.accepted) {
+                auto now = millis();
+                if (value == filter.previous && now - filter.accepted_at < FLIP_WINDOW) {
+                    // the last accepted change was noise after all
+                    this->readings_flipped_++;
+                }
+                filter.previous = filter.accepted;
+                filter.accepted = value;
+                filter.accepted_at = now;
+                this->readings_accepted_++;
+            }
+            return true;
         }
 
         // unknown meaning of observed command-responses:
@@ -295,6 +392,7 @@ namespace ratgdo {
 
         void Secplus1::handle_command(const RxCommand& cmd)
         {
+            RATGDO_PROFILE_SCOPE("secplus1.handle_command");
             if (cmd.req == CommandType::TOGGLE_DOOR_RELEASE || cmd.resp == 0x31) {
                 ESP_LOGD(TAG, "wall panel is starting");
                 this->wall_panel_starting_ = true;
@@ -323,17 +421,28 @@ namespace ratgdo {
                     door_state = DoorState::UNKNOWN;
                 }
 
-                if (this->maybe_door_state != door_state) {
+                auto now = millis();
+                if (this->last_status_ != 0) {
+                    auto interval = now - this->last_status_;
+                    this->status_refresh_.count++;
+                    this->status_refresh_.total += interval;
+                    this->status_refresh_.max = std::max(this->status_refresh_.max, interval);
+                }
+                this->last_status_ = now;
+
+                if (this->door_filter_.candidate != door_state && this->on_door_state_.size() > 0) {
                     this->on_door_state_.trigger(door_state);
                 }
 
-                if (!this->is_0x37_panel_ && door_state != this->maybe_door_state) {
-                    this->maybe_door_state = door_state;
+                if (!this->filter_reading(this->door_filter_, door_state, this->score_reading(cmd))) {
                     ESP_LOG1(TAG, "Door maybe %s, waiting for 2nd status message to confirm", DoorState_to_string(door_state));
                 } else {
-                    this->maybe_door_state = door_state;
                     this->door_state = door_state;
-                    if (this->door_state == DoorState::STOPPED || this->door_state == DoorState::OPEN || this->door_state == DoorState::CLOSED) {
+                    // also a door moved from the wall panel or a remote, so
+                    // a 0x37 panel's queries follow it as closely
+                    if (this->door_state == DoorState::OPENING || this->door_state == DoorState::CLOSING) {
+                        this->door_moving_ = true;
+                    } else if (this->door_state == DoorState::STOPPED || this->door_state == DoorState::OPEN || this->door_state == DoorState::CLOSED) {
                         this->door_moving_ = false;
                     }
                     this->ratgdo_->received(door_state);
@@ -345,25 +454,21 @@ namespace ratgdo {
                     this->do_transmit_if_pending();
                 } else {
                     // inject door status request
-                    if (door_moving_ || (millis() - this->last_status_query_ > 10000)) {
-                        this->transmit_byte(static_cast<uint8_t>(CommandType::QUERY_DOOR_STATUS));
+                    if ((door_moving_ || (millis() - this->last_status_query_ > STATUS_QUERY_INTERVAL))
+                        && this->transmit_byte(static_cast<uint8_t>(CommandType::QUERY_DOOR_STATUS))) {
                         this->last_status_query_ = millis();
                     }
                 }
             } else if (cmd.req == CommandType::QUERY_OTHER_STATUS) {
+                auto score = this->score_reading(cmd);
                 LightState light_state = to_LightState((cmd.resp >> 2) & 1, LightState::UNKNOWN);
-
-                if (!this->is_0x37_panel_ && light_state != this->maybe_light_state) {
-                    this->maybe_light_state = light_state;
-                } else {
+                if (this->filter_reading(this->light_filter_, light_state, score)) {
                     this->light_state = light_state;
                     this->ratgdo_->received(light_state);
                 }
 
                 LockState lock_state = to_LockState((~cmd.resp >> 3) & 1, LockState::UNKNOWN);
-                if (!this->is_0x37_panel_ && lock_state != this->maybe_lock_state) {
-                    this->maybe_lock_state = lock_state;
-                } else {
+                if (this->filter_reading(this->lock_filter_, lock_state, score)) {
                     this->lock_state = lock_state;
                     this->ratgdo_->received(lock_state);
                 }
@@ -383,26 +488,18 @@ namespace ratgdo {
             }
         }
 
+        // True when a command was due, it is only taken off the queue once
+        // sent and stays queued while another instance transmits
         bool Secplus1::do_transmit_if_pending()
         {
-            auto cmd = this->pop_pending_tx();
-            if (cmd) {
-                this->enqueue_command_pair(cmd.value());
-                this->transmit_byte(static_cast<uint32_t>(cmd.value()));
+            auto cmd = this->pending_tx();
+            if (!cmd) {
+                return false;
             }
-            return cmd;
-        }
-
-        void Secplus1::enqueue_command_pair(CommandType cmd)
-        {
-            auto now = millis();
-            if (cmd == CommandType::TOGGLE_DOOR_PRESS) {
-                this->enqueue_transmit(CommandType::TOGGLE_DOOR_RELEASE, now + 500);
-            } else if (cmd == CommandType::TOGGLE_LIGHT_PRESS) {
-                this->enqueue_transmit(CommandType::TOGGLE_LIGHT_RELEASE, now + 500);
-            } else if (cmd == CommandType::TOGGLE_LOCK_PRESS) {
-                this->enqueue_transmit(CommandType::TOGGLE_LOCK_RELEASE, now + 3500);
-            };
+            if (this->transmit_byte(static_cast<uint32_t>(cmd.value()))) {
+                this->pop_pending_tx();
+            }
+            return true;
         }
 
         void Secplus1::enqueue_transmit(CommandType cmd, uint32_t time)
@@ -410,42 +507,67 @@ namespace ratgdo {
             if (time == 0) {
                 time = millis();
             }
-            this->pending_tx_.push(TxCommand { cmd, time });
+            if (!this->pending_tx_.insert(cmd, time)) {
+                ESP_LOGW(TAG, "Transmit queue full, dropping %s", CommandType_to_string(cmd));
+                return;
+            }
+            // don't let a slow emulation poll delay the command
+            if (this->wall_panel_emulation_state_ == WallPanelEmulationState::RUNNING && this->wall_panel_next_ != 0 && int32_t(this->wall_panel_next_ - time) > 0) {
+                this->schedule_wall_panel_emulation(time);
+            }
         }
 
         optional<CommandType> Secplus1::pending_tx()
         {
-            if (this->pending_tx_.empty()) {
-                return {};
-            }
-            auto cmd = this->pending_tx_.top();
-            if (cmd.time > millis()) {
+            auto index = this->pending_tx_.due(millis());
+            if (index < 0) {
                 return {};
             }
-            return cmd.request;
+            return this->pending_tx_.get(index).request;
         }
 
+        // A press is re-armed as its release in the same entry,
+        // so the release can never be lost
         optional<CommandType> Secplus1::pop_pending_tx()
         {
-            auto cmd = this->pending_tx();
-            if (cmd) {
-                this->pending_tx_.pop();
+            auto now = millis();
+            auto index = this->pending_tx_.due(now);
+            if (index < 0) {
+                return {};
+            }
+            auto cmd = this->pending_tx_.get(index).request;
+            if (cmd == CommandType::TOGGLE_DOOR_PRESS) {
+                this->pending_tx_.rearm(index, CommandType::TOGGLE_DOOR_RELEASE, now + RELEASE_DELAY);
+            } else if (cmd == CommandType::TOGGLE_LIGHT_PRESS) {
+                this->pending_tx_.rearm(index, CommandType::TOGGLE_LIGHT_RELEASE, now + RELEASE_DELAY);
+            } else if (cmd == CommandType::TOGGLE_LOCK_PRESS) {
+                this->pending_tx_.rearm(index, CommandType::TOGGLE_LOCK_RELEASE, now + LOCK_RELEASE_DELAY);
+            } else {
+                this->pending_tx_.remove(index);
             }
             return cmd;
         }
 
-        void Secplus1::transmit_byte(uint32_t value)
+        bool Secplus1::transmit_byte(uint32_t value)
         {
+            if (!this->ratgdo_->may_transmit()) {
+                ESP_LOG1(TAG, "[%d] Another door is receiving, deferring byte: [%02X]", millis(), value);
+                return false;
+            }
             bool enable_rx = (value == 0x38) || (value == 0x39) || (value == 0x3A);
             if (!enable_rx) {
                 this->sw_serial_.enableIntTx(false);
             }
             this->sw_serial_.write(value);
+            this->ratgdo_->capture_wire(value, WIRE_TX);
             this->last_tx_ = millis();
+            this->last_query_ = value;
+            this->bus_bytes_++;
             if (!enable_rx) {
                 this->sw_serial_.enableIntTx(true);
             }
             ESP_LOG2(TAG, "[%d] Sent byte: [%02X]", millis(), value);
+            return true;
         }
 
     } // namespace secplus1
@@ -1,7 +1,5 @@
 #pragma once
 
-#include <queue>
-
 #include "SoftwareSerial.h" // Using espsoftwareserial https://github.com/plerup/espsoftwareserial
 #include "esphome/core/optional.h"
 
@@ -9,6 +7,8 @@
 #include "observable.h"
 #include "protocol.h"
 #include "ratgdo_state.h"
+#include "secplus1_score.h"
+#include "tx_wheel.h"
 
 namespace esphome {
 
@@ -48,6 +48,7 @@ namespace ratgdo {
         struct RxCommand {
             CommandType req;
             uint8_t resp;
+            bool clean { true };
 
             RxCommand()
                 : req(CommandType::UNKNOWN)
@@ -66,13 +67,28 @@ namespace ratgdo {
             }
         };
 
-        struct TxCommand {
-            CommandType request;
-            uint32_t time;
-        };
-
-        struct FirstToSend {
-            bool operator()(const TxCommand l, const TxCommand r) const { return l.time > r.time; }
+        static const uint32_t WALL_PANEL_DETECT_PERIOD = 2000; // ms
+        static const uint32_t WALL_PANEL_FAST_POLL = 250; // ms, door moving or command pending
+        static const uint32_t WALL_PANEL_SLOW_POLL = 1000; // ms, idle
+        static const uint32_t BYTE_TIME = 9167; // us on the wire, 11 bits at 1200 baud
+        static const uint32_t WALL_PANEL_TIMEOUT = 35000; // ms without a panel before emulating one
+        static const uint32_t SYNC_TIMEOUT = 45000; // ms, sync failed when the door state is still unknown
+        static const uint32_t TX_MIN_INTERVAL = 200; // ms between our transmissions
+        static const uint32_t TX_RX_GAP = 50; // ms after the last received byte before sending
+        static const uint32_t RX_PACKET_TIMEOUT = 100; // ms a partial packet is kept
+        static const uint32_t STATUS_QUERY_INTERVAL = 10000; // ms between door status queries injected for 0x37 panels
+        static const uint32_t RELEASE_DELAY = 500; // ms a button is held
+        static const uint32_t LOCK_RELEASE_DELAY = 3500; // ms the lock button is held
+
+        static const uint32_t RESPONSE_WINDOW = 100; // ms after our query
+        static const uint32_t FLIP_WINDOW = 2000; // ms, an accepted change reverted within it was noise
+
+        template <typename T>
+        struct StateFilter {
+            T candidate { T::UNKNOWN };
+            T accepted { T::UNKNOWN };
+            T previous { T::UNKNOWN };
+            uint32_t accepted_at { 0 };
         };
 
         enum class WallPanelEmulationState {
@@ -95,6 +111,7 @@ namespace ratgdo {
             Result call(Args args);
 
             const Traits& traits() const { return this->traits_; }
+            bool rx_in_progress() { return this->rx_.reading_msg || this->sw_serial_.available() > 0; }
 
             // methods not used by secplus1
             void set_open_limit(bool state) { }
@@ -103,21 +120,24 @@ namespace ratgdo {
             void set_discrete_close_pin(InternalGPIOPin* pin) { }
 
         protected:
-            void wall_panel_emulation(size_t index = 0);
+            void wall_panel_emulation(uint32_t now);
+            void schedule_wall_panel_emulation(uint32_t at);
 
             optional<RxCommand> read_command();
             void handle_command(const RxCommand& cmd);
 
             void print_rx_packet(const RxPacket& packet) const;
             void print_tx_packet(const TxPacket& packet) const;
-            optional<RxCommand> decode_packet(const RxPacket& packet) const;
+            optional<RxCommand> decode_packet(const RxPacket& packet, bool clean) const;
+            uint8_t score_reading(const RxCommand& cmd) const;
+            template <typename T>
+            bool filter_reading(StateFilter<T>& filter, T value, uint8_t score);
 
             void enqueue_transmit(CommandType cmd, uint32_t time = 0);
             optional<CommandType> pending_tx();
             optional<CommandType> pop_pending_tx();
             bool do_transmit_if_pending();
-            void enqueue_command_pair(CommandType cmd);
-            void transmit_byte(uint32_t value);
+            bool transmit_byte(uint32_t value);
 
             void toggle_light();
             void toggle_lock();
@@ -128,24 +148,48 @@ namespace ratgdo {
             LockState lock_state { LockState::UNKNOWN };
             DoorState door_state { DoorState::UNKNOWN };
 
-            LightState maybe_light_state { LightState::UNKNOWN };
-            LockState maybe_lock_state { LockState::UNKNOWN };
-            DoorState maybe_door_state { DoorState::UNKNOWN };
+            StateFilter<LightState> light_filter_;
+            StateFilter<LockState> lock_filter_;
+            StateFilter<DoorState> door_filter_;
+            uint8_t last_query_ { 0 }; // last byte sent
+            uint32_t readings_accepted_ { 0 };
+            uint32_t readings_rejected_ { 0 };
+            uint32_t readings_flipped_ { 0 };
 
-            OnceCallbacks<void(DoorState)> on_door_state_;
+            OnceCallbacks<void(DoorState), 4> on_door_state_;
+            void on_next_door_state(std::function<void(DoorState)>&& f);
 
             bool door_moving_ { false };
 
             bool wall_panel_starting_ { false };
             uint32_t wall_panel_emulation_start_ { 0 };
+            uint32_t wall_panel_next_ { 0 }; // when the next emulation step is due, 0 when none is
+            uint8_t wall_panel_index_ { 0 };
             WallPanelEmulationState wall_panel_emulation_state_ { WallPanelEmulationState::WAITING };
 
             bool is_0x37_panel_ { false };
-            std::priority_queue<TxCommand, std::vector<TxCommand>, FirstToSend> pending_tx_;
+            TxWheel<CommandType> pending_tx_;
+            struct {
+                bool reading_msg { false };
+                uint16_t byte_count { 0 };
+                RxPacket packet;
+                bool clean { true }; // no parity errors in the packet
+                uint32_t discarded { 0 }; // incomplete packets
+                uint32_t max_time { 0 }; // us, slowest read_command with its handle_command
+            } rx_;
             uint32_t last_rx_ { 0 };
             uint32_t last_tx_ { 0 };
             uint32_t last_status_query_ { 0 };
 
+            uint32_t bus_bytes_ { 0 }; // sent and received
+            uint32_t bus_stats_start_ { 0 };
+            uint32_t last_status_ { 0 };
+            struct {
+                uint32_t count { 0 };
+                uint32_t total { 0 };
+                uint32_t max { 0 };
+            } status_refresh_; // ms between door status messages
+
             Traits traits_;
 
             SoftwareSerial sw_serial_;
@@ -0,0 +1,26 @@
+#pragma once
+#include <cstdint>
+
+namespace esphome {
+namespace ratgdo {
+    namespace secplus1 {
+
+        // confidence scores of a status reading, compared with the configured threshold
+        static const uint8_t CONFIDENCE_PARITY = 40; // no parity errors
+        static const uint8_t CONFIDENCE_ECHO = 40; // answers the query we just sent
+        static const uint8_t CONFIDENCE_MAX = 100;
+        static const uint8_t CONFIDENCE_CONFIRMED = CONFIDENCE_MAX; // same as the previous reading, passes any threshold
+
+        inline uint8_t reading_score(bool clean, bool echo)
+        {
+            return (clean ? CONFIDENCE_PARITY : 0) + (echo ? CONFIDENCE_ECHO : 0);
+        }
+
+        inline bool reading_accepted(uint8_t score, bool confirmed, uint8_t threshold)
+        {
+            return score + (confirmed ? CONFIDENCE_CONFIRMED : 0) >= threshold;
+        }
+
+    } // namespace secplus1
+} // namespace ratgdo
+} // namespace esphome
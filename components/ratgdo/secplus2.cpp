@@ -1,11 +1,16 @@
 
 #include "secplus2.h"
+#include "profile.h"
 #include "ratgdo.h"
 
 #include "esphome/core/gpio.h"
+#include "esphome/core/hal.h"
 #include "esphome/core/log.h"
 #include "esphome/core/scheduler.h"
 
+#include <algorithm>
+#include <cstring>
+
 extern "C" {
 #include "secplus.h"
 }
@@ -14,16 +19,6 @@ namespace esphome {
 namespace ratgdo {
     namespace secplus2 {
 
-        // MAX_CODES_WITHOUT_FLASH_WRITE is a bit of a guess
-        // since we write the flash at most every every 1min
-        //
-        // We want the rolling counter to be high enough that the
-        // GDO will accept the command after an unexpected reboot
-        // that did not save the counter to flash in time which
-        // results in the rolling counter being behind what the GDO
-        // expects.
-        static const uint8_t MAX_CODES_WITHOUT_FLASH_WRITE = 60;
-
         static const char* const TAG = "ratgdo_secplus2";
 
         void Secplus2::setup(RATGDOComponent* ratgdo, Scheduler* scheduler, InternalGPIOPin* rx_pin, InternalGPIOPin* tx_pin)
@@ -42,15 +37,48 @@ namespace ratgdo {
 
         void Secplus2::loop()
         {
-            if (this->transmit_pending_) {
+            this->rolling_code_counter_.flush();
+            this->check_query_timeout();
+            if (this->tx_state_ == TxState::IDLE) {
+                this->start_next_transmit();
+            }
+            if (this->tx_state_ != TxState::IDLE) {
                 if (!this->transmit_packet()) {
                     return;
                 }
             }
 
-            auto cmd = this->read_command();
-            if (cmd) {
-                this->handle_command(*cmd);
+            // decode and dispatch every complete frame already sitting in the
+            // serial buffer, so a burst from the GDO (STATUS, LIGHT, MOTION,
+            // OPENINGS after a door close) is handled in one pass instead of
+            // one frame per loop; read_command runs at least once so partial
+            // frames still time out
+            const uint32_t start = micros();
+            const uint32_t budget = this->ratgdo_->get_rx_drain_budget();
+            uint8_t frames = 0;
+            do {
+                const uint32_t read_start = micros();
+                auto cmd = this->read_command();
+                if (cmd) {
+                    this->handle_command(*cmd);
+                    frames++;
+                }
+                this->rx_.max_time = std::max(this->rx_.max_time, micros() - read_start);
+            } while (this->sw_serial_.available() && micros() - start < budget);
+
+            if (frames > 0) {
+                this->ratgdo_->protocol_frame_received(frames);
+                this->rx_frames_total_ += frames;
+                if (frames > this->rx_frames_max_per_loop_) {
+                    this->rx_frames_max_per_loop_ = frames;
+                }
+                if (frames > 1) {
+                    ESP_LOG1(TAG, "Drained %d frames in %" PRIu32 "us", frames, micros() - start);
+                }
+            }
+
+            if (this->tx_state_ == TxState::IDLE && this->tx_queue_depth_ == 0) {
+                this->prepare_door_frame();
             }
         }
 
@@ -59,6 +87,24 @@ namespace ratgdo {
             ESP_LOGCONFIG(TAG, "  Rolling Code Counter: %d", *this->rolling_code_counter_);
             ESP_LOGCONFIG(TAG, "  Client ID: %d", this->client_id_);
             ESP_LOGCONFIG(TAG, "  Protocol: SEC+ v2");
+            ESP_LOGCONFIG(TAG, "  RX drain budget: %" PRIu32 "us", this->ratgdo_->get_rx_drain_budget());
+            ESP_LOGCONFIG(TAG, "  TX max loop stall: %" PRIu32 "us", this->tx_max_stall_overall_);
+            ESP_LOGCONFIG(TAG, "  TX queue: depth %d (max %d), %" PRIu32 " sent, %" PRIu32 " coalesced, %" PRIu32 " dropped, %" PRIu32 " expired",
+                this->tx_queue_depth_, this->tx_queue_max_depth_, this->tx_sent_, this->tx_coalesced_, this->tx_drops_, this->tx_expired_);
+            ESP_LOGCONFIG(TAG, "  TX queue wait: avg %" PRIu32 "ms, max %" PRIu32 "ms",
+                this->tx_sent_ > 0 ? this->tx_wait_total_ / this->tx_sent_ : 0, this->tx_wait_max_);
+            const char* query_names[] = { "STATUS", "OPENINGS", "PAIRED_DEVICES" };
+            for (size_t i = 0; i < 3; i++) {
+                const auto& stats = this->query_stats_[i];
+                ESP_LOGCONFIG(TAG, "  Query %s: %" PRIu32 " answered (avg %" PRIu32 "ms, max %" PRIu32 "ms), %" PRIu32 " timeouts", query_names[i],
+                    stats.count, stats.count > 0 ? stats.total / stats.count : 0, stats.max, stats.timeouts);
+            }
+            const auto& hit = this->door_frames_.hit;
+            const auto& miss = this->door_frames_.miss;
+            ESP_LOGCONFIG(TAG, "  Door frames: %" PRIu32 " pre-encoded (avg %" PRIu32 "us), %" PRIu32 " encoded (avg %" PRIu32 "us)",
+                hit.count, hit.count > 0 ? hit.total / hit.count : 0, miss.count, miss.count > 0 ? miss.total / miss.count : 0);
+            ESP_LOGCONFIG(TAG, "  RX frames: %" PRIu32 " total, max %d per loop", this->rx_frames_total_, this->rx_frames_max_per_loop_);
+            ESP_LOGCONFIG(TAG, "  RX worst case: %" PRIu32 "us per read, %" PRIu32 " incomplete packets discarded", this->rx_.max_time, this->rx_.discarded);
         }
 
         void Secplus2::sync_helper(uint32_t start, uint32_t delay, uint8_t tries)
@@ -97,18 +143,13 @@ namespace ratgdo {
                 return;
             }
 
-            if (tries == 2 && *this->ratgdo_->door_state == DoorState::UNKNOWN) { // made a few attempts and no progress (door state is the first sync request)
-                // increment rolling code counter by some amount in case we crashed without writing to flash the latest value
-                this->increment_rolling_code_counter(MAX_CODES_WITHOUT_FLASH_WRITE);
-            }
-
-            // not sync-ed after 30s, notify failure
-            if (millis() - start > 30000) {
+            // not sync-ed in time, notify failure
+            if (millis() - start > SYNC_TIMEOUT) {
                 ESP_LOGW(TAG, "Triggering sync failed actions.");
                 this->ratgdo_->sync_failed = true;
             } else {
                 if (tries % 3 == 0) {
-                    delay *= 1.5;
+                    delay *= SYNC_BACKOFF;
                 }
                 this->scheduler_->set_timeout(this->ratgdo_, "sync", delay, [=]() {
                     this->sync_helper(start, delay, tries + 1);
@@ -119,7 +160,7 @@ namespace ratgdo {
         void Secplus2::sync()
         {
             this->scheduler_->cancel_timeout(this->ratgdo_, "sync");
-            this->sync_helper(millis(), 500, 0);
+            this->sync_helper(millis(), SYNC_QUERY_DELAY, 0);
         }
 
         void Secplus2::light_action(LightAction action)
@@ -173,15 +214,30 @@ namespace ratgdo {
             return {};
         }
 
+        // The press and its release share a rolling code, the release moves
+        // the counter on. A press given before the previous release went out,
+        // the close that follows a stop as soon as the GDO reports STOPPED,
+        // would reuse that code and be ignored: the release goes out first
         void Secplus2::door_command(DoorAction action)
         {
+            if (this->door_release_ != DoorAction::UNKNOWN) {
+                this->scheduler_->cancel_timeout(this->ratgdo_, "door_release");
+                this->door_release();
+            }
             this->send_command(Command(CommandType::DOOR_ACTION, static_cast<uint8_t>(action), 1, 1), IncrementRollingCode::NO, [=]() {
-                this->scheduler_->set_timeout(this->ratgdo_, "", 150, [=] {
-                    this->send_command(Command(CommandType::DOOR_ACTION, static_cast<uint8_t>(action), 0, 1));
+                this->door_release_ = action;
+                this->scheduler_->set_timeout(this->ratgdo_, "door_release", PRESS_RELEASE_DELAY, [=] {
+                    this->door_release();
                 });
             });
         }
 
+        void Secplus2::door_release()
+        {
+            this->send_command(Command(CommandType::DOOR_ACTION, static_cast<uint8_t>(this->door_release_), 0, 1));
+            this->door_release_ = DoorAction::UNKNOWN;
+        }
+
         void Secplus2::query_status()
         {
             this->send_command(CommandType::GET_STATUS);
@@ -194,18 +250,12 @@ namespace ratgdo {
 
         void Secplus2::query_paired_devices()
         {
-            const auto kinds = {
-                PairedDevice::ALL,
-                PairedDevice::REMOTE,
-                PairedDevice::KEYPAD,
-                PairedDevice::WALL_CONTROL,
-                PairedDevice::ACCESSORY
-            };
-            uint32_t timeout = 0;
-            for (auto kind : kinds) {
-                timeout += 200;
-                this->scheduler_->set_timeout(this->ratgdo_, "", timeout, [=] { this->query_paired_devices(kind); });
-            }
+            // queries are sent one at a time, each as soon as the previous one is answered
+            this->query_paired_devices(PairedDevice::ALL);
+            this->query_paired_devices(PairedDevice::REMOTE);
+            this->query_paired_devices(PairedDevice::KEYPAD);
+            this->query_paired_devices(PairedDevice::WALL_CONTROL);
+            this->query_paired_devices(PairedDevice::ACCESSORY);
         }
 
         void Secplus2::query_paired_devices(PairedDevice kind)
@@ -222,64 +272,85 @@ namespace ratgdo {
             }
             ESP_LOGW(TAG, "Clear paired devices of type: %s", PairedDevice_to_string(kind));
             if (kind == PairedDevice::ALL) {
-                this->scheduler_->set_timeout(this->ratgdo_, "", 200, [=] { this->send_command(Command { CommandType::CLEAR_PAIRED_DEVICES, static_cast<uint8_t>(PairedDevice::REMOTE) - 1 }); }); // wireless
-                this->scheduler_->set_timeout(this->ratgdo_, "", 400, [=] { this->send_command(Command { CommandType::CLEAR_PAIRED_DEVICES, static_cast<uint8_t>(PairedDevice::KEYPAD) - 1 }); }); // keypads
-                this->scheduler_->set_timeout(this->ratgdo_, "", 600, [=] { this->send_command(Command { CommandType::CLEAR_PAIRED_DEVICES, static_cast<uint8_t>(PairedDevice::WALL_CONTROL) - 1 }); }); // wall controls
-                this->scheduler_->set_timeout(this->ratgdo_, "", 800, [=] { this->send_command(Command { CommandType::CLEAR_PAIRED_DEVICES, static_cast<uint8_t>(PairedDevice::ACCESSORY) - 1 }); }); // accessories
-                this->scheduler_->set_timeout(this->ratgdo_, "", 1000, [=] { this->query_status(); });
-                this->scheduler_->set_timeout(this->ratgdo_, "", 1200, [=] { this->query_paired_devices(); });
+                // wireless, keypads, wall controls then accessories
+                this->send_clear_paired_devices(PairedDevice::REMOTE, true);
             } else {
-                uint8_t dev_kind = static_cast<uint8_t>(kind) - 1;
-                this->send_command(Command { CommandType::CLEAR_PAIRED_DEVICES, dev_kind }); // just requested device
-                this->scheduler_->set_timeout(this->ratgdo_, "", 200, [=] { this->query_status(); });
-                this->scheduler_->set_timeout(this->ratgdo_, "", 400, [=] { this->query_paired_devices(kind); });
+                this->send_clear_paired_devices(kind, false);
             }
         }
 
+        // The GDO doesn't answer a clear, the next clear and the queries for
+        // the result are sent CLEAR_PAIRED_DEVICES_SPACING after it went out
+        void Secplus2::send_clear_paired_devices(PairedDevice kind, bool all)
+        {
+            uint8_t dev_kind = static_cast<uint8_t>(kind) - 1;
+            this->send_command(Command { CommandType::CLEAR_PAIRED_DEVICES, dev_kind }, IncrementRollingCode::YES, [=] {
+                this->scheduler_->set_timeout(this->ratgdo_, "", CLEAR_PAIRED_DEVICES_SPACING, [=] {
+                    if (all && kind != PairedDevice::ACCESSORY) {
+                        this->send_clear_paired_devices(static_cast<PairedDevice>(static_cast<uint8_t>(kind) + 1), true);
+                        return;
+                    }
+                    this->query_status();
+                    if (all) {
+                        this->query_paired_devices();
+                    } else {
+                        this->query_paired_devices(kind);
+                    }
+                });
+            });
+        }
+
         // Learn functions
         void Secplus2::activate_learn()
         {
             // Send LEARN with nibble = 0 then nibble = 1 to mimic wall control learn button
             this->send_command(Command { CommandType::LEARN, 0 });
-            this->scheduler_->set_timeout(this->ratgdo_, "", 150, [=] { this->send_command(Command { CommandType::LEARN, 1 }); });
-            this->scheduler_->set_timeout(this->ratgdo_, "", 500, [=] { this->query_status(); });
+            this->scheduler_->set_timeout(this->ratgdo_, "", PRESS_RELEASE_DELAY, [=] { this->send_command(Command { CommandType::LEARN, 1 }); });
+            this->scheduler_->set_timeout(this->ratgdo_, "", LEARN_STATUS_DELAY, [=] { this->query_status(); });
         }
 
         void Secplus2::inactivate_learn()
         {
             // Send LEARN twice with nibble = 0 to inactivate learn and get status to update switch state
             this->send_command(Command { CommandType::LEARN, 0 });
-            this->scheduler_->set_timeout(this->ratgdo_, "", 150, [=] { this->send_command(Command { CommandType::LEARN, 0 }); });
-            this->scheduler_->set_timeout(this->ratgdo_, "", 500, [=] { this->query_status(); });
+            this->scheduler_->set_timeout(this->ratgdo_, "", PRESS_RELEASE_DELAY, [=] { this->send_command(Command { CommandType::LEARN, 0 }); });
+            this->scheduler_->set_timeout(this->ratgdo_, "", LEARN_STATUS_DELAY, [=] { this->query_status(); });
         }
 
         optional<Command> Secplus2::read_command()
         {
-            static bool reading_msg = false;
-            static uint32_t msg_start = 0;
-            static uint16_t byte_count = 0;
-            static WirePacket rx_packet;
-            static uint32_t last_read = 0;
+            RATGDO_PROFILE_SCOPE("secplus2.read_command");
+            // parser state is per instance, several openers may be connected
+            auto& reading_msg = this->rx_.reading_msg;
+            auto& msg_start = this->rx_.msg_start;
+            auto& byte_count = this->rx_.byte_count;
+            auto& rx_packet = this->rx_.packet;
+            auto& last_read = this->rx_.last_read;
 
             if (!reading_msg) {
                 while (this->sw_serial_.available()) {
                     uint8_t ser_byte = this->sw_serial_.read();
+                    this->ratgdo_->capture_wire(ser_byte, 0);
                     last_read = millis();
 
                     if (ser_byte != 0x55 && ser_byte != 0x01 && ser_byte != 0x00) {
-                        ESP_LOG2(TAG, "Ignoring byte (%d): %02X, baud: %d", byte_count, ser_byte, this->sw_serial_.baudRate());
-                        byte_count = 0;
+                        ESP_LOG2(TAG, "Ignoring byte: %02X, baud: %d", ser_byte, this->sw_serial_.baudRate());
+                        this->ratgdo_->protocol_frame_rejected();
+                        msg_start = 0;
                         continue;
                     }
                     msg_start = ((msg_start << 8) | ser_byte) & 0xffffff;
-                    byte_count++;
 
-                    // if we are at the start of a message, capture the next 16 bytes
+                    // if we are at the start of a message, capture the next 16 bytes.
+                    // the preamble is matched on msg_start alone, a run of preamble
+                    // bytes on a noisy line must not move where the payload is stored
                     if (msg_start == 0x550100) {
                         ESP_LOG1(TAG, "Baud: %d", this->sw_serial_.baudRate());
                         rx_packet[0] = 0x55;
                         rx_packet[1] = 0x01;
                         rx_packet[2] = 0x00;
+                        byte_count = 3;
+                        msg_start = 0;
 
                         reading_msg = true;
                         break;
@@ -289,6 +360,7 @@ namespace ratgdo {
             if (reading_msg) {
                 while (this->sw_serial_.available()) {
                     uint8_t ser_byte = this->sw_serial_.read();
+                    this->ratgdo_->capture_wire(ser_byte, 0);
                     last_read = millis();
                     rx_packet[byte_count] = ser_byte;
                     byte_count++;
@@ -302,13 +374,15 @@ namespace ratgdo {
                     }
                 }
 
-                if (millis() - last_read > 100) {
+                if (millis() - last_read > RX_PACKET_TIMEOUT) {
                     // if we have a partial packet and it's been over 100ms since last byte was read,
                     // the rest is not coming (a full packet should be received in ~20ms),
                     // discard it so we can read the following packet correctly
                     ESP_LOGW(TAG, "Discard incomplete packet, length: %d", byte_count);
                     reading_msg = false;
                     byte_count = 0;
+                    this->rx_.discarded++;
+                    this->ratgdo_->protocol_frame_rejected();
                 }
             }
 
@@ -342,11 +416,16 @@ namespace ratgdo {
 
         optional<Command> Secplus2::decode_packet(const WirePacket& packet) const
         {
+            RATGDO_PROFILE_SCOPE("secplus2.decode_packet");
             uint32_t rolling = 0;
             uint64_t fixed = 0;
             uint32_t data = 0;
 
-            decode_wireline(packet, &rolling, &fixed, &data);
+            if (decode_wireline(packet, &rolling, &fixed, &data) < 0) {
+                ESP_LOG2(TAG, "Dropping packet that fails to decode");
+                this->ratgdo_->protocol_frame_rejected();
+                return {};
+            }
 
             uint16_t cmd = ((fixed >> 24) & 0xf00) | (data & 0xff);
             data &= ~0xf000; // clear parity nibble
@@ -370,8 +449,11 @@ namespace ratgdo {
 
         void Secplus2::handle_command(const Command& cmd)
         {
+            RATGDO_PROFILE_SCOPE("secplus2.handle_command");
             ESP_LOG1(TAG, "Handle command: %s", CommandType_to_string(cmd.type));
 
+            this->match_query_response(cmd);
+
             if (cmd.type == CommandType::STATUS) {
 
                 this->ratgdo_->received(to_DoorState(cmd.nibble, DoorState::UNKNOWN));
@@ -415,34 +497,271 @@ namespace ratgdo {
             ESP_LOG1(TAG, "Done handle command: %s", CommandType_to_string(cmd.type));
         }
 
+        TxPriority Secplus2::tx_priority(const Command& command)
+        {
+            if (command.type == CommandType::DOOR_ACTION) {
+                return command.nibble == static_cast<uint8_t>(DoorAction::STOP) ? TxPriority::DOOR_STOP : TxPriority::DOOR;
+            }
+            if (command.type == CommandType::GET_STATUS || command.type == CommandType::GET_OPENINGS || command.type == CommandType::GET_PAIRED_DEVICES) {
+                return TxPriority::QUERY;
+            }
+            return TxPriority::NORMAL;
+        }
+
         void Secplus2::send_command(Command command, IncrementRollingCode increment)
+        {
+            this->send_command(command, increment, nullptr);
+        }
+
+        void Secplus2::send_command(Command command, IncrementRollingCode increment, std::function<void()>&& on_sent)
+        {
+            this->enqueue_command(command, increment, std::move(on_sent), this->tx_seq_++, 0);
+        }
+
+        // seq orders commands of the same priority, a retried query keeps the
+        // seq of its first attempt so it doesn't queue behind later queries
+        void Secplus2::enqueue_command(Command command, IncrementRollingCode increment, std::function<void()>&& on_sent, uint32_t seq, uint8_t retries)
         {
             ESP_LOG1(TAG, "Send command: %s, data: %02X%02X%02X", CommandType_to_string(command.type), command.byte2, command.byte1, command.nibble);
-            if (!this->transmit_pending_) { // have an untransmitted packet
-                this->encode_packet(command, this->tx_packet_);
-                if (increment == IncrementRollingCode::YES) {
-                    this->increment_rolling_code_counter();
+            if (this->tx_state_ != TxState::IDLE && this->transmit_pending_start_ == 0) {
+                ESP_LOGW(TAG, "Not connected to GDO, ignoring command: %s", CommandType_to_string(command.type));
+                return;
+            }
+
+            auto now = millis();
+            auto priority = tx_priority(command);
+
+            if (priority == TxPriority::QUERY) {
+                for (uint8_t i = 0; i < this->tx_queue_depth_; i++) {
+                    const auto& queued = this->tx_queue_[i].command;
+                    if (queued.type == command.type && queued.nibble == command.nibble && queued.byte1 == command.byte1 && queued.byte2 == command.byte2) {
+                        ESP_LOG1(TAG, "Coalesced with queued command: %s", CommandType_to_string(command.type));
+                        auto& entry = this->tx_queue_[i];
+                        entry.retries = std::max(entry.retries, retries);
+                        entry.seq = std::min(entry.seq, seq);
+                        this->tx_coalesced_++;
+                        return;
+                    }
                 }
-            } else {
-                // unlikely this would happed (unless not connected to GDO), we're ensuring any pending packet
-                // is transmitted each loop before doing anyting else
-                if (this->transmit_pending_start_ > 0) {
-                    ESP_LOGW(TAG, "Have untransmitted packet, ignoring command: %s", CommandType_to_string(command.type));
+            }
+
+            if (this->tx_queue_depth_ == TX_QUEUE_LENGTH) {
+                // make room by dropping the oldest entry of the lowest priority,
+                // provided it ranks below the new command
+                uint8_t victim = 0;
+                for (uint8_t i = 1; i < TX_QUEUE_LENGTH; i++) {
+                    const auto& e = this->tx_queue_[i];
+                    const auto& v = this->tx_queue_[victim];
+                    if (e.priority < v.priority || (e.priority == v.priority && e.seq < v.seq)) {
+                        victim = i;
+                    }
+                }
+                if (this->tx_queue_[victim].priority >= priority) {
+                    ESP_LOGW(TAG, "Transmit queue full, dropping command: %s", CommandType_to_string(command.type));
+                    this->tx_drops_++;
+                    return;
+                }
+                ESP_LOGW(TAG, "Transmit queue full, dropping command: %s", CommandType_to_string(this->tx_queue_[victim].command.type));
+                this->tx_drops_++;
+                this->tx_queue_[victim] = std::move(this->tx_queue_[--this->tx_queue_depth_]);
+            }
+
+            auto& entry = this->tx_queue_[this->tx_queue_depth_++];
+            entry.command = command;
+            entry.increment = increment;
+            entry.priority = priority;
+            entry.seq = seq;
+            entry.retries = retries;
+            entry.enqueued = now;
+            entry.expires = now + (priority == TxPriority::QUERY ? TX_QUERY_EXPIRY : TX_COMMAND_EXPIRY);
+            entry.on_sent = std::move(on_sent);
+
+            if (this->tx_queue_depth_ > this->tx_queue_max_depth_) {
+                this->tx_queue_max_depth_ = this->tx_queue_depth_;
+            }
+
+            if (this->tx_state_ == TxState::IDLE && this->start_next_transmit()) {
+                this->transmit_packet();
+            }
+        }
+
+        bool Secplus2::start_next_transmit()
+        {
+            auto now = millis();
+            while (this->tx_queue_depth_ > 0) {
+                // only one query is outstanding at a time, the next one goes
+                // out once the GDO answered or the previous one timed out
+                const bool hold_queries = this->pending_query_.active;
+                int next = -1;
+                for (uint8_t i = 0; i < this->tx_queue_depth_; i++) {
+                    const auto& e = this->tx_queue_[i];
+                    if (hold_queries && e.priority == TxPriority::QUERY) {
+                        continue;
+                    }
+                    if (next < 0) {
+                        next = i;
+                        continue;
+                    }
+                    const auto& n = this->tx_queue_[next];
+                    if (e.priority > n.priority || (e.priority == n.priority && e.seq < n.seq)) {
+                        next = i;
+                    }
+                }
+                if (next < 0) {
+                    return false;
+                }
+                this->tx_current_ = std::move(this->tx_queue_[next]);
+                this->tx_queue_[next] = std::move(this->tx_queue_[--this->tx_queue_depth_]);
+
+                if (int32_t(now - this->tx_current_.expires) > 0) {
+                    ESP_LOGD(TAG, "Command expired in transmit queue: %s", CommandType_to_string(this->tx_current_.command.type));
+                    this->tx_expired_++;
+                    continue;
+                }
+
+                auto wait = now - this->tx_current_.enqueued;
+                this->tx_wait_total_ += wait;
+                this->tx_sent_++;
+                if (wait > this->tx_wait_max_) {
+                    this->tx_wait_max_ = wait;
+                }
+
+                // the rolling code is taken when the packet goes out, so that
+                // codes stay in transmit order regardless of queue priorities
+                this->ratgdo_->use_rolling_code(*this->rolling_code_counter_);
+                if (this->tx_current_.command.type == CommandType::DOOR_ACTION) {
+                    auto encode_start = micros();
+                    bool hit = this->take_door_frame(this->tx_current_.command, this->tx_packet_);
+                    if (!hit) {
+                        this->encode_packet(this->tx_current_.command, this->tx_packet_);
+                    }
+                    auto encode_time = micros() - encode_start;
+                    auto& stats = hit ? this->door_frames_.hit : this->door_frames_.miss;
+                    stats.count++;
+                    stats.total += encode_time;
+                    ESP_LOG1(TAG, "Door frame %s in %" PRIu32 "us", hit ? "pre-encoded" : "encoded", encode_time);
                 } else {
-                    ESP_LOGW(TAG, "Not connected to GDO, ignoring command: %s", CommandType_to_string(command.type));
+                    this->encode_packet(this->tx_current_.command, this->tx_packet_);
+                }
+                if (this->tx_current_.increment == IncrementRollingCode::YES) {
+                    this->increment_rolling_code_counter();
                 }
+                this->tx_state_ = TxState::WAIT_BUS_IDLE;
+                this->tx_state_start_ = micros();
+                this->tx_rx_available_ = this->sw_serial_.available();
+                this->tx_collision_ = false;
+                this->tx_max_stall_ = 0;
+                this->transmit_pending_start_ = now;
+                // keep the loop running back to back until the packet is out
+                this->high_freq_.start();
+                return true;
             }
-            this->transmit_packet();
+            return false;
         }
 
-        void Secplus2::send_command(Command command, IncrementRollingCode increment, std::function<void()>&& on_sent)
+        QueryStats* Secplus2::query_stats(CommandType request)
         {
-            this->on_command_sent_(on_sent);
-            this->send_command(command, increment);
+            if (request == CommandType::GET_STATUS) {
+                return &this->query_stats_[0];
+            } else if (request == CommandType::GET_OPENINGS) {
+                return &this->query_stats_[1];
+            } else if (request == CommandType::GET_PAIRED_DEVICES) {
+                return &this->query_stats_[2];
+            }
+            return nullptr;
+        }
+
+        void Secplus2::match_query_response(const Command& cmd)
+        {
+            auto& pending = this->pending_query_;
+            if (!pending.active) {
+                return;
+            }
+            // every query is answered with the command code following it:
+            // GET_STATUS -> STATUS, GET_OPENINGS -> OPENINGS, GET_PAIRED_DEVICES -> PAIRED_DEVICES
+            const auto request = static_cast<uint16_t>(pending.command.type);
+            if (static_cast<uint16_t>(cmd.type) != request + 1) {
+                return;
+            }
+            if (pending.command.type == CommandType::GET_PAIRED_DEVICES && cmd.nibble != pending.command.nibble) {
+                return;
+            }
+
+            auto latency = millis() - pending.sent;
+            auto* stats = this->query_stats(pending.command.type);
+            if (stats != nullptr) {
+                stats->count++;
+                stats->total += latency;
+                if (latency > stats->max) {
+                    stats->max = latency;
+                }
+            }
+            ESP_LOG1(TAG, "%s answered in %" PRIu32 "ms", CommandType_to_string(pending.command.type), latency);
+            pending.active = false;
+        }
+
+        void Secplus2::check_query_timeout()
+        {
+            auto& pending = this->pending_query_;
+            if (!pending.active || millis() - pending.sent < QUERY_TIMEOUT) {
+                return;
+            }
+            pending.active = false;
+            auto* stats = this->query_stats(pending.command.type);
+            if (stats != nullptr) {
+                stats->timeouts++;
+            }
+            if (pending.retries < QUERY_RETRIES) {
+                ESP_LOGD(TAG, "No answer to %s, retrying", CommandType_to_string(pending.command.type));
+                this->enqueue_command(pending.command, IncrementRollingCode::YES, nullptr, pending.seq, pending.retries + 1);
+                return;
+            }
+            ESP_LOGD(TAG, "No answer to %s after %d retries", CommandType_to_string(pending.command.type), pending.retries);
+        }
+
+        // The press (byte1 = 1) and release (byte1 = 0) packets of the four door
+        // actions only depend on the rolling code counter and the client ID, so
+        // they are encoded ahead of time while the bus is idle, one per loop.
+        // press doesn't increment the counter, so its release is usually a hit too
+        void Secplus2::prepare_door_frame()
+        {
+            auto& cache = this->door_frames_;
+            if (cache.counter != *this->rolling_code_counter_ || cache.client_id != this->client_id_) {
+                cache.counter = *this->rolling_code_counter_;
+                cache.client_id = this->client_id_;
+                cache.valid = 0;
+            }
+            for (uint8_t i = 0; i < DOOR_FRAME_COUNT; i++) {
+                if ((cache.valid & (1 << i)) == 0) {
+                    uint8_t action = i >> 1;
+                    uint8_t press = i & 1;
+                    this->encode_packet(Command(CommandType::DOOR_ACTION, action, press, 1), cache.frames[i]);
+                    cache.valid |= 1 << i;
+                    return;
+                }
+            }
+        }
+
+        bool Secplus2::take_door_frame(const Command& command, WirePacket& packet)
+        {
+            auto& cache = this->door_frames_;
+            if (command.nibble > static_cast<uint8_t>(DoorAction::STOP) || command.byte1 > 1 || command.byte2 != 1) {
+                return false;
+            }
+            if (cache.counter != *this->rolling_code_counter_ || cache.client_id != this->client_id_) {
+                return false;
+            }
+            uint8_t i = (command.nibble << 1) | command.byte1;
+            if ((cache.valid & (1 << i)) == 0) {
+                return false;
+            }
+            memcpy(packet, cache.frames[i], PACKET_LENGTH);
+            return true;
         }
 
         void Secplus2::encode_packet(Command command, WirePacket& packet)
         {
+            RATGDO_PROFILE_SCOPE("secplus2.encode_packet");
             auto cmd = static_cast<uint64_t>(command.type);
             uint64_t fixed = ((cmd & ~0xff) << 24) | this->client_id_;
             uint32_t data = (static_cast<uint64_t>(command.byte2) << 24) | (static_cast<uint64_t>(command.byte1) << 16) | (static_cast<uint64_t>(command.nibble) << 8) | (cmd & 0xff);
@@ -451,43 +770,87 @@ namespace ratgdo {
             encode_wireline(*this->rolling_code_counter_, fixed, data, packet);
         }
 
+        // Waits for the line to be idle without blocking the loop, returns
+        // true once the packet is sent.
+        //
+        //   WAIT_BUS_IDLE: the line must stay idle for 1.3ms before sending.
+        //                  The wait spans loops, bytes the serial interrupt
+        //                  buffered in between count as activity
+        //   then the break and the whole packet go out in one call, a gap
+        //   between them would let the GDO start talking inside our frame.
+        //   That call still blocks the loop for about 21ms: the 1.3ms break,
+        //   130us of stop bit and 19 bytes at 9600 baud, the software serial
+        //   write returns once the last bit is out
         bool Secplus2::transmit_packet()
         {
-            auto now = micros();
+            const uint32_t call_start = micros();
+            bool done = this->transmit_step(call_start);
+            uint32_t stall = micros() - call_start;
+            if (stall > this->tx_max_stall_) {
+                this->tx_max_stall_ = stall;
+            }
+            if (done) {
+                if (this->tx_max_stall_ > this->tx_max_stall_overall_) {
+                    this->tx_max_stall_overall_ = this->tx_max_stall_;
+                }
+                ESP_LOG1(TAG, "Sent packet in %" PRIu32 "ms, max loop stall %" PRIu32 "us",
+                    millis() - this->transmit_pending_start_, this->tx_max_stall_);
+                this->transmit_pending_start_ = 0;
+                if (this->tx_current_.priority == TxPriority::QUERY) {
+                    auto& pending = this->pending_query_;
+                    pending.command = this->tx_current_.command;
+                    pending.seq = this->tx_current_.seq;
+                    pending.retries = this->tx_current_.retries;
+                    pending.active = true;
+                    pending.sent = millis();
+                }
+                if (this->tx_current_.on_sent) {
+                    auto on_sent = std::move(this->tx_current_.on_sent);
+                    this->tx_current_.on_sent = nullptr;
+                    on_sent();
+                }
+            }
+            return done;
+        }
 
-            while (micros() - now < 1300) {
-                if (this->rx_pin_->digital_read()) {
-                    if (!this->transmit_pending_) {
-                        this->transmit_pending_ = true;
-                        this->transmit_pending_start_ = millis();
+        bool Secplus2::transmit_step(uint32_t now)
+        {
+            if (this->tx_state_ == TxState::WAIT_BUS_IDLE) {
+                int available = this->sw_serial_.available();
+                if (this->rx_pin_->digital_read() || available != this->tx_rx_available_) {
+                    this->tx_rx_available_ = available;
+                    this->tx_state_start_ = now;
+                    if (!this->tx_collision_) {
+                        this->tx_collision_ = true;
                         ESP_LOGD(TAG, "Collision detected, waiting to send packet");
-                    } else {
-                        if (millis() - this->transmit_pending_start_ < 5000) {
-                            ESP_LOGD(TAG, "Collision detected, waiting to send packet");
-                        } else {
-                            this->transmit_pending_start_ = 0; // to indicate GDO not connected state
-                        }
+                    } else if (this->transmit_pending_start_ > 0 && millis() - this->transmit_pending_start_ > GDO_DISCONNECTED_TIME) {
+                        this->transmit_pending_start_ = 0; // to indicate GDO not connected state
                     }
                     return false;
                 }
-                delayMicroseconds(100);
-            }
+                if (now - this->tx_state_start_ < BUS_IDLE_TIME) {
+                    return false;
+                }
+                if (!this->ratgdo_->may_transmit()) {
+                    return false;
+                }
 
-            this->print_packet("Sending packet", this->tx_packet_);
+                this->print_packet("Sending packet", this->tx_packet_);
 
-            // indicate the start of a frame by pulling the 12V line low for at leat 1 byte followed by
-            // one STOP bit, which indicates to the receiving end that the start of the message follows
-            // The output pin is controlling a transistor, so the logic is inverted
-            this->tx_pin_->digital_write(true); // pull the line low for at least 1 byte
-            delayMicroseconds(1300);
-            this->tx_pin_->digital_write(false); // line high for at least 1 bit
-            delayMicroseconds(130);
+                // indicate the start of a frame by pulling the 12V line low for at leat 1 byte followed by
+                // one STOP bit, which indicates to the receiving end that the start of the message follows
+                // The output pin is controlling a transistor, so the logic is inverted
+                this->tx_pin_->digital_write(true); // pull the line low for at least 1 byte
+                delayMicroseconds(BUS_IDLE_TIME);
+                this->tx_pin_->digital_write(false); // line high for at least 1 bit
+                delayMicroseconds(130);
 
-            this->sw_serial_.write(this->tx_packet_, PACKET_LENGTH);
+                this->sw_serial_.write(this->tx_packet_, PACKET_LENGTH);
+                this->ratgdo_->capture_wire(this->tx_packet_, PACKET_LENGTH, WIRE_TX);
+            }
 
-            this->transmit_pending_ = false;
-            this->transmit_pending_start_ = 0;
-            this->on_command_sent_.trigger();
+            this->tx_state_ = TxState::IDLE;
+            this->high_freq_.stop();
             return true;
         }
 
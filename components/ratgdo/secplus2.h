@@ -1,6 +1,7 @@
 #pragma once
 
 #include "SoftwareSerial.h" // Using espsoftwareserial https://github.com/plerup/espsoftwareserial
+#include "esphome/core/helpers.h"
 #include "esphome/core/optional.h"
 
 #include "callbacks.h"
@@ -61,11 +62,28 @@ namespace ratgdo {
         inline bool operator==(const uint16_t cmd_i, const CommandType& cmd_e) { return cmd_i == static_cast<uint16_t>(cmd_e); }
         inline bool operator==(const CommandType& cmd_e, const uint16_t cmd_i) { return cmd_i == static_cast<uint16_t>(cmd_e); }
 
+        enum class TxState : uint8_t {
+            IDLE,
+            WAIT_BUS_IDLE,
+        };
+
         enum class IncrementRollingCode {
             NO,
             YES,
         };
 
+        // higher value is transmitted first
+        enum class TxPriority : uint8_t {
+            QUERY,
+            NORMAL,
+            DOOR,
+            DOOR_STOP,
+        };
+
+        static const uint8_t TX_QUEUE_LENGTH = 12;
+        static const uint32_t TX_QUERY_EXPIRY = 3000; // ms
+        static const uint32_t TX_COMMAND_EXPIRY = 5000; // ms
+
         struct Command {
             CommandType type;
             uint8_t nibble;
@@ -85,6 +103,61 @@ namespace ratgdo {
             }
         };
 
+        static const uint32_t QUERY_TIMEOUT = 500; // ms
+        static const uint8_t QUERY_RETRIES = 2;
+
+        // timing of the protocol, all in ms unless noted
+        static const uint32_t SYNC_QUERY_DELAY = 500; // between sync rounds, grows by SYNC_BACKOFF every third round
+        static const float SYNC_BACKOFF = 1.5f;
+        static const uint32_t SYNC_TIMEOUT = 30000; // sync failed when not synced by then
+        static const uint32_t PRESS_RELEASE_DELAY = 150; // between the press and release frames of a button
+        static const uint32_t LEARN_STATUS_DELAY = 500; // status query after changing learn mode
+        static const uint32_t CLEAR_PAIRED_DEVICES_SPACING = 200; // after a clear before the next command of the sequence
+        static const uint32_t RX_PACKET_TIMEOUT = 100; // a partial packet is discarded after this long without bytes
+        static const uint32_t BUS_IDLE_TIME = 1300; // us the line has to be idle before sending, also the break length
+        static const uint32_t GDO_DISCONNECTED_TIME = 5000; // line held busy this long means no GDO is connected
+
+        struct PendingQuery {
+            Command command;
+            uint32_t seq { 0 };
+            uint32_t sent { 0 };
+            uint8_t retries { 0 }; // of the query in flight
+            bool active { false };
+        };
+
+        struct QueryStats {
+            uint32_t count { 0 };
+            uint32_t total { 0 }; // ms
+            uint32_t max { 0 }; // ms
+            uint32_t timeouts { 0 };
+        };
+
+        // press and release for each of CLOSE, OPEN, TOGGLE and STOP
+        static const uint8_t DOOR_FRAME_COUNT = 8;
+
+        struct DoorFrameCache {
+            uint32_t counter { 0 };
+            uint64_t client_id { 0 };
+            uint8_t valid { 0 }; // bit per frame, index = action << 1 | press
+            WirePacket frames[DOOR_FRAME_COUNT];
+
+            struct {
+                uint32_t count { 0 };
+                uint32_t total { 0 }; // us
+            } hit, miss;
+        };
+
+        struct TxEntry {
+            Command command;
+            IncrementRollingCode increment;
+            TxPriority priority;
+            uint32_t seq;
+            uint8_t retries; // times a query was already sent without an answer
+            uint32_t enqueued;
+            uint32_t expires;
+            std::function<void()> on_sent;
+        };
+
         class Secplus2 : public Protocol {
         public:
             void setup(RATGDOComponent* ratgdo, Scheduler* scheduler, InternalGPIOPin* rx_pin, InternalGPIOPin* tx_pin);
@@ -100,6 +173,7 @@ namespace ratgdo {
             Result call(Args args);
 
             const Traits& traits() const { return this->traits_; }
+            bool rx_in_progress() { return this->rx_.reading_msg || this->sw_serial_.available() > 0; }
 
             // methods not used by secplus2
             void set_open_limit(bool state) { }
@@ -117,16 +191,27 @@ namespace ratgdo {
 
             void send_command(Command cmd, IncrementRollingCode increment = IncrementRollingCode::YES);
             void send_command(Command cmd, IncrementRollingCode increment, std::function<void()>&& on_sent);
+            void enqueue_command(Command cmd, IncrementRollingCode increment, std::function<void()>&& on_sent, uint32_t seq, uint8_t retries);
             void encode_packet(Command cmd, WirePacket& packet);
+            void prepare_door_frame();
+            bool take_door_frame(const Command& command, WirePacket& packet);
+            static TxPriority tx_priority(const Command& command);
+            void match_query_response(const Command& cmd);
+            void check_query_timeout();
+            QueryStats* query_stats(CommandType request);
+            bool start_next_transmit();
             bool transmit_packet();
+            bool transmit_step(uint32_t now);
 
             void door_command(DoorAction action);
+            void door_release();
 
             void query_status();
             void query_openings();
             void query_paired_devices();
             void query_paired_devices(PairedDevice kind);
             void clear_paired_devices(PairedDevice kind);
+            void send_clear_paired_devices(PairedDevice kind, bool all);
             void activate_learn();
             void inactivate_learn();
 
@@ -136,14 +221,49 @@ namespace ratgdo {
             void sync_helper(uint32_t start, uint32_t delay, uint8_t tries);
 
             LearnState learn_state_ { LearnState::UNKNOWN };
+            DoorAction door_release_ { DoorAction::UNKNOWN }; // the press sent, its release still to go
 
             observable<uint32_t> rolling_code_counter_ { 0 };
             uint64_t client_id_ { 0x539 };
 
-            bool transmit_pending_ { false };
+            uint32_t rx_frames_total_ { 0 };
+            uint8_t rx_frames_max_per_loop_ { 0 };
+
+            TxState tx_state_ { TxState::IDLE };
+            uint32_t tx_state_start_ { 0 };
+            int tx_rx_available_ { 0 }; // serial bytes buffered when the line was last seen busy
+            bool tx_collision_ { false };
+            uint32_t tx_max_stall_ { 0 };
+            uint32_t tx_max_stall_overall_ { 0 };
             uint32_t transmit_pending_start_ { 0 };
             WirePacket tx_packet_;
-            OnceCallbacks<void()> on_command_sent_;
+            struct {
+                bool reading_msg { false };
+                uint32_t msg_start { 0 };
+                uint16_t byte_count { 0 };
+                WirePacket packet;
+                uint32_t last_read { 0 };
+                uint32_t discarded { 0 }; // incomplete packets
+                uint32_t max_time { 0 }; // us, slowest read_command with its handle_command
+            } rx_;
+            TxEntry tx_current_;
+            HighFrequencyLoopRequester high_freq_;
+
+            TxEntry tx_queue_[TX_QUEUE_LENGTH];
+            uint8_t tx_queue_depth_ { 0 };
+            uint8_t tx_queue_max_depth_ { 0 };
+            uint32_t tx_seq_ { 0 };
+            uint32_t tx_sent_ { 0 };
+            uint32_t tx_coalesced_ { 0 };
+            uint32_t tx_drops_ { 0 };
+            uint32_t tx_expired_ { 0 };
+            uint32_t tx_wait_total_ { 0 };
+            uint32_t tx_wait_max_ { 0 };
+
+            DoorFrameCache door_frames_;
+
+            PendingQuery pending_query_;
+            QueryStats query_stats_[3]; // STATUS, OPENINGS, PAIRED_DEVICES
 
             Traits traits_;
 
@@ -0,0 +1,188 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+
+namespace esphome {
+namespace ratgdo {
+
+    static const uint8_t TX_WHEEL_CAPACITY = 8;
+    static const uint8_t TX_WHEEL_SLOTS = 64; // power of two
+    static const uint8_t TX_WHEEL_OVERFLOW = TX_WHEEL_SLOTS; // slot of entries beyond the wheel
+    static const uint32_t TX_WHEEL_TICK = 128; // ms, power of two so slots stay aligned across the millis() wrap
+    static const uint32_t TX_WHEEL_SPAN = TX_WHEEL_SLOTS * TX_WHEEL_TICK; // ms the wheel covers ahead, 8.2s
+
+    template <typename Request>
+    struct TxCommand {
+        Request request;
+        uint32_t time;
+        int8_t next; // next entry in the same slot, or in the free list
+        uint8_t slot;
+    };
+
+    // Pending transmissions in static storage. Each slot of the wheel holds
+    // the commands due within one tick in insertion order, so commands due
+    // at the same time go out first in, first out. Inserting only touches
+    // the slot of its tick, finding the next command scans forward to the
+    // first occupied slot. Commands beyond the wheel wait in an overflow
+    // list until the wheel reaches them.
+    template <typename Request>
+    class TxWheel {
+    public:
+        TxWheel()
+        {
+            for (auto& slot : this->slots_) {
+                slot = -1;
+            }
+            for (int8_t i = 0; i < TX_WHEEL_CAPACITY; i++) {
+                this->entries_[i].next = i + 1 < TX_WHEEL_CAPACITY ? i + 1 : -1;
+            }
+        }
+
+        bool insert(Request request, uint32_t time)
+        {
+            if (this->free_ < 0) {
+                return false;
+            }
+            auto index = this->free_;
+            this->free_ = this->entries_[index].next;
+            if (this->count_++ == 0) {
+                this->tick_ = tick_of(time);
+            }
+            this->entries_[index].request = request;
+            this->entries_[index].time = time;
+            this->link(index);
+            return true;
+        }
+
+        // the earliest entry due at now, -1 if none is
+        int8_t due(uint32_t now)
+        {
+            if (this->count_ == 0) {
+                return -1;
+            }
+            uint32_t now_tick = tick_of(now);
+            bool advanced = false;
+            while (int32_t(now_tick - this->tick_) > 0 && this->slots_[slot_of(this->tick_)] < 0) {
+                this->tick_ += TX_WHEEL_TICK;
+                advanced = true;
+            }
+            if (advanced) {
+                this->migrate_overflow();
+            }
+            int8_t best = -1;
+            for (auto i = this->slots_[slot_of(this->tick_)]; i >= 0; i = this->entries_[i].next) {
+                const auto& entry = this->entries_[i];
+                if (int32_t(now - entry.time) >= 0 && (best < 0 || int32_t(entry.time - this->entries_[best].time) < 0)) {
+                    best = i;
+                }
+            }
+            return best;
+        }
+
+        const TxCommand<Request>& get(int8_t index) const { return this->entries_[index]; }
+
+        void remove(int8_t index)
+        {
+            this->unlink(index);
+            this->entries_[index].next = this->free_;
+            this->free_ = index;
+            this->count_--;
+        }
+
+        void rearm(int8_t index, Request request, uint32_t time)
+        {
+            this->unlink(index);
+            this->entries_[index].request = request;
+            this->entries_[index].time = time;
+            this->link(index);
+        }
+
+        uint32_t time_until_next(uint32_t now) const
+        {
+            if (this->count_ == 0) {
+                return UINT32_MAX;
+            }
+            // every entry on the wheel is due before the overflow list
+            for (uint8_t i = 0; i < TX_WHEEL_SLOTS; i++) {
+                auto index = this->slots_[slot_of(this->tick_ + i * TX_WHEEL_TICK)];
+                if (index >= 0) {
+                    return this->earliest(index, now);
+                }
+            }
+            return this->earliest(this->overflow_, now);
+        }
+
+        bool empty() const { return this->count_ == 0; }
+
+    protected:
+        void link(int8_t index)
+        {
+            auto& entry = this->entries_[index];
+            uint32_t tick = tick_of(entry.time);
+            // overdue entries go to the current slot
+            if (int32_t(tick - this->tick_) < 0) {
+                tick = this->tick_;
+            }
+            entry.slot = tick - this->tick_ < TX_WHEEL_SPAN ? slot_of(tick) : TX_WHEEL_OVERFLOW;
+            entry.next = -1;
+            auto* link = this->head(entry.slot);
+            while (*link >= 0) {
+                link = &this->entries_[*link].next;
+            }
+            *link = index;
+        }
+
+        void unlink(int8_t index)
+        {
+            auto* link = this->head(this->entries_[index].slot);
+            while (*link >= 0) {
+                if (*link == index) {
+                    *link = this->entries_[index].next;
+                    return;
+                }
+                link = &this->entries_[*link].next;
+            }
+        }
+
+        // moves overflow entries the wheel has reached onto it
+        void migrate_overflow()
+        {
+            auto* link = &this->overflow_;
+            while (*link >= 0) {
+                auto index = *link;
+                if (int32_t(tick_of(this->entries_[index].time) - this->tick_) < int32_t(TX_WHEEL_SPAN)) {
+                    *link = this->entries_[index].next;
+                    this->link(index);
+                } else {
+                    link = &this->entries_[index].next;
+                }
+            }
+        }
+
+        // ticks are kept as the ms time their slot starts at, so they
+        // compare across the millis() wrap like any other time
+        static uint32_t tick_of(uint32_t time) { return time & ~(TX_WHEEL_TICK - 1); }
+        static uint8_t slot_of(uint32_t tick) { return (tick / TX_WHEEL_TICK) & (TX_WHEEL_SLOTS - 1); }
+
+        int8_t* head(uint8_t slot) { return slot == TX_WHEEL_OVERFLOW ? &this->overflow_ : &this->slots_[slot]; }
+
+        uint32_t earliest(int8_t index, uint32_t now) const
+        {
+            uint32_t next = UINT32_MAX;
+            for (; index >= 0; index = this->entries_[index].next) {
+                int32_t remaining = this->entries_[index].time - now;
+                next = std::min<uint32_t>(next, std::max<int32_t>(remaining, 0));
+            }
+            return next;
+        }
+
+        TxCommand<Request> entries_[TX_WHEEL_CAPACITY];
+        int8_t slots_[TX_WHEEL_SLOTS];
+        int8_t overflow_ { -1 };
+        int8_t free_ { 0 };
+        uint8_t count_ { 0 };
+        uint32_t tick_ { 0 }; // earliest tick that may hold entries, ms
+    };
+
+} // namespace ratgdo
+} // namespace esphome
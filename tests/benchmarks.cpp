@@ -0,0 +1,235 @@
+// Host benchmarks of the protocol codecs and the state pipeline, Google
+// Benchmark style: each body runs until MIN_TIME has been spent in its
+// timed part and reports ns and heap allocations per operation. The
+// numbers are host numbers, they rank the paths and show what a change
+// does to them, the device's are several times slower
+//
+//   benchmarks [filter]
+
+#include "protocol_probe.h"
+
+#include <chrono>
+#include <cstring>
+#include <new>
+
+using namespace host_board;
+
+static uint64_t heap_allocations = 0;
+
+void* operator new(size_t size)
+{
+    heap_allocations++;
+    if (void* p = std::malloc(size != 0 ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+void* operator new[](size_t size) { return operator new(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    heap_allocations++;
+    return std::malloc(size != 0 ? size : 1);
+}
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept { return operator new(size, tag); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+
+static const uint64_t MIN_TIME = 200000000; // ns per benchmark
+
+// The timed part of a benchmark, the setup around it is not counted
+class Timer {
+public:
+    void start()
+    {
+        this->allocations_at_ = heap_allocations;
+        this->at_ = std::chrono::steady_clock::now();
+    }
+    void stop(uint64_t ops)
+    {
+        this->ns_ += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - this->at_).count();
+        this->allocations_ += heap_allocations - this->allocations_at_;
+        this->ops_ += ops;
+    }
+
+    uint64_t ns() const { return this->ns_; }
+    uint64_t ops() const { return this->ops_; }
+    uint64_t allocations() const { return this->allocations_; }
+
+protected:
+    std::chrono::steady_clock::time_point at_;
+    uint64_t allocations_at_ { 0 };
+    uint64_t ns_ { 0 };
+    uint64_t allocations_ { 0 };
+    uint64_t ops_ { 0 };
+};
+
+static const char* filter = nullptr;
+
+template <typename Body>
+static void bench(const char* name, Body body)
+{
+    if (filter != nullptr && std::strstr(name, filter) == nullptr) {
+        return;
+    }
+    Timer timer;
+    while (timer.ns() < MIN_TIME) {
+        body(timer);
+    }
+    std::printf("%-40s %10.1f %12.2f %12llu\n", name, double(timer.ns()) / timer.ops(),
+        double(timer.allocations()) / timer.ops(), (unsigned long long)timer.ops());
+}
+
+// bytes that have arrived by now, moved into the receive buffer: the
+// shim's deque allocates there while the device's ring doesn't
+static void arrived(SoftwareSerial* serial, const uint8_t* data, size_t len)
+{
+    deliver(serial, data, len);
+    serial->available();
+}
+
+static void bench_secplus2(Board& board)
+{
+    host::HostGPIOPin rx(PROBE_RX);
+    host::HostGPIOPin tx(PROBE_TX);
+    Secplus2Probe protocol;
+    protocol.setup(&board.ratgdo, &App.scheduler, &rx, &tx);
+    auto* serial = SoftwareSerial::on_pin(PROBE_RX);
+
+    // a status frame from the GDO, encoded under another client id than
+    // the one the frames are then decoded with
+    secplus2::Command status { secplus2::CommandType::STATUS, static_cast<uint8_t>(DoorState::CLOSED), 0x40, 0x00 };
+    secplus2::WirePacket frame;
+    protocol.encode_packet(status, frame);
+    protocol.set_client_id(0x2c5a1d);
+
+    bench("secplus2.encode_packet", [&](Timer& timer) {
+        secplus2::WirePacket packet;
+        timer.start();
+        for (int i = 0; i < 1000; i++) {
+            protocol.encode_packet(status, packet);
+        }
+        timer.stop(1000);
+    });
+    bench("secplus2.decode_packet", [&](Timer& timer) {
+        uint32_t decoded = 0;
+        timer.start();
+        for (int i = 0; i < 1000; i++) {
+            decoded += protocol.decode_packet(frame).has_value();
+        }
+        timer.stop(1000);
+        EXPECT(decoded == 1000);
+    });
+    // three frames fill the 64 byte receive buffer
+    bench("secplus2.read_command (frame)", [&](Timer& timer) {
+        for (int i = 0; i < 3; i++) {
+            arrived(serial, frame, sizeof(frame));
+        }
+        uint32_t frames = 0;
+        timer.start();
+        while (serial->available()) {
+            frames += protocol.read_command().has_value();
+        }
+        timer.stop(3);
+        EXPECT(frames == 3);
+    });
+    bench("secplus2.handle_command (STATUS)", [&](Timer& timer) {
+        auto cmd = *protocol.decode_packet(frame);
+        timer.start();
+        for (int i = 0; i < 1000; i++) {
+            protocol.handle_command(cmd);
+        }
+        timer.stop(1000);
+    });
+}
+
+static void bench_secplus1(Board& board)
+{
+    host::HostGPIOPin rx(PROBE_RX);
+    host::HostGPIOPin tx(PROBE_TX);
+    Secplus1Probe protocol;
+    protocol.setup(&board.ratgdo, &App.scheduler, &rx, &tx);
+    auto* serial = SoftwareSerial::on_pin(PROBE_RX);
+
+    // a status query and the GDO's answer, door closed
+    const uint8_t status[] = { 0x38, 0x05 };
+    bench("secplus1.read_command (query+answer)", [&](Timer& timer) {
+        for (int i = 0; i < 32; i++) {
+            arrived(serial, status, sizeof(status));
+        }
+        uint32_t frames = 0;
+        timer.start();
+        while (serial->available()) {
+            frames += protocol.read_command().has_value();
+        }
+        timer.stop(32);
+        EXPECT(frames == 32);
+    });
+    bench("secplus1.handle_command (0x38)", [&](Timer& timer) {
+        secplus1::RxPacket packet = { status[0], status[1] };
+        auto cmd = *protocol.decode_packet(packet, true);
+        timer.start();
+        for (int i = 0; i < 1000; i++) {
+            protocol.handle_command(cmd);
+        }
+        timer.stop(1000);
+    });
+}
+
+static void bench_state(Board& board)
+{
+    // every call a change, OPEN and CLOSED alternate
+    bench("received(DoorState)", [&](Timer& timer) {
+        timer.start();
+        for (int i = 0; i < 1000; i++) {
+            board.ratgdo.received(i % 2 == 0 ? DoorState::OPEN : DoorState::CLOSED);
+        }
+        timer.stop(1000);
+    });
+    // the change published to the board's subscribers by the next loop
+    bench("received(DoorState) + loop", [&](Timer& timer) {
+        timer.start();
+        for (int i = 0; i < 1000; i++) {
+            board.ratgdo.received(i % 2 == 0 ? DoorState::OPEN : DoorState::CLOSED);
+            board.ratgdo.loop();
+        }
+        timer.stop(1000);
+    });
+    bench("loop (nothing changed)", [&](Timer& timer) {
+        timer.start();
+        for (int i = 0; i < 1000; i++) {
+            board.ratgdo.loop();
+        }
+        timer.stop(1000);
+    });
+
+    observable<uint16_t> value { 0 };
+    uint32_t sum = 0;
+    for (size_t i = 0; i < RATGDO_MAX_OBSERVERS; i++) {
+        value.subscribe([&sum](uint16_t value) { sum += value; });
+    }
+    bench("observable set + flush (all observers)", [&](Timer& timer) {
+        timer.start();
+        for (uint16_t i = 0; i < 1000; i++) {
+            value = i;
+            value.flush();
+        }
+        timer.stop(1000);
+        EXPECT(sum > 0);
+    });
+}
+
+int main(int argc, char** argv)
+{
+    filter = argc > 1 ? argv[1] : nullptr;
+    host::Bus bus;
+    Board board(bus);
+    board.run(100);
+
+    std::printf("%-40s %10s %12s %12s\n", "Benchmark", "ns/op", "allocs/op", "ops");
+    bench_secplus2(board);
+    bench_secplus1(board);
+    bench_state(board);
+    return report();
+}
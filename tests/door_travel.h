@@ -0,0 +1,161 @@
+#pragma once
+// The door of a simulated opener, shared by the Sec+2 and Sec+1 ones
+
+#include <algorithm>
+#include <cstdint>
+
+namespace host_board {
+
+// The door and its motor. The door starts moving start_delay after a
+// command, moves at the speed of its travel time and coasts for
+// stop_latency after a stop. Positions run from 0 closed to 1 open
+class DoorTravel {
+public:
+    enum class State {
+        CLOSED,
+        OPENING,
+        OPEN,
+        CLOSING,
+        STOPPED,
+    };
+
+    uint64_t opening_time { 12000000 }; // us
+    uint64_t closing_time { 11000000 }; // us
+    uint64_t stop_latency { 0 }; // us
+    uint64_t start_delay { 0 }; // us from a command to the door moving
+
+    State state { State::CLOSED };
+    float position { 0 };
+    uint32_t cycles { 0 }; // openings from closed
+
+    bool moving() const { return this->state == State::OPENING || this->state == State::CLOSING; }
+
+    // returns whether the command started or stopped something
+    bool open(uint64_t now)
+    {
+        this->advance(now);
+        if (this->state == State::OPEN || this->state == State::OPENING) {
+            return false;
+        }
+        if (this->state == State::CLOSED) {
+            this->cycles++;
+        }
+        this->start(State::OPENING, now);
+        return true;
+    }
+
+    bool close(uint64_t now)
+    {
+        this->advance(now);
+        // a close while opening is ignored, the door has to stop first
+        if (this->state == State::CLOSED || this->state == State::CLOSING || this->state == State::OPENING) {
+            return false;
+        }
+        this->start(State::CLOSING, now);
+        return true;
+    }
+
+    bool stop(uint64_t now)
+    {
+        this->advance(now);
+        if (!this->moving() || this->stop_at_ != UINT64_MAX) {
+            return false;
+        }
+        this->stop_at_ = now + this->stop_latency;
+        return true;
+    }
+
+    // a wall button: opening stops, closing reverses, stopped goes the
+    // other way than before
+    bool toggle(uint64_t now)
+    {
+        this->advance(now);
+        switch (this->state) {
+        case State::CLOSED:
+            return this->open(now);
+        case State::OPEN:
+            return this->close(now);
+        case State::OPENING:
+            return this->stop(now);
+        case State::CLOSING:
+            this->start(State::OPENING, now);
+            return true;
+        case State::STOPPED:
+            return this->last_ == State::OPENING ? this->close(now) : this->open(now);
+        }
+        return false;
+    }
+
+    // Moves the door on to now, true when it reached an end or stopped
+    bool advance(uint64_t now)
+    {
+        if (!this->moving() || now < this->moved_at_) {
+            return false;
+        }
+        auto until = std::min(now, this->stop_at_);
+        auto arrival = this->arrival();
+        if (arrival <= until) {
+            this->position = this->state == State::OPENING ? 1 : 0;
+            this->state = this->state == State::OPENING ? State::OPEN : State::CLOSED;
+            this->stop_at_ = UINT64_MAX;
+            return true;
+        }
+        this->position = this->position_at(until);
+        this->moved_at_ = until;
+        if (until == this->stop_at_) {
+            this->state = State::STOPPED;
+            this->stop_at_ = UINT64_MAX;
+            return true;
+        }
+        return false;
+    }
+
+    // when the door next reaches an end or stops, us
+    uint64_t next_event() const
+    {
+        if (!this->moving()) {
+            return UINT64_MAX;
+        }
+        return std::min(this->arrival(), this->stop_at_);
+    }
+
+    float position_at(uint64_t now) const
+    {
+        if (!this->moving() || now <= this->moved_at_) {
+            return this->position;
+        }
+        auto until = std::min(now, this->stop_at_);
+        float moved = float(until - this->moved_at_) / (this->state == State::OPENING ? this->opening_time : this->closing_time);
+        return std::clamp(this->position + (this->state == State::OPENING ? moved : -moved), 0.0f, 1.0f);
+    }
+
+protected:
+    void start(State direction, uint64_t now)
+    {
+        this->state = direction;
+        this->last_ = direction;
+        this->moved_at_ = now + this->start_delay;
+        this->stop_at_ = UINT64_MAX;
+    }
+
+    uint64_t arrival() const
+    {
+        auto travel = this->state == State::OPENING ? this->opening_time : this->closing_time;
+        auto remaining = this->state == State::OPENING ? 1 - this->position : this->position;
+        return this->moved_at_ + uint64_t(remaining * travel);
+    }
+
+    State last_ { State::CLOSING };
+    uint64_t moved_at_ { 0 };
+    uint64_t stop_at_ { UINT64_MAX };
+};
+
+// What an opener counts of the commands it got
+struct GdoStats {
+    uint32_t commands { 0 }; // accepted
+    uint32_t rejected { 0 }; // rolling code not ahead of the last one
+    uint32_t queries { 0 }; // answered
+    uint64_t last_command { 0 }; // us, when the last accepted command arrived
+};
+
+} // namespace host_board
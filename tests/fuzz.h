@@ -0,0 +1,179 @@
+#pragma once
+// Fuzz targets for the protocols' receive paths on the host shim. Built
+// with clang and RATGDO_LIBFUZZER, libFuzzer drives LLVMFuzzerTestOneInput.
+// Otherwise main() below does: it replays the files given, or runs inputs
+// of its own, random bytes and the target's seed frames mutated, from a
+// fixed seed so a failure reproduces. Memory errors are the sanitizers'
+// to catch, FUZZ_ASSERT checks the framers' own invariants
+//
+//   fuzz_secplus2 [-runs=N] [input files]
+
+#include "protocol_probe.h"
+
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <vector>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+#define FUZZ_ASSERT(cond)                                                     \
+    do {                                                                      \
+        if (!(cond)) {                                                        \
+            std::fprintf(stderr, "%s:%d: failed %s\n", __FILE__, __LINE__, #cond); \
+            std::abort();                                                     \
+        }                                                                     \
+    } while (0)
+
+namespace host_board {
+
+// What a target seeds the standalone driver with: frames as they arrive
+// from the GDO and the gap that puts their bytes back to back
+struct FuzzSeeds {
+    std::vector<std::vector<uint8_t>> frames;
+    uint8_t byte_gap;
+};
+FuzzSeeds fuzz_seeds();
+
+// the slowest call of a framer with the handling of what it returned, ns
+inline uint64_t& fuzz_max_call()
+{
+    static uint64_t max = 0;
+    return max;
+}
+
+// in the thread's CPU time, the wall clock's maximum is the host
+// descheduling the process
+inline uint64_t fuzz_cpu_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+template <typename F>
+void fuzz_timed(F f)
+{
+    auto start = fuzz_cpu_ns();
+    f();
+    fuzz_max_call() = std::max(fuzz_max_call(), fuzz_cpu_ns() - start);
+}
+
+// The board the probes report to, set up with the first input and kept.
+// The clock starts a minute before millis() wraps
+inline Board& fuzz_board()
+{
+    static Board* board = nullptr;
+    if (board == nullptr) {
+        host::set_clock_us((uint64_t(UINT32_MAX) - 60000) * 1000);
+        board = new Board(*new host::Bus());
+    }
+    return *board;
+}
+
+// The input as steps of two bytes: the time since the previous byte, then
+// the byte. Gaps below 0xf0 are in 100us up to 24ms, the rest are 50ms to
+// 800ms, past a partial frame's timeout. An odd gap flips the byte's
+// parity. After each byte the framer runs once, then the due timers
+template <typename Read, typename Check>
+void fuzz_steps(const uint8_t* data, size_t size, SoftwareSerial* serial, Read read, Check check)
+{
+    for (size_t i = 0; i + 1 < size; i += 2) {
+        uint8_t gap = data[i];
+        host::advance_us(gap < 0xf0 ? gap * 100 : (gap - 0xef) * 50000);
+        auto now = host::now_us();
+        bool parity = SoftwareSerial::parityEven(data[i + 1]) != bool(gap & 1);
+        serial->deliver({ data[i + 1], parity, now - serial->byte_time(), now });
+        fuzz_timed(read);
+        check();
+        App.scheduler.call();
+    }
+}
+
+#ifndef RATGDO_LIBFUZZER
+// a seed frame or random bytes, mutated a few times
+inline std::vector<uint8_t> fuzz_input(std::mt19937& rng, const FuzzSeeds& seeds)
+{
+    std::vector<uint8_t> input;
+    if (rng() % 4 == 0) {
+        input.resize(rng() % 512);
+        for (auto& byte : input) {
+            byte = rng();
+        }
+        return input;
+    }
+    // a few frames back to back, as steps
+    for (uint32_t frames = 1 + rng() % 6; frames > 0; frames--) {
+        const auto& frame = seeds.frames[rng() % seeds.frames.size()];
+        uint8_t gap = rng() % 8 == 0 ? rng() : seeds.byte_gap;
+        for (auto byte : frame) {
+            input.push_back(gap);
+            input.push_back(byte);
+            gap = seeds.byte_gap;
+        }
+    }
+    for (uint32_t mutations = rng() % 8; mutations > 0 && !input.empty(); mutations--) {
+        size_t at = rng() % input.size();
+        switch (rng() % 5) {
+        case 0:
+            input[at] ^= 1 << (rng() % 8);
+            break;
+        case 1:
+            input[at] = rng();
+            break;
+        case 2:
+            input.erase(input.begin() + at, input.begin() + std::min(input.size(), at + 1 + rng() % 16));
+            break;
+        case 3: {
+            std::vector<uint8_t> copy(input.begin() + at, input.begin() + std::min(input.size(), at + 1 + rng() % 32));
+            input.insert(input.begin() + rng() % input.size(), copy.begin(), copy.end());
+            break;
+        }
+        default:
+            input.insert(input.begin() + at, uint8_t(rng()));
+            break;
+        }
+    }
+    return input;
+}
+
+} // namespace host_board
+
+int main(int argc, char** argv)
+{
+    uint32_t runs = 20000;
+    std::vector<const char*> files;
+    for (int i = 1; i < argc; i++) {
+        if (std::strncmp(argv[i], "-runs=", 6) == 0) {
+            runs = std::strtoul(argv[i] + 6, nullptr, 10);
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+
+    uint64_t bytes = 0;
+    if (!files.empty()) {
+        for (auto* file : files) {
+            std::ifstream in(file, std::ios::binary);
+            std::vector<uint8_t> input((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            LLVMFuzzerTestOneInput(input.data(), input.size());
+            bytes += input.size();
+        }
+        runs = files.size();
+    } else {
+        auto seeds = host_board::fuzz_seeds();
+        std::mt19937 rng(1);
+        for (uint32_t run = 0; run < runs; run++) {
+            auto input = host_board::fuzz_input(rng, seeds);
+            LLVMFuzzerTestOneInput(input.data(), input.size());
+            bytes += input.size();
+        }
+    }
+    std::printf("%u inputs, %llu bytes, slowest framer call %.1fus\n", runs, (unsigned long long)bytes, host_board::fuzz_max_call() / 1000.0);
+    return EXIT_SUCCESS;
+}
+#else
+} // namespace host_board
+#endif
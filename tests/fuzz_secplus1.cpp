@@ -0,0 +1,63 @@
+// Fuzz target of the Sec+1 receive path, see fuzz.h: the input's first
+// two bytes go to decode_packet, clean or not by the third, and as a
+// query and answer of any value to handle_command, then all of it
+// through read_command
+
+#include "fuzz.h"
+
+using namespace host_board;
+
+FuzzSeeds host_board::fuzz_seeds()
+{
+    // queries from a panel and the GDO's answers, the buttons alone
+    return { {
+                 { 0x38, 0x05 },
+                 { 0x38, 0x01 },
+                 { 0x38, 0x02 },
+                 { 0x38, 0x06 },
+                 { 0x3A, 0x51 },
+                 { 0x3A, 0x50 },
+                 { 0x39, 0x00 },
+                 { 0x37, 0x05 },
+                 { 0x30 },
+                 { 0x31 },
+                 { 0x32, 0x33 },
+                 { 0x34, 0x35 },
+             },
+        92 }; // 9.2ms, a byte at 1200 baud
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    auto& board = fuzz_board();
+    host::HostGPIOPin rx(PROBE_RX);
+    host::HostGPIOPin tx(PROBE_TX);
+    Secplus1Probe protocol;
+    protocol.setup(&board.ratgdo, &App.scheduler, &rx, &tx);
+    auto* serial = SoftwareSerial::on_pin(PROBE_RX);
+
+    if (size >= secplus1::RX_LENGTH) {
+        secplus1::RxPacket packet = { data[0], data[1] };
+        bool clean = size < 3 || (data[2] & 1);
+        fuzz_timed([&] {
+            if (auto cmd = protocol.decode_packet(packet, clean)) {
+                protocol.handle_command(*cmd);
+            }
+        });
+        secplus1::RxCommand cmd { static_cast<secplus1::CommandType>(data[0]), data[1] };
+        cmd.clean = clean;
+        fuzz_timed([&] { protocol.handle_command(cmd); });
+    }
+    fuzz_steps(
+        data, size, serial,
+        [&] {
+            if (auto cmd = protocol.read_command()) {
+                protocol.handle_command(*cmd);
+            }
+        },
+        [&] { FUZZ_ASSERT(protocol.rx_byte_count() < secplus1::RX_LENGTH); });
+
+    // the probe's timers go with it
+    App.scheduler.clear();
+    return 0;
+}
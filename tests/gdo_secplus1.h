@@ -0,0 +1,124 @@
+#pragma once
+// A Sec+1 opener and wall panels on the host, the opener's door travels
+// with its timing and its state is what it answers the queries with
+
+#include "door_travel.h"
+#include "host_board.h"
+#include "secplus1_wire.h"
+
+namespace host_board {
+
+// A Sec+1 opener. It answers the status queries of whoever is on the line
+// and acts on the presses of the door, light and lock buttons
+class Secplus1Gdo : public Secplus1Wire {
+public:
+    explicit Secplus1Gdo(esphome::host::Bus& bus)
+        : Secplus1Wire(bus)
+    {
+    }
+
+    DoorTravel travel;
+    bool light { false };
+    bool locked { false };
+    bool obstructed { false };
+    GdoStats stats;
+
+    uint64_t next_poll() const override { return std::min(this->next_arrival(), this->travel.next_event()); }
+
+    void poll() override
+    {
+        auto now = esphome::host::now_us();
+        this->travel.advance(now);
+        this->door = this->door_code();
+        this->other = (this->light ? SECPLUS1_LIGHT_ON : 0) | (this->locked ? 0 : SECPLUS1_UNLOCKED);
+        this->obstruction = this->obstructed ? 1 : 0;
+        for (auto byte : this->answer()) {
+            this->others.push_back(byte);
+            this->button(byte, now);
+        }
+        this->stats.queries = this->queries;
+    }
+
+protected:
+    uint8_t door_code() const
+    {
+        switch (this->travel.state) {
+        case DoorTravel::State::OPEN:
+            return SECPLUS1_DOOR_OPEN;
+        case DoorTravel::State::CLOSED:
+            return SECPLUS1_DOOR_CLOSED;
+        case DoorTravel::State::OPENING:
+            return SECPLUS1_DOOR_OPENING;
+        case DoorTravel::State::CLOSING:
+            return SECPLUS1_DOOR_CLOSING;
+        case DoorTravel::State::STOPPED:
+            return SECPLUS1_DOOR_STOPPED;
+        }
+        return 0;
+    }
+
+    void button(uint8_t byte, uint64_t now)
+    {
+        if (byte == static_cast<uint8_t>(CommandType::TOGGLE_DOOR_PRESS)) {
+            this->travel.toggle(now);
+            if (this->travel.moving()) {
+                this->light = true;
+            }
+        } else if (byte == static_cast<uint8_t>(CommandType::TOGGLE_LIGHT_PRESS)) {
+            this->light = !this->light;
+        } else if (byte == static_cast<uint8_t>(CommandType::TOGGLE_LOCK_PRESS)) {
+            this->locked = !this->locked;
+        } else {
+            return;
+        }
+        this->stats.commands++;
+        this->stats.last_command = now;
+    }
+};
+
+// A Sec+1 wall panel polling the opener. A standard panel queries the
+// door, the light and lock, and the obstruction, a 0x37 panel sends 0x37
+// where the standard one queries the door
+
+class Secplus1Panel : public esphome::host::SerialEndpoint {
+public:
+    Secplus1Panel(esphome::host::Bus& bus, bool panel_0x37 = false)
+        : bus_(bus)
+        , panel_0x37_(panel_0x37)
+    {
+        this->configure(1200, true);
+        this->echo = false;
+        bus.attach(this);
+        this->next_ = esphome::host::now_us();
+    }
+
+    uint64_t interval { 250000 }; // us between queries
+
+    uint64_t next_poll() const override { return this->next_; }
+    void poll() override
+    {
+        auto now = esphome::host::now_us();
+        esphome::host::WireByte byte;
+        while (this->receive(byte)) {
+        }
+        if (this->bus_.busy(now)) {
+            this->next_ = now + 1000;
+            return;
+        }
+        static const uint8_t standard[] = { 0x38, 0x3A, 0x39, 0x3A };
+        static const uint8_t panel_0x37[] = { 0x37, 0x3A, 0x39, 0x3A };
+        const uint8_t* cycle = this->panel_0x37_ ? panel_0x37 : standard;
+        uint8_t query = cycle[this->index_ % 4];
+        this->index_++;
+        this->bus_.send(this, &query, 1, now);
+        this->next_ = now + this->interval;
+    }
+
+protected:
+    esphome::host::Bus& bus_;
+    bool panel_0x37_;
+    uint64_t next_ { 0 };
+    uint32_t index_ { 0 };
+};
+
+} // namespace host_board
@@ -0,0 +1,225 @@
+#pragma once
+// A Sec+2 opener on the host: the door travels with its timing, commands
+// are checked for their rolling codes, queries are answered and what
+// happens is reported like an opener does, so the component is exercised
+// end to end and its latency, sync time and position estimate measured
+
+#include "door_travel.h"
+#include "host_board.h"
+#include "secplus2_wire.h"
+
+#include <deque>
+#include <map>
+#include <set>
+
+namespace host_board {
+
+const uint32_t GDO_ROLLING_CODE_MASK = 0xfffffff; // rolling codes are 28 bits and wrap
+
+// A Sec+2 opener. A command is accepted when its rolling code is ahead of
+// the last one of its client ID, the release of a button may repeat the
+// code of its press. Frames to send wait for the line to be idle
+class Secplus2Gdo : public Secplus2Wire {
+public:
+    explicit Secplus2Gdo(esphome::host::Bus& bus)
+        : Secplus2Wire(bus)
+    {
+    }
+
+    DoorTravel travel;
+    bool light { false };
+    bool locked { false };
+    bool obstructed { false };
+    uint16_t openings { 0 };
+    uint8_t paired[5] { 3, 2, 0, 1, 0 }; // total, remotes, keypads, wall controls, accessories
+    uint32_t answer_delay { 10000 }; // us from the end of a query to its answer
+    // frames of these types the opener sends are lost on the way
+    std::set<CommandType> drop;
+    GdoStats stats;
+
+    // sensed by the opener itself
+    void motion() { this->queue(CommandType::MOTION); }
+    void obstruction(bool obstructed)
+    {
+        this->obstructed = obstructed;
+        this->queue_status();
+    }
+
+    uint64_t next_poll() const override
+    {
+        auto next = std::min(this->next_arrival(), this->travel.next_event());
+        if (!this->outbox_.empty()) {
+            next = std::min(next, std::max(this->outbox_.front().at, this->line_free_));
+        }
+        return next;
+    }
+
+    void poll() override
+    {
+        auto now = esphome::host::now_us();
+        for (const auto& frame : this->frames()) {
+            this->handle(frame);
+        }
+        if (this->travel.advance(now)) {
+            this->queue_status();
+        }
+        this->flush(now);
+    }
+
+protected:
+    struct Outgoing {
+        uint64_t at;
+        CommandType type;
+        uint8_t nibble;
+        uint8_t byte1;
+        uint8_t byte2;
+    };
+
+    uint8_t door_nibble() const
+    {
+        switch (this->travel.state) {
+        case DoorTravel::State::OPEN:
+            return static_cast<uint8_t>(DoorState::OPEN);
+        case DoorTravel::State::CLOSED:
+            return static_cast<uint8_t>(DoorState::CLOSED);
+        case DoorTravel::State::OPENING:
+            return static_cast<uint8_t>(DoorState::OPENING);
+        case DoorTravel::State::CLOSING:
+            return static_cast<uint8_t>(DoorState::CLOSING);
+        case DoorTravel::State::STOPPED:
+            return static_cast<uint8_t>(DoorState::STOPPED);
+        }
+        return 0;
+    }
+
+    void queue(CommandType type, uint8_t nibble = 0, uint8_t byte1 = 0, uint8_t byte2 = 0, uint64_t at = 0)
+    {
+        this->outbox_.push_back({ std::max(at, esphome::host::now_us()), type, nibble, byte1, byte2 });
+    }
+
+    void queue_status(uint64_t at = 0)
+    {
+        uint8_t byte1 = this->obstructed ? 0 : 1 << 6;
+        uint8_t byte2 = (this->light ? 1 << 1 : 0) | (this->locked ? 1 : 0);
+        this->queue(CommandType::STATUS, this->door_nibble(), byte1, byte2, at);
+    }
+
+    bool accept(const Frame& frame)
+    {
+        auto id = frame.id();
+        auto last = this->rolling_codes_.find(id);
+        bool release = frame.type() == CommandType::DOOR_ACTION && frame.byte1() == 0;
+        if (last != this->rolling_codes_.end()) {
+            // ahead modulo 2^28, a code in the half behind the last one is old
+            uint32_t ahead = (frame.rolling - last->second) & GDO_ROLLING_CODE_MASK;
+            if (ahead > GDO_ROLLING_CODE_MASK / 2 || (ahead == 0 && !release)) {
+                this->stats.rejected++;
+                return false;
+            }
+        }
+        this->rolling_codes_[id] = frame.rolling;
+        return true;
+    }
+
+    void handle(const Frame& frame)
+    {
+        if (!this->accept(frame)) {
+            return;
+        }
+        auto now = esphome::host::now_us();
+        auto answer_at = frame.end + this->answer_delay;
+        switch (frame.type()) {
+        case CommandType::GET_STATUS:
+            this->stats.queries++;
+            this->queue_status(answer_at);
+            break;
+        case CommandType::GET_OPENINGS:
+            this->stats.queries++;
+            this->queue(CommandType::OPENINGS, 0, this->openings >> 8, this->openings & 0xff, answer_at);
+            break;
+        case CommandType::GET_PAIRED_DEVICES:
+            this->stats.queries++;
+            if (frame.nibble() < 5) {
+                this->queue(CommandType::PAIRED_DEVICES, frame.nibble(), 0, this->paired[frame.nibble()], answer_at);
+            }
+            break;
+        case CommandType::DOOR_ACTION:
+            // acts on the press
+            if (frame.byte1() == 1) {
+                this->stats.commands++;
+                this->stats.last_command = now;
+                this->door_action(static_cast<DoorAction>(frame.nibble()), now);
+            }
+            break;
+        case CommandType::LIGHT:
+            this->stats.commands++;
+            this->stats.last_command = now;
+            this->set_light(frame.nibble() == static_cast<uint8_t>(LightAction::TOGGLE) ? !this->light : frame.nibble() == static_cast<uint8_t>(LightAction::ON));
+            break;
+        case CommandType::LOCK:
+            this->stats.commands++;
+            this->stats.last_command = now;
+            this->locked = frame.nibble() == static_cast<uint8_t>(LockAction::TOGGLE) ? !this->locked : frame.nibble() == static_cast<uint8_t>(LockAction::LOCK);
+            this->queue_status();
+            break;
+        default:
+            break;
+        }
+    }
+
+    void door_action(DoorAction action, uint64_t now)
+    {
+        bool was_closed = this->travel.state == DoorTravel::State::CLOSED;
+        bool moved = false;
+        if (action == DoorAction::OPEN) {
+            moved = this->travel.open(now);
+        } else if (action == DoorAction::CLOSE) {
+            moved = this->travel.close(now);
+        } else if (action == DoorAction::STOP) {
+            // reported once the door has coasted to a stop
+            this->travel.stop(now);
+            return;
+        } else if (action == DoorAction::TOGGLE) {
+            moved = this->travel.toggle(now);
+        }
+        if (!moved || !this->travel.moving()) {
+            return;
+        }
+        if (was_closed) {
+            this->openings++;
+        }
+        this->queue(CommandType::MOTOR_ON);
+        this->set_light(true);
+    }
+
+    void set_light(bool on)
+    {
+        if (on != this->light) {
+            this->light = on;
+            this->queue(CommandType::LIGHT, on ? 1 : 0);
+        }
+        this->queue_status();
+    }
+
+    void flush(uint64_t now)
+    {
+        while (!this->outbox_.empty() && this->outbox_.front().at <= now && this->line_free_ <= now) {
+            if (this->bus_.busy(now)) {
+                this->line_free_ = now + 1000;
+                return;
+            }
+            auto out = this->outbox_.front();
+            this->outbox_.pop_front();
+            if (this->drop.count(out.type) != 0) {
+                continue;
+            }
+            this->line_free_ = this->send_at(now, out.type, out.nibble, out.byte1, out.byte2);
+        }
+    }
+
+    std::map<uint32_t, uint32_t> rolling_codes_; // last accepted per client ID
+    std::deque<Outgoing> outbox_;
+    uint64_t line_free_ { 0 };
+};
+
+} // namespace host_board
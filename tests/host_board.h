@@ -0,0 +1,154 @@
+#pragma once
+// A ratgdo board on the host: the real component with its protocol, its
+// pins and its software serial attached to a host::Bus, driven by App.loop()
+// on the virtual clock
+
+#include "ratgdo.h"
+
+#include "SoftwareSerial.h"
+#include "esphome/core/application.h"
+#include "host.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+static int failures = 0;
+
+#define EXPECT(cond)                                                         \
+    do {                                                                     \
+        if (!(cond)) {                                                       \
+            std::printf("%s:%d: expected %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                      \
+        }                                                                    \
+    } while (0)
+
+namespace host_board {
+
+using namespace esphome;
+using namespace esphome::ratgdo;
+
+const uint8_t OUTPUT_GDO = 1;
+const uint8_t INPUT_GDO = 2;
+const uint8_t INPUT_OBST = 3;
+
+// Everything the opener publishes, as the children would see it
+struct Published {
+    DoorState door { DoorState::UNKNOWN };
+    float position { DOOR_POSITION_UNKNOWN };
+    LightState light { LightState::UNKNOWN };
+    LockState lock { LockState::UNKNOWN };
+    ObstructionState obstruction { ObstructionState::UNKNOWN };
+    MotorState motor { MotorState::UNKNOWN };
+    MotionState motion { MotionState::UNKNOWN };
+    uint16_t openings { 0 };
+    uint16_t paired_total { PAIRED_DEVICES_UNKNOWN };
+    bool sync_failed { false };
+    uint64_t sync_failed_at { 0 }; // us
+    uint32_t door_updates { 0 };
+    uint32_t button_presses { 0 };
+    uint32_t button_releases { 0 };
+};
+
+class Board {
+public:
+    // a fresh board starts with empty preferences, otherwise it boots
+    // from what the previous board left in flash. A second board on the
+    // same host, for a second door, takes its pins from pin_base on
+    explicit Board(host::Bus& bus, bool fresh = true, uint8_t pin_base = 0)
+        : bus_(bus)
+        , output_(OUTPUT_GDO + pin_base)
+        , input_(INPUT_GDO + pin_base)
+        , obst_(INPUT_OBST + pin_base)
+    {
+        if (fresh) {
+            host::preferences().reset();
+        }
+        this->ratgdo.set_output_gdo_pin(&this->output_);
+        this->ratgdo.set_input_gdo_pin(&this->input_);
+        this->ratgdo.set_input_obst_pin(&this->obst_);
+        this->ratgdo.set_preference_key(fnv1_hash("ratgdo") + pin_base);
+        this->ratgdo.init_protocol();
+        this->subscribe();
+        App.register_component(&this->ratgdo);
+        App.setup();
+        this->serial = SoftwareSerial::on_pin(INPUT_GDO + pin_base);
+        bus.attach(this->serial, &this->input_, &this->output_);
+    }
+
+    ~Board() { host::reboot(); }
+
+    // runs for ms like the device does, see host::run_until()
+    uint32_t run(uint32_t ms) { return host::run_until(host::now_us() + uint64_t(ms) * 1000, &this->bus_); }
+    // runs until cond holds or ms have passed, returns how long it took in ms
+    template <typename Cond>
+    uint32_t run_until(Cond cond, uint32_t ms)
+    {
+        auto start = host::now_us();
+        while (!cond() && host::now_us() - start < uint64_t(ms) * 1000) {
+            host::run_until(host::now_us() + 1000, &this->bus_);
+        }
+        return (host::now_us() - start) / 1000;
+    }
+
+    RATGDOComponent ratgdo;
+    SoftwareSerial* serial;
+    Published published;
+
+protected:
+    void subscribe()
+    {
+        auto& p = this->published;
+        this->ratgdo.subscribe_door_state([&p](DoorState state, float position) {
+            p.door = state;
+            p.position = position;
+            p.door_updates++;
+        });
+        this->ratgdo.subscribe_light_state([&p](LightState state) { p.light = state; });
+        this->ratgdo.subscribe_lock_state([&p](LockState state) { p.lock = state; });
+        this->ratgdo.subscribe_obstruction_state([&p](ObstructionState state) { p.obstruction = state; });
+        this->ratgdo.subscribe_motor_state([&p](MotorState state) { p.motor = state; });
+        this->ratgdo.subscribe_motion_state([&p](MotionState state) { p.motion = state; });
+        this->ratgdo.subscribe_openings([&p](uint16_t openings) { p.openings = openings; });
+        this->ratgdo.subscribe_paired_devices_total([&p](uint16_t total) { p.paired_total = total; });
+        this->ratgdo.subscribe_sync_failed([&p](bool failed) {
+            p.sync_failed = failed;
+            p.sync_failed_at = failed ? host::now_us() : 0;
+        });
+        this->ratgdo.subscribe_button_state([&p](ButtonState state) {
+            if (state == ButtonState::PRESSED) {
+                p.button_presses++;
+            } else if (state == ButtonState::RELEASED) {
+                p.button_releases++;
+            }
+        });
+    }
+
+    host::Bus& bus_;
+    host::HostGPIOPin output_;
+    host::HostGPIOPin input_;
+    host::HostGPIOPin obst_;
+};
+
+// runs the main loop once per ms until ms have passed, a loop that blocks
+// (a serial write) moves the clock on by itself. Board::run() loops at the
+// device's pace instead
+inline void run_for(uint32_t ms)
+{
+    uint64_t end = host::now_us() + uint64_t(ms) * 1000;
+    while (host::now_us() < end) {
+        App.loop();
+        host::advance_ms(1);
+    }
+}
+
+inline int report()
+{
+    if (failures > 0) {
+        std::printf("%d failures\n", failures);
+        return EXIT_FAILURE;
+    }
+    std::printf("all tests passed\n");
+    return EXIT_SUCCESS;
+}
+
+} // namespace host_board
@@ -0,0 +1,215 @@
+// Host tests for the parts of the ratgdo component that don't touch the
+// hardware, built with the others by tests/CMakeLists.txt
+
+#include "callbacks.h"
+#include "rolling_code.h"
+#include "secplus1_score.h"
+#include "tx_wheel.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+using namespace esphome::ratgdo;
+
+static int failures = 0;
+
+#define EXPECT(cond)                                                         \
+    do {                                                                     \
+        if (!(cond)) {                                                       \
+            std::printf("%s:%d: expected %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                      \
+        }                                                                    \
+    } while (0)
+
+enum class Request : uint8_t {
+    QUERY,
+    PRESS,
+    RELEASE,
+    LATER,
+};
+
+// pops the next due request, the test fails when none is due
+static Request pop(TxWheel<Request>& wheel, uint32_t now)
+{
+    auto index = wheel.due(now);
+    EXPECT(index >= 0);
+    if (index < 0) {
+        return Request::LATER;
+    }
+    auto request = wheel.get(index).request;
+    wheel.remove(index);
+    return request;
+}
+
+static void test_wheel_same_time_is_fifo()
+{
+    TxWheel<Request> wheel;
+    wheel.insert(Request::QUERY, 1000);
+    wheel.insert(Request::PRESS, 1000);
+    EXPECT(pop(wheel, 1000) == Request::QUERY);
+    EXPECT(pop(wheel, 1000) == Request::PRESS);
+    EXPECT(wheel.empty());
+}
+
+static void test_wheel_earliest_first()
+{
+    TxWheel<Request> wheel;
+    wheel.insert(Request::LATER, 1050);
+    wheel.insert(Request::QUERY, 1010);
+    EXPECT(wheel.due(1000) < 0);
+    EXPECT(wheel.time_until_next(1000) == 10);
+    EXPECT(pop(wheel, 1100) == Request::QUERY);
+    EXPECT(pop(wheel, 1100) == Request::LATER);
+}
+
+static void test_wheel_rearm()
+{
+    TxWheel<Request> wheel;
+    wheel.insert(Request::PRESS, 1000);
+    auto index = wheel.due(1000);
+    EXPECT(index >= 0);
+    wheel.rearm(index, Request::RELEASE, 1500);
+    EXPECT(wheel.due(1000) < 0);
+    EXPECT(wheel.time_until_next(1000) == 500);
+    EXPECT(pop(wheel, 1500) == Request::RELEASE);
+    EXPECT(wheel.empty());
+}
+
+static void test_wheel_overflow_does_not_block()
+{
+    TxWheel<Request> wheel;
+    wheel.insert(Request::QUERY, 0);
+    wheel.insert(Request::LATER, 20000); // beyond the wheel
+    wheel.insert(Request::PRESS, 6000);
+    EXPECT(pop(wheel, 0) == Request::QUERY);
+    EXPECT(wheel.time_until_next(0) == 6000);
+    EXPECT(wheel.due(5999) < 0);
+    EXPECT(pop(wheel, 6000) == Request::PRESS);
+    EXPECT(wheel.time_until_next(6000) == 14000);
+    EXPECT(wheel.due(19999) < 0);
+    EXPECT(pop(wheel, 20000) == Request::LATER);
+    EXPECT(wheel.empty());
+}
+
+static void test_wheel_overflow_only()
+{
+    TxWheel<Request> wheel;
+    wheel.insert(Request::QUERY, 1000);
+    wheel.insert(Request::LATER, 1000 + 3 * TX_WHEEL_SPAN);
+    EXPECT(pop(wheel, 1000) == Request::QUERY);
+    // a command inserted later but due earlier still goes first
+    wheel.insert(Request::PRESS, 2000);
+    EXPECT(pop(wheel, 2000) == Request::PRESS);
+    EXPECT(wheel.time_until_next(2000) == 3 * TX_WHEEL_SPAN - 1000);
+    EXPECT(pop(wheel, 1000 + 3 * TX_WHEEL_SPAN) == Request::LATER);
+}
+
+static void test_wheel_millis_wrap()
+{
+    TxWheel<Request> wheel;
+    uint32_t start = 0xffffffff - 300;
+    wheel.insert(Request::QUERY, start);
+    wheel.insert(Request::PRESS, start + 200); // before the wrap
+    wheel.insert(Request::RELEASE, start + 600); // after it
+    EXPECT(pop(wheel, start) == Request::QUERY);
+    EXPECT(pop(wheel, start + 200) == Request::PRESS);
+    EXPECT(wheel.due(start + 599) < 0);
+    EXPECT(wheel.time_until_next(start + 500) == 100);
+    EXPECT(pop(wheel, start + 600) == Request::RELEASE);
+}
+
+static void test_wheel_capacity()
+{
+    TxWheel<Request> wheel;
+    for (uint8_t i = 0; i < TX_WHEEL_CAPACITY; i++) {
+        EXPECT(wheel.insert(Request::QUERY, 1000 + i));
+    }
+    EXPECT(!wheel.insert(Request::QUERY, 2000));
+    pop(wheel, 1000);
+    EXPECT(wheel.insert(Request::QUERY, 2000));
+}
+
+static void test_rolling_code_lease()
+{
+    EXPECT(!rolling_code_reached(100, 164));
+    EXPECT(rolling_code_reached(164, 164));
+    EXPECT(rolling_code_reached(165, 164));
+    // the lease end wrapped past 2^28, the counter hasn't yet
+    uint32_t lease_end = (ROLLING_CODE_MASK - 10 + ROLLING_CODE_LEASE) & ROLLING_CODE_MASK;
+    EXPECT(!rolling_code_reached(ROLLING_CODE_MASK - 10, lease_end));
+    EXPECT(!rolling_code_reached(ROLLING_CODE_MASK, lease_end));
+    EXPECT(!rolling_code_reached(0, lease_end));
+    EXPECT(rolling_code_reached(lease_end, lease_end));
+    // the counter wrapped past a lease ending near the top
+    EXPECT(rolling_code_reached(5, ROLLING_CODE_MASK - 5));
+    // a lease in the upper half of the range is reached from 0
+    EXPECT(!rolling_code_reached(0, 0x8000000));
+    EXPECT(rolling_code_reached(0x8000000, 0x8000000));
+}
+
+static void test_secplus1_scoring()
+{
+    using namespace secplus1;
+    uint8_t unconfirmed_clean = reading_score(true, false);
+    uint8_t clean_echo = reading_score(true, true);
+    uint8_t parity_error = reading_score(false, false);
+    // 0 accepts everything
+    EXPECT(reading_accepted(parity_error, false, 0));
+    // the default accepts a clean answer to our query at once
+    EXPECT(reading_accepted(clean_echo, false, 60));
+    EXPECT(!reading_accepted(unconfirmed_clean, false, 60));
+    EXPECT(reading_accepted(parity_error, true, 60));
+    // 100 waits for confirmation, which is enough on its own
+    EXPECT(!reading_accepted(clean_echo, false, 100));
+    EXPECT(reading_accepted(parity_error, true, 100));
+    EXPECT(reading_accepted(CONFIDENCE_MAX, false, 100));
+}
+
+static void test_callbacks_expire_per_registration()
+{
+    OnceCallbacks<void(int), 4> callbacks;
+    int first = 0;
+    int second = 0;
+    callbacks([&](int v) { first = v; }, 10000);
+    callbacks([&](int v) { second = v; }, 15000);
+    // a later registration doesn't extend the first deadline
+    EXPECT(callbacks.expire(9999) == 0);
+    EXPECT(callbacks.expire(10000) == 1);
+    EXPECT(callbacks.size() == 1);
+    callbacks.trigger(3);
+    EXPECT(first == 0);
+    EXPECT(second == 3);
+    EXPECT(callbacks.size() == 0);
+}
+
+static void test_callbacks_expire_across_wrap()
+{
+    OnceCallbacks<void(int), 4> callbacks;
+    int value = 0;
+    callbacks([&](int v) { value = v; }, 0xfffffff0 + 10000);
+    EXPECT(callbacks.expire(0xfffffff0) == 0);
+    EXPECT(callbacks.expire(9000) == 0);
+    callbacks.trigger(1);
+    EXPECT(value == 1);
+}
+
+int main()
+{
+    test_wheel_same_time_is_fifo();
+    test_wheel_earliest_first();
+    test_wheel_rearm();
+    test_wheel_overflow_does_not_block();
+    test_wheel_overflow_only();
+    test_wheel_millis_wrap();
+    test_wheel_capacity();
+    test_rolling_code_lease();
+    test_secplus1_scoring();
+    test_callbacks_expire_per_registration();
+    test_callbacks_expire_across_wrap();
+    if (failures > 0) {
+        std::printf("%d failures\n", failures);
+        return EXIT_FAILURE;
+    }
+    std::printf("all tests passed\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,72 @@
+#pragma once
+// protocol: auto on the host, a board that reboots into the protocol it
+// switches to
+
+#include "host_board.h"
+
+#include <functional>
+#include <memory>
+
+namespace host_board {
+
+using protocol::ProtocolType;
+
+// A board that is rebooted whenever it asks to, booting from the flash the
+// previous boot left
+class Rebooting {
+public:
+    explicit Rebooting(host::Bus& bus, bool fresh = true)
+        : bus_(bus)
+        , board(new Board(bus, fresh))
+    {
+    }
+
+    // runs until a protocol is confirmed or ms have passed, every_second
+    // is called at the start of each second, returns the ms it took
+    uint32_t run_until_detected(uint32_t ms, const std::function<void()>& every_second = {})
+    {
+        auto start = host::now_ms();
+        while (this->detected() == ProtocolType::UNKNOWN && host::now_ms() - start < ms) {
+            if (every_second) {
+                every_second();
+            }
+            this->board->run_until([this] { return this->detected() != ProtocolType::UNKNOWN || App.reboot_requests() > 0; }, 1000);
+            if (App.reboot_requests() > 0) {
+                this->reboot();
+                this->reboots++;
+            }
+        }
+        return host::now_ms() - start;
+    }
+
+    // the old board goes before the new one takes its pins
+    void reboot()
+    {
+        this->board.reset();
+        this->board.reset(new Board(this->bus_, false));
+    }
+
+    ProtocolType detected() { return this->board->ratgdo.get_detected_protocol(); }
+
+protected:
+    host::Bus& bus_;
+
+public:
+    std::unique_ptr<Board> board;
+    uint32_t reboots { 0 };
+};
+
+inline void print(const char* name, Rebooting& rebooting, uint32_t took)
+{
+    std::printf("%s: %s after %ums and %u reboots\n", name, ProtocolType_to_string(rebooting.detected()), took, rebooting.reboots);
+}
+
+// bytes corrupted on the way and random bytes between the frames, about
+// five a second at each end
+inline void add_noise(host::Bus& bus, float error_rate)
+{
+    bus.set_error_rate(error_rate);
+    bus.noise(host::now_us(), 1000000, 5);
+}
+
+} // namespace host_board
@@ -0,0 +1,46 @@
+#pragma once
+// The protocols with their receive paths opened up, for driving them
+// directly: read_command framing, decode_packet and handle_command on an
+// instance of their own next to a host Board's
+
+#include "host_board.h"
+#include "secplus1.h"
+#include "secplus2.h"
+
+namespace host_board {
+
+// pins of the probe's serial, clear of the board's
+const uint8_t PROBE_RX = 20;
+const uint8_t PROBE_TX = 21;
+
+class Secplus2Probe : public secplus2::Secplus2 {
+public:
+    using secplus2::Secplus2::decode_packet;
+    using secplus2::Secplus2::encode_packet;
+    using secplus2::Secplus2::handle_command;
+    using secplus2::Secplus2::read_command;
+    using secplus2::Secplus2::set_client_id;
+
+    uint16_t rx_byte_count() const { return this->rx_.byte_count; }
+};
+
+class Secplus1Probe : public secplus1::Secplus1 {
+public:
+    using secplus1::Secplus1::decode_packet;
+    using secplus1::Secplus1::handle_command;
+    using secplus1::Secplus1::read_command;
+
+    uint16_t rx_byte_count() const { return this->rx_.byte_count; }
+};
+
+// bytes that have arrived by now at serial, the clock moves past each
+inline void deliver(SoftwareSerial* serial, const uint8_t* data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        auto now = host::now_us();
+        serial->deliver({ data[i], SoftwareSerial::parityEven(data[i]), now - serial->byte_time(), now });
+        host::advance_us(serial->byte_time());
+    }
+}
+
+} // namespace host_board
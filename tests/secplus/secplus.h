@@ -0,0 +1,23 @@
+#ifndef SECPLUS_H
+#define SECPLUS_H
+
+#include <stdint.h>
+
+// Host stand-in for the wireline functions of https://github.com/ratgdo/secplus.
+// It is NOT the Security+ 2.0 wire format: it carries rolling, fixed and
+// data behind the same 55 01 00 preamble in a 19 byte packet with a CRC,
+// so the component's framing, validation and dispatch run unchanged. Set
+// RATGDO_SECPLUS_DIR to build against the real library instead
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int8_t encode_wireline(const uint32_t rolling, const uint64_t fixed, const uint32_t data, uint8_t* packet);
+int8_t decode_wireline(const uint8_t* packet, uint32_t* rolling, uint64_t* fixed, uint32_t* data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,68 @@
+#include "secplus.h"
+
+#include <string.h>
+
+#define LOOPBACK_MARKER 0x5a
+
+static uint16_t loopback_crc(const uint8_t* data, uint8_t len)
+{
+    uint16_t crc = 0xffff;
+    while (len--) {
+        crc ^= *data++;
+        for (uint8_t i = 0; i < 8; i++) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xa001 : crc >> 1;
+        }
+    }
+    return crc;
+}
+
+static void put(uint8_t* out, uint64_t value, uint8_t bytes)
+{
+    for (uint8_t i = 0; i < bytes; i++) {
+        out[i] = (value >> (8 * i)) & 0xff;
+    }
+}
+
+static uint64_t get(const uint8_t* in, uint8_t bytes)
+{
+    uint64_t value = 0;
+    for (uint8_t i = 0; i < bytes; i++) {
+        value |= (uint64_t)in[i] << (8 * i);
+    }
+    return value;
+}
+
+// 55 01 00 | rolling 4 | fixed 5 | data 4 | marker | crc 2
+int8_t encode_wireline(const uint32_t rolling, const uint64_t fixed, const uint32_t data, uint8_t* packet)
+{
+    if (rolling >= (1u << 28) || fixed >= (1ull << 40)) {
+        return -1;
+    }
+    packet[0] = 0x55;
+    packet[1] = 0x01;
+    packet[2] = 0x00;
+    put(&packet[3], rolling, 4);
+    put(&packet[7], fixed, 5);
+    put(&packet[12], data, 4);
+    packet[16] = LOOPBACK_MARKER;
+    put(&packet[17], loopback_crc(&packet[3], 14), 2);
+    return 0;
+}
+
+int8_t decode_wireline(const uint8_t* packet, uint32_t* rolling, uint64_t* fixed, uint32_t* data)
+{
+    if (packet[0] != 0x55 || packet[1] != 0x01 || packet[2] != 0x00 || packet[16] != LOOPBACK_MARKER) {
+        return -1;
+    }
+    if (get(&packet[17], 2) != loopback_crc(&packet[3], 14)) {
+        return -1;
+    }
+    uint32_t r = (uint32_t)get(&packet[3], 4);
+    if (r >= (1u << 28)) {
+        return -1;
+    }
+    *rolling = r;
+    *fixed = get(&packet[7], 5);
+    *data = (uint32_t)get(&packet[12], 4);
+    return 0;
+}
@@ -0,0 +1,67 @@
+// protocol: auto against the simulated Sec+1 opener, with and without a
+// wall panel, on a clean and on a noisy wire: the board starts on Sec+2
+// and has to switch
+
+#include "gdo_secplus1.h"
+#include "protocol_detect.h"
+
+using namespace host_board;
+
+static void test_secplus1_with_panel()
+{
+    host::Bus bus;
+    Secplus1Gdo gdo(bus);
+    Secplus1Panel panel(bus);
+    Rebooting rebooting(bus);
+
+    auto took = rebooting.run_until_detected(120000);
+    print("sec+1 with panel", rebooting, took);
+    EXPECT(rebooting.detected() == ProtocolType::SECPLUSV1);
+    EXPECT(rebooting.reboots == 1);
+    EXPECT(took < PROTOCOL_DETECT_WINDOW + 3000);
+
+    // the next boot starts on Sec+1
+    rebooting.reboot();
+    took = rebooting.run_until_detected(120000);
+    print("sec+1 with panel, next boot", rebooting, took);
+    EXPECT(rebooting.detected() == ProtocolType::SECPLUSV1);
+    EXPECT(rebooting.reboots == 1);
+    EXPECT(took < 3000);
+}
+
+static void test_secplus1_without_panel()
+{
+    host::Bus bus;
+    Secplus1Gdo gdo(bus);
+    Rebooting rebooting(bus);
+
+    auto took = rebooting.run_until_detected(120000);
+    print("sec+1 without panel", rebooting, took);
+    EXPECT(rebooting.detected() == ProtocolType::SECPLUSV1);
+    EXPECT(rebooting.reboots == 1);
+    // the emulated panel starts polling after WALL_PANEL_TIMEOUT, the
+    // state is known a few seconds of sync later
+    EXPECT(took < PROTOCOL_DETECT_WINDOW + secplus1::WALL_PANEL_TIMEOUT + 10000);
+}
+
+static void test_noisy_secplus1()
+{
+    host::Bus bus;
+    Secplus1Gdo gdo(bus);
+    Secplus1Panel panel(bus);
+    Rebooting rebooting(bus);
+
+    auto took = rebooting.run_until_detected(120000, [&bus] { add_noise(bus, 0.02f); });
+    print("noisy sec+1", rebooting, took);
+    EXPECT(rebooting.detected() == ProtocolType::SECPLUSV1);
+    EXPECT(rebooting.reboots == 1);
+    EXPECT(took < PROTOCOL_DETECT_WINDOW + 10000);
+}
+
+int main()
+{
+    test_secplus1_with_panel();
+    test_secplus1_without_panel();
+    test_noisy_secplus1();
+    return report();
+}
@@ -0,0 +1,135 @@
+// The component against a simulated Sec+1 opener, alone, with a standard
+// wall panel and with a 0x37 panel: how long until the state is known,
+// door commands end to end and the position estimate
+
+#include "gdo_secplus1.h"
+
+#include <cmath>
+
+using namespace host_board;
+
+static const uint32_t SYNC_START = 1000; // ms after setup
+
+static void set_durations(Board& board, const Secplus1Gdo& gdo)
+{
+    board.ratgdo.set_opening_duration(gdo.travel.opening_time / 1e6f);
+    board.ratgdo.set_closing_duration(gdo.travel.closing_time / 1e6f);
+}
+
+// Opens the door, returns the ms until OPENING was published, and the
+// largest difference between a reported position and the door's
+static uint32_t open_door(Board& board, Secplus1Gdo& gdo, float& max_error)
+{
+    max_error = 0;
+    board.ratgdo.subscribe_door_state([&gdo, &max_error](DoorState state, float position) {
+        if (state == DoorState::OPENING && position != DOOR_POSITION_UNKNOWN) {
+            max_error = std::max(max_error, std::fabs(position - gdo.travel.position_at(host::now_us())));
+        }
+    });
+    board.ratgdo.door_open();
+    auto took = board.run_until([&board] { return board.published.door == DoorState::OPENING; }, 5000);
+    board.run_until([&board] { return board.published.door == DoorState::OPEN; }, 20000);
+    return took;
+}
+
+static void test_without_panel()
+{
+    host::Bus bus;
+    Secplus1Gdo gdo(bus);
+    gdo.light = true;
+    Board board(bus);
+    set_durations(board, gdo);
+
+    auto took = board.run_until([&board] { return board.published.door != DoorState::UNKNOWN; }, 60000);
+    std::printf("no panel: door state known %ums after setup\n", took);
+    EXPECT(board.published.door == DoorState::CLOSED);
+    EXPECT(took > SYNC_START + secplus1::WALL_PANEL_TIMEOUT);
+    EXPECT(took < SYNC_START + secplus1::SYNC_TIMEOUT);
+    board.run(2000);
+    EXPECT(board.published.light == LightState::ON);
+    EXPECT(board.published.lock == LockState::UNLOCKED);
+
+    float error;
+    auto latency = open_door(board, gdo, error);
+    std::printf("no panel: OPENING published after %ums, max position error %.3f\n", latency, error);
+    EXPECT(board.published.door == DoorState::OPEN);
+    EXPECT(gdo.stats.commands == 1);
+    EXPECT(latency < 1500);
+    EXPECT(error < 0.05f);
+}
+
+static void test_standard_panel()
+{
+    host::Bus bus;
+    Secplus1Gdo gdo(bus);
+    Secplus1Panel panel(bus);
+    Board board(bus);
+    set_durations(board, gdo);
+
+    auto took = board.run_until([&board] { return board.published.door != DoorState::UNKNOWN; }, 60000);
+    std::printf("standard panel: door state known %ums after setup\n", took);
+    EXPECT(board.published.door == DoorState::CLOSED);
+    EXPECT(took < 2000);
+    board.run(SYNC_START + secplus1::SYNC_TIMEOUT);
+    EXPECT(!board.published.sync_failed);
+
+    float error;
+    auto latency = open_door(board, gdo, error);
+    std::printf("standard panel: OPENING published after %ums, max position error %.3f\n", latency, error);
+    EXPECT(board.published.door == DoorState::OPEN);
+    EXPECT(gdo.stats.commands == 1);
+    EXPECT(latency < 1500);
+    EXPECT(error < 0.05f);
+    EXPECT(bus.collisions() == 0);
+}
+
+static void test_0x37_panel()
+{
+    host::Bus bus;
+    Secplus1Gdo gdo(bus);
+    Secplus1Panel panel(bus, true);
+    Board board(bus);
+
+    // the panel doesn't query the door, the ratgdo does it in its place
+    auto took = board.run_until([&board] { return board.published.door != DoorState::UNKNOWN; }, 60000);
+    std::printf("0x37 panel: door state known %ums after setup\n", took);
+    EXPECT(board.published.door == DoorState::CLOSED);
+    EXPECT(took < secplus1::STATUS_QUERY_INTERVAL + 2000);
+
+    float error;
+    auto latency = open_door(board, gdo, error);
+    std::printf("0x37 panel: OPENING published after %ums\n", latency);
+    EXPECT(board.published.door == DoorState::OPEN);
+    EXPECT(gdo.stats.commands == 1);
+    EXPECT(latency < 2000);
+}
+
+// the door moved by a remote, the ratgdo queries it in place of the 0x37
+// panel on every poll while it moves, not only every STATUS_QUERY_INTERVAL
+static void test_0x37_panel_follows_remote()
+{
+    host::Bus bus;
+    Secplus1Gdo gdo(bus);
+    Secplus1Panel panel(bus, true);
+    Board board(bus);
+    board.run_until([&board] { return board.published.door == DoorState::CLOSED; }, 60000);
+
+    gdo.travel.open(host::now_us());
+    board.run_until([&board] { return board.published.door == DoorState::OPENING; }, secplus1::STATUS_QUERY_INTERVAL + 2000);
+    EXPECT(board.published.door == DoorState::OPENING);
+    auto arrival = gdo.travel.next_event();
+    board.run_until([&board] { return board.published.door == DoorState::OPEN; }, 20000);
+    auto late = (host::now_us() - arrival) / 1000;
+    std::printf("0x37 panel: OPEN after a remote published %llums late\n", (unsigned long long)late);
+    EXPECT(board.published.door == DoorState::OPEN);
+    EXPECT(late < 2000);
+}
+
+int main()
+{
+    test_without_panel();
+    test_standard_panel();
+    test_0x37_panel();
+    test_0x37_panel_follows_remote();
+    return report();
+}
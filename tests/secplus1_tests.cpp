@@ -0,0 +1,134 @@
+// Sec+1 through the real component: query and answer pairs on the wire are
+// decoded by Secplus1, scored, and published to the subscribers
+
+#include "host_board.h"
+#include "secplus1_wire.h"
+
+using namespace host_board;
+
+// runs the loop while the opener answers every query
+static std::vector<uint8_t> run_with_gdo(Secplus1Wire& gdo, uint32_t ms)
+{
+    std::vector<uint8_t> others;
+    uint64_t end = host::now_us() + uint64_t(ms) * 1000;
+    while (host::now_us() < end) {
+        App.loop();
+        auto bytes = gdo.answer();
+        others.insert(others.end(), bytes.begin(), bytes.end());
+        host::advance_ms(1);
+    }
+    return others;
+}
+
+static void test_panel_status_needs_confirmation()
+{
+    host::Bus bus;
+    Board board(bus);
+    Secplus1Wire gdo(bus);
+    run_for(50);
+
+    // a panel's query doesn't score as an answer to ours, the first
+    // reading waits for a second identical one
+    gdo.exchange(0x38, SECPLUS1_DOOR_OPEN);
+    run_for(100);
+    EXPECT(board.published.door == DoorState::UNKNOWN);
+    gdo.exchange(0x38, SECPLUS1_DOOR_OPEN);
+    run_for(100);
+    EXPECT(board.published.door == DoorState::OPEN);
+    EXPECT(board.published.position == 1.0f);
+}
+
+static void test_light_lock_and_obstruction()
+{
+    host::Bus bus;
+    Board board(bus);
+    Secplus1Wire gdo(bus);
+    run_for(50);
+
+    gdo.exchange(0x3A, SECPLUS1_LIGHT_ON);
+    run_for(100);
+    gdo.exchange(0x3A, SECPLUS1_LIGHT_ON);
+    run_for(100);
+    EXPECT(board.published.light == LightState::ON);
+    EXPECT(board.published.lock == LockState::LOCKED);
+
+    gdo.exchange(0x39, 0x01);
+    run_for(100);
+    EXPECT(board.published.obstruction == ObstructionState::OBSTRUCTED);
+    gdo.exchange(0x39, 0x00);
+    run_for(100);
+    EXPECT(board.published.obstruction == ObstructionState::CLEAR);
+}
+
+static void test_parity_errors_are_not_trusted()
+{
+    host::Bus bus;
+    Board board(bus);
+    Secplus1Wire gdo(bus);
+    run_for(50);
+
+    // an 8N1 byte read as 8E1 carries the stop bit as parity, 0x02 has odd
+    // parity so it arrives as a parity error
+    host::SerialEndpoint noisy;
+    noisy.configure(1200, false);
+    noisy.echo = false;
+    bus.attach(&noisy);
+    auto end = gdo.send(0x38);
+    uint8_t answer = SECPLUS1_DOOR_OPEN;
+    bus.send(&noisy, &answer, 1, end + SECPLUS1_ANSWER_DELAY);
+    run_for(100);
+    EXPECT(board.published.door == DoorState::UNKNOWN);
+    bus.detach(&noisy);
+}
+
+static void test_emulation_polls_without_panel()
+{
+    host::Bus bus;
+    Board board(bus);
+    Secplus1Wire gdo(bus);
+    gdo.door = SECPLUS1_DOOR_CLOSED;
+    gdo.other = SECPLUS1_LIGHT_ON | SECPLUS1_UNLOCKED;
+
+    // nobody talks until the ratgdo gives up waiting for a panel
+    run_with_gdo(gdo, secplus1::WALL_PANEL_TIMEOUT);
+    EXPECT(gdo.queries == 0);
+    EXPECT(board.published.door == DoorState::UNKNOWN);
+
+    // answers to its own queries are accepted at once
+    run_with_gdo(gdo, 10000);
+    EXPECT(gdo.queries > 0);
+    EXPECT(board.published.door == DoorState::CLOSED);
+    EXPECT(board.published.light == LightState::ON);
+    EXPECT(board.published.lock == LockState::UNLOCKED);
+    EXPECT(!board.published.sync_failed);
+}
+
+static void test_toggle_goes_out_as_press_and_release()
+{
+    host::Bus bus;
+    Board board(bus);
+    Secplus1Wire gdo(bus);
+    run_with_gdo(gdo, secplus1::WALL_PANEL_TIMEOUT + 10000);
+    EXPECT(board.published.door == DoorState::CLOSED);
+
+    board.ratgdo.door_open();
+    auto bytes = run_with_gdo(gdo, 2000);
+    bool press = false;
+    bool release = false;
+    for (auto byte : bytes) {
+        press |= byte == static_cast<uint8_t>(CommandType::TOGGLE_DOOR_PRESS);
+        release |= press && byte == static_cast<uint8_t>(CommandType::TOGGLE_DOOR_RELEASE);
+    }
+    EXPECT(press);
+    EXPECT(release);
+}
+
+int main()
+{
+    test_panel_status_needs_confirmation();
+    test_light_lock_and_obstruction();
+    test_parity_errors_are_not_trusted();
+    test_emulation_polls_without_panel();
+    test_toggle_goes_out_as_press_and_release();
+    return report();
+}
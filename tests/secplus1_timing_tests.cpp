@@ -0,0 +1,71 @@
+// Sec+1 timing on the virtual clock: wall panel detection and the sync
+// timeout at the device's loop pace, with the idle time skipped
+
+#include "host_board.h"
+#include "secplus1_wire.h"
+
+using namespace host_board;
+
+static const uint32_t SYNC_START = 1000; // ms after setup
+static const uint32_t PANEL_INTERVAL = 1000; // ms between a wall panel's queries
+
+static void test_emulation_starts_without_panel()
+{
+    host::Bus bus;
+    Board board(bus);
+    Secplus1Wire gdo(bus);
+    auto start = host::now_ms() + SYNC_START;
+
+    board.run_until([&gdo] { return gdo.queries > 0; }, SYNC_START + secplus1::WALL_PANEL_TIMEOUT + 10000);
+    EXPECT(gdo.queries > 0);
+    auto first = gdo.first_query / 1000 - start;
+    // the switch is made on the first detection check past the timeout,
+    // the states are sent from the next check on, the door query is the
+    // ninth, each state goes out in the first loop after it is due
+    const auto period = secplus1::WALL_PANEL_DETECT_PERIOD;
+    auto expected = (secplus1::WALL_PANEL_TIMEOUT / period + 2) * period + 8 * secplus1::WALL_PANEL_FAST_POLL;
+    EXPECT(first >= expected);
+    EXPECT(first <= expected + 9 * host::LOOP_INTERVAL / 1000 + 10);
+
+    board.run(2000);
+    EXPECT(board.published.door == DoorState::CLOSED);
+    EXPECT(!board.published.sync_failed);
+}
+
+static void test_panel_keeps_emulation_off()
+{
+    host::Bus bus;
+    Board board(bus);
+    Secplus1Wire gdo(bus);
+
+    // the panel's queries and the opener's answers, the ratgdo only listens
+    gdo.door = SECPLUS1_DOOR_OPEN;
+    for (uint32_t t = 0; t < SYNC_START + secplus1::WALL_PANEL_TIMEOUT + 10000; t += PANEL_INTERVAL) {
+        gdo.exchange(0x38, gdo.door);
+        board.run(PANEL_INTERVAL);
+    }
+    EXPECT(gdo.queries == 0);
+    EXPECT(board.published.door == DoorState::OPEN);
+    EXPECT(!board.published.sync_failed);
+}
+
+static void test_sync_fails_without_opener()
+{
+    host::Bus bus;
+    Board board(bus);
+    auto start = host::now_ms() + SYNC_START;
+
+    board.run_until([&board] { return board.published.sync_failed; }, SYNC_START + secplus1::SYNC_TIMEOUT + 5000);
+    EXPECT(board.published.sync_failed);
+    auto failed = board.published.sync_failed_at / 1000 - start;
+    EXPECT(failed >= secplus1::SYNC_TIMEOUT);
+    EXPECT(failed <= secplus1::SYNC_TIMEOUT + host::LOOP_INTERVAL / 1000);
+}
+
+int main()
+{
+    test_emulation_starts_without_panel();
+    test_panel_keeps_emulation_off();
+    test_sync_fails_without_opener();
+    return report();
+}
@@ -0,0 +1,94 @@
+#pragma once
+// The opener's end of a Sec+1 line: answers the status queries of a wall
+// panel or of the ratgdo emulating one, and sends bytes of its own
+
+#include "secplus1.h"
+
+#include "host.h"
+
+#include <vector>
+
+namespace host_board {
+
+using esphome::ratgdo::secplus1::CommandType;
+
+// door bits of the 0x38 answer
+const uint8_t SECPLUS1_DOOR_STOPPED = 0x0;
+const uint8_t SECPLUS1_DOOR_OPENING = 0x1;
+const uint8_t SECPLUS1_DOOR_OPEN = 0x2;
+const uint8_t SECPLUS1_DOOR_CLOSING = 0x4;
+const uint8_t SECPLUS1_DOOR_CLOSED = 0x5;
+// bits of the 0x3A answer
+const uint8_t SECPLUS1_LIGHT_ON = 1 << 2;
+const uint8_t SECPLUS1_UNLOCKED = 1 << 3;
+
+const uint32_t SECPLUS1_ANSWER_DELAY = 2000; // us from the end of a query to the answer
+
+class Secplus1Wire : public esphome::host::SerialEndpoint {
+public:
+    explicit Secplus1Wire(esphome::host::Bus& bus)
+        : bus_(bus)
+    {
+        this->configure(1200, true);
+        this->echo = false;
+        bus.attach(this);
+    }
+
+    // a byte from whoever is on the line, a panel or the opener itself
+    uint64_t send_at(uint64_t at, uint8_t byte) { return this->bus_.send(this, &byte, 1, at); }
+    uint64_t send(uint8_t byte) { return this->send_at(esphome::host::now_us(), byte); }
+
+    // a wall panel's query and the opener's answer right after it
+    uint64_t exchange(uint8_t query, uint8_t answer)
+    {
+        auto end = this->send(query);
+        return this->send_at(end + SECPLUS1_ANSWER_DELAY, answer);
+    }
+
+    // on a bus driven by run_until() the opener answers as queries arrive,
+    // the other bytes are kept in others
+    uint64_t next_poll() const override { return this->next_arrival(); }
+    void poll() override
+    {
+        auto bytes = this->answer();
+        this->others.insert(this->others.end(), bytes.begin(), bytes.end());
+    }
+
+    // Answers the queries that have arrived by now with the current
+    // state, returns the other bytes received, buttons and their releases
+    std::vector<uint8_t> answer()
+    {
+        std::vector<uint8_t> others;
+        esphome::host::WireByte byte;
+        while (this->receive(byte)) {
+            uint8_t answer;
+            if (byte.value == static_cast<uint8_t>(CommandType::QUERY_DOOR_STATUS)) {
+                answer = this->door;
+            } else if (byte.value == static_cast<uint8_t>(CommandType::QUERY_OTHER_STATUS)) {
+                answer = this->other;
+            } else if (byte.value == static_cast<uint8_t>(CommandType::OBSTRUCTION)) {
+                answer = this->obstruction;
+            } else {
+                others.push_back(byte.value);
+                continue;
+            }
+            if (this->queries++ == 0) {
+                this->first_query = byte.end;
+            }
+            this->send_at(byte.end + SECPLUS1_ANSWER_DELAY, answer);
+        }
+        return others;
+    }
+
+    uint8_t door { SECPLUS1_DOOR_CLOSED };
+    uint8_t other { SECPLUS1_UNLOCKED };
+    uint8_t obstruction { 0 };
+    uint32_t queries { 0 };
+    uint64_t first_query { 0 }; // us
+    std::vector<uint8_t> others;
+
+protected:
+    esphome::host::Bus& bus_;
+};
+
+} // namespace host_board
@@ -0,0 +1,86 @@
+// protocol: auto against the simulated Sec+2 opener, on a clean and on a
+// noisy wire, and that a silent or noise only wire doesn't keep the board
+// rebooting
+
+#include "gdo_secplus2.h"
+#include "protocol_detect.h"
+
+using namespace host_board;
+
+static void test_secplus2()
+{
+    host::Bus bus;
+    Secplus2Gdo gdo(bus);
+    gdo.openings = 10;
+    Rebooting rebooting(bus);
+
+    auto took = rebooting.run_until_detected(120000);
+    print("sec+2", rebooting, took);
+    EXPECT(rebooting.detected() == ProtocolType::SECPLUSV2);
+    EXPECT(rebooting.reboots == 0);
+    EXPECT(took < 2000);
+}
+
+static void test_noisy_secplus2()
+{
+    host::Bus bus;
+    Secplus2Gdo gdo(bus);
+    gdo.openings = 10;
+    Rebooting rebooting(bus);
+
+    auto took = rebooting.run_until_detected(120000, [&bus] { add_noise(bus, 0.02f); });
+    print("noisy sec+2", rebooting, took);
+    EXPECT(rebooting.detected() == ProtocolType::SECPLUSV2);
+    EXPECT(rebooting.reboots == 0);
+    EXPECT(took < 5000);
+}
+
+// the GDO of a confirmed protocol is unplugged, the board keeps listening
+static void test_silent_wire_keeps_confirmed()
+{
+    host::Bus bus;
+    Secplus2Gdo gdo(bus);
+    gdo.openings = 10;
+    Rebooting rebooting(bus);
+    rebooting.run_until_detected(10000);
+    EXPECT(rebooting.detected() == ProtocolType::SECPLUSV2);
+    rebooting.board->run(PERSIST_WINDOW + 1000);
+
+    bus.detach(&gdo);
+    rebooting.reboot();
+    rebooting.run_until_detected(600000);
+    std::printf("silent wire: %u reboots in 10 minutes\n", rebooting.reboots);
+    EXPECT(rebooting.reboots == 0);
+
+    // plugged back in, confirmed again without a reboot by what the GDO
+    // reports when someone walks through the door
+    bus.attach(&gdo);
+    gdo.motion();
+    gdo.obstruction(true);
+    gdo.obstruction(false);
+    auto took = rebooting.run_until_detected(10000);
+    EXPECT(rebooting.detected() == ProtocolType::SECPLUSV2);
+    EXPECT(rebooting.reboots == 0);
+    EXPECT(took < 5000);
+}
+
+// nothing but noise, no protocol is confirmed and the switches stop
+static void test_noise_only()
+{
+    host::Bus bus;
+    Rebooting rebooting(bus);
+
+    auto took = rebooting.run_until_detected(600000, [&bus] { bus.noise(host::now_us(), 1000000, 20); });
+    print("noise only", rebooting, took);
+    EXPECT(rebooting.detected() == ProtocolType::UNKNOWN);
+    EXPECT(rebooting.reboots == PROTOCOL_DETECT_ATTEMPTS);
+}
+
+int main()
+{
+    test_secplus2();
+    test_noisy_secplus2();
+    test_silent_wire_keeps_confirmed();
+    test_noise_only();
+    return report();
+}
@@ -0,0 +1,230 @@
+// The component against a simulated Sec+2 opener: sync, door commands end
+// to end, position estimates and rolling codes across reboots. The
+// measurements are printed, the bounds they are checked against are what
+// a wall panel user would notice
+
+#include "gdo_secplus2.h"
+
+#include <cmath>
+
+using namespace host_board;
+
+static const uint32_t SYNC_START = 1000; // ms after setup
+
+static bool synced(RATGDOComponent& ratgdo)
+{
+    return *ratgdo.door_state != DoorState::UNKNOWN && *ratgdo.openings != 0
+        && *ratgdo.paired_total != PAIRED_DEVICES_UNKNOWN && *ratgdo.paired_remotes != PAIRED_DEVICES_UNKNOWN
+        && *ratgdo.paired_keypads != PAIRED_DEVICES_UNKNOWN && *ratgdo.paired_wall_controls != PAIRED_DEVICES_UNKNOWN
+        && *ratgdo.paired_accessories != PAIRED_DEVICES_UNKNOWN;
+}
+
+// the largest difference between a reported position and the door's while it moves
+struct PositionError {
+    float max { 0 };
+    uint32_t samples { 0 };
+};
+
+static void track_position(Board& board, const Secplus2Gdo& gdo, PositionError& error)
+{
+    board.ratgdo.subscribe_door_state([&gdo, &error](DoorState state, float position) {
+        if ((state == DoorState::OPENING || state == DoorState::CLOSING) && position != DOOR_POSITION_UNKNOWN) {
+            error.max = std::max(error.max, std::fabs(position - gdo.travel.position_at(host::now_us())));
+            error.samples++;
+        }
+    });
+}
+
+static void test_sync()
+{
+    host::Bus bus;
+    Secplus2Gdo gdo(bus);
+    gdo.openings = 1234;
+    Board board(bus);
+    board.run(SYNC_START);
+
+    auto took = board.run_until([&board] { return synced(board.ratgdo); }, 10000);
+    std::printf("sync: %ums, %u queries answered\n", took, gdo.stats.queries);
+    EXPECT(synced(board.ratgdo));
+    EXPECT(took < 1000);
+    EXPECT(board.published.door == DoorState::CLOSED);
+    EXPECT(board.published.openings == 1234);
+    EXPECT(board.published.paired_total == 3);
+    EXPECT(*board.ratgdo.paired_remotes == 2);
+    EXPECT(gdo.stats.rejected == 0);
+    EXPECT(gdo.undecodable() == 0);
+}
+
+static void test_open_and_close()
+{
+    host::Bus bus;
+    Secplus2Gdo gdo(bus);
+    gdo.openings = 10;
+    Board board(bus);
+    board.ratgdo.set_opening_duration(gdo.travel.opening_time / 1e6f);
+    board.ratgdo.set_closing_duration(gdo.travel.closing_time / 1e6f);
+    PositionError error;
+    track_position(board, gdo, error);
+    board.run(SYNC_START + 1000);
+    EXPECT(synced(board.ratgdo));
+
+    // command to the opener, and the opener's state back to the subscribers
+    auto start = host::now_us();
+    board.ratgdo.door_open();
+    auto took = board.run_until([&board] { return board.published.door == DoorState::OPENING; }, 2000);
+    auto command = (gdo.stats.last_command - start) / 1000;
+    std::printf("open: command at the opener after %llums, OPENING published after %ums\n", (unsigned long long)command, took);
+    EXPECT(gdo.stats.commands == 1);
+    EXPECT(command < 100);
+    EXPECT(took < 150);
+    EXPECT(board.published.motor == MotorState::ON);
+    EXPECT(board.published.light == LightState::ON);
+
+    took = board.run_until([&board] { return board.published.door == DoorState::OPEN; }, 20000);
+    EXPECT(board.published.door == DoorState::OPEN);
+    EXPECT(board.published.position == 1.0f);
+    EXPECT(gdo.openings == 11);
+
+    board.ratgdo.door_close();
+    board.run_until([&board] { return board.published.door == DoorState::CLOSED; }, 20000);
+    EXPECT(board.published.door == DoorState::CLOSED);
+    EXPECT(board.published.position == 0.0f);
+
+    std::printf("open and close: max position error %.3f over %u reports\n", error.max, error.samples);
+    EXPECT(error.samples > 20);
+    EXPECT(error.max < 0.02f);
+    EXPECT(gdo.stats.rejected == 0);
+}
+
+static void test_move_to_position()
+{
+    host::Bus bus;
+    Secplus2Gdo gdo(bus);
+    gdo.openings = 10;
+    gdo.travel.stop_latency = 400000;
+    Board board(bus);
+    board.ratgdo.set_opening_duration(gdo.travel.opening_time / 1e6f);
+    board.ratgdo.set_closing_duration(gdo.travel.closing_time / 1e6f);
+    board.run(SYNC_START + 1000);
+
+    // the door coasts past the target until the stop latency is learned
+    float first = 0;
+    float last = 0;
+    for (int i = 0; i < 4; i++) {
+        float target = i % 2 == 0 ? 0.5f : 0.25f;
+        board.ratgdo.door_move_to_position(target);
+        board.run_until([&board] { return board.published.door != DoorState::STOPPED; }, 2000);
+        board.run_until([&board] { return board.published.door == DoorState::STOPPED; }, 20000);
+        board.run(500);
+        auto error = std::fabs(gdo.travel.position - target);
+        std::printf("move to %.2f: stopped at %.3f, reported %.3f\n", target, gdo.travel.position, board.published.position);
+        EXPECT(board.published.door == DoorState::STOPPED);
+        EXPECT(std::fabs(board.published.position - gdo.travel.position) < 0.02f);
+        if (i == 0) {
+            first = error;
+        }
+        last = error;
+    }
+    EXPECT(first > 0.02f);
+    EXPECT(last < 0.02f);
+}
+
+// a move to position the door never started on is dropped, by a timeout
+// or by the next door command, and doesn't stop a later full open
+static void test_unstarted_move_is_dropped()
+{
+    for (int by_command = 0; by_command < 2; by_command++) {
+        host::Bus bus;
+        Secplus2Gdo gdo(bus);
+        gdo.openings = 10;
+        Board board(bus);
+        board.ratgdo.set_opening_duration(gdo.travel.opening_time / 1e6f);
+        board.ratgdo.set_closing_duration(gdo.travel.closing_time / 1e6f);
+        board.run(SYNC_START + 1000);
+
+        bus.detach(&gdo);
+        board.ratgdo.door_move_to_position(0.5f);
+        board.run(by_command ? 100 : DOOR_RESPONSE_TIMEOUT + 100);
+        bus.attach(&gdo);
+        board.ratgdo.door_open();
+        board.run_until([&board] { return board.published.door == DoorState::OPEN || board.published.door == DoorState::STOPPED; }, 20000);
+        EXPECT(board.published.door == DoorState::OPEN);
+        EXPECT(gdo.travel.position == 1.0f);
+    }
+}
+
+// a close while opening stops the door first and closes it once STOPPED is
+// reported. The opener reports it within the press of the stop, the close
+// must not reuse the code the stop's release has yet to move on
+static void test_close_while_opening()
+{
+    host::Bus bus;
+    Secplus2Gdo gdo(bus);
+    gdo.openings = 10;
+    Board board(bus);
+    board.run(SYNC_START + 1000);
+
+    board.ratgdo.door_open();
+    board.run(4000);
+    EXPECT(board.published.door == DoorState::OPENING);
+    board.ratgdo.door_close();
+    board.run_until([&board] { return board.published.door == DoorState::CLOSED; }, 20000);
+    std::printf("close while opening: %u commands accepted, %u rejected\n", gdo.stats.commands, gdo.stats.rejected);
+    EXPECT(board.published.door == DoorState::CLOSED);
+    EXPECT(gdo.travel.state == DoorTravel::State::CLOSED);
+    EXPECT(gdo.stats.commands == 3);
+    EXPECT(gdo.stats.rejected == 0);
+}
+
+static void test_rolling_codes_across_reboots()
+{
+    host::Bus bus;
+    Secplus2Gdo gdo(bus);
+    gdo.openings = 10;
+    for (int boot = 0; boot < 4; boot++) {
+        // every other boot follows a power loss, without the last flash write
+        Board board(bus, boot == 0);
+        board.run(SYNC_START + 1000);
+        board.ratgdo.light_toggle();
+        board.run(200);
+        board.ratgdo.light_toggle();
+        board.run(200);
+        if (boot % 2 == 1) {
+            host::reboot(true);
+        }
+    }
+    std::printf("reboots: %u commands accepted, %u rejected\n", gdo.stats.commands, gdo.stats.rejected);
+    EXPECT(gdo.stats.commands == 8);
+    EXPECT(gdo.stats.rejected == 0);
+}
+
+static void test_motion_and_obstruction()
+{
+    host::Bus bus;
+    Secplus2Gdo gdo(bus);
+    gdo.openings = 10;
+    Board board(bus);
+    board.run(SYNC_START + 1000);
+
+    gdo.motion();
+    board.run(100);
+    EXPECT(board.published.motion == MotionState::DETECTED);
+    gdo.obstruction(true);
+    board.run(100);
+    EXPECT(board.published.obstruction == ObstructionState::OBSTRUCTED);
+    gdo.obstruction(false);
+    board.run(100);
+    EXPECT(board.published.obstruction == ObstructionState::CLEAR);
+}
+
+int main()
+{
+    test_sync();
+    test_open_and_close();
+    test_move_to_position();
+    test_unstarted_move_is_dropped();
+    test_close_while_opening();
+    test_rolling_codes_across_reboots();
+    test_motion_and_obstruction();
+    return report();
+}
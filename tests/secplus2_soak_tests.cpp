@@ -0,0 +1,260 @@
+// Years of a Sec+2 door in accelerated time against the real component.
+// The door cycles a few times a day, now and then closed while it is
+// still opening or through a noise burst on the line, the board reboots
+// and loses power every few weeks. Every cycle runs loop by loop, the
+// idle hours between them are skipped.
+//
+// millis() first wraps half a day in and every 49.7 days after, a cycle
+// runs across each wrap. The rolling code counter starts a few hundred
+// codes below 2^28 and the opener's openings below 65535. What must hold
+// all along: the published state follows the door, the position estimate
+// and the calibrated durations stay on the door's, and nothing
+// accumulates, pending door state continuations, scheduler timers or
+// heap blocks
+//
+//   secplus2_soak_tests [days]
+
+#include "gdo_secplus2.h"
+
+#include <cmath>
+#include <memory>
+#include <new>
+#include <random>
+
+using namespace host_board;
+
+static int64_t heap_blocks = 0; // live
+
+void* operator new(size_t size)
+{
+    if (void* p = std::malloc(size != 0 ? size : 1)) {
+        heap_blocks++;
+        return p;
+    }
+    throw std::bad_alloc();
+}
+void* operator new[](size_t size) { return operator new(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    void* p = std::malloc(size != 0 ? size : 1);
+    heap_blocks += p != nullptr;
+    return p;
+}
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept { return operator new(size, tag); }
+void operator delete(void* p) noexcept
+{
+    heap_blocks -= p != nullptr;
+    std::free(p);
+}
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+void operator delete[](void* p) noexcept { operator delete(p); }
+void operator delete[](void* p, size_t) noexcept { operator delete(p); }
+
+static const uint32_t DAYS = 2 * 365;
+static const uint32_t CYCLES_PER_DAY = 4;
+static const uint32_t REBOOT_DAYS = 20; // every other one a power loss
+static const uint32_t SETTLE = 15000; // ms after a cycle, past the continuations' deadline and the flash commit
+static const uint64_t MILLIS_WRAP = uint64_t(1) << 32; // ms
+static const uint64_t WRAP_LEAD = 5000; // ms from the start of a cycle to the wrap it crosses
+static const uint32_t WARNINGS_SHOWN = 10;
+
+class Soak {
+public:
+    Soak()
+        : gdo(bus)
+    {
+        // the first wrap comes on the first day
+        host::set_clock_us((MILLIS_WRAP - 12 * 3600 * 1000) * 1000);
+        this->start_ms = host::now_ms();
+        this->gdo.openings = UINT16_MAX - 40;
+        this->boot(true);
+        // before the first code goes out, the opener only takes codes ahead
+        this->board->ratgdo.set_rolling_code_counter(GDO_ROLLING_CODE_MASK + 1 - 300);
+        this->board->run(2000);
+    }
+
+    void boot(bool fresh)
+    {
+        this->board.reset();
+        this->board = std::make_unique<Board>(this->bus, fresh);
+        this->boot_cycles = 0;
+        auto& ratgdo = this->board->ratgdo;
+        ratgdo.subscribe_door_state([this](DoorState state, float position) {
+            this->max_busy_timers = std::max(this->max_busy_timers, App.scheduler.pending());
+            if ((state == DoorState::OPENING || state == DoorState::CLOSING) && position != DOOR_POSITION_UNKNOWN && this->calibrated()) {
+                this->max_position_error = std::max(this->max_position_error, std::fabs(position - this->gdo.travel.position_at(host::now_us())));
+            }
+        });
+        ratgdo.subscribe_rolling_code_counter([this](uint32_t counter) {
+            this->rolling_code_wraps += counter < this->rolling_code;
+            this->rolling_code = counter;
+        });
+    }
+
+    // both durations have seen enough runs to be trusted
+    bool calibrated() const
+    {
+        return this->runs >= 2 * DURATION_WEIGHT;
+    }
+
+    void day(uint32_t day)
+    {
+        for (uint32_t cycle = 0; cycle < CYCLES_PER_DAY; cycle++) {
+            this->idle(uint64_t(1 + this->rng() % 5) * 3600 * 1000);
+            this->cycle();
+        }
+        if (day % REBOOT_DAYS == REBOOT_DAYS - 1) {
+            bool power_loss = (day / REBOOT_DAYS) % 2 == 1;
+            if (power_loss) {
+                host::reboot(true);
+            }
+            this->boot(false);
+            this->reboots++;
+            this->board->run(2000);
+        }
+    }
+
+    // the wraps the clock went through, every one of them with a cycle across
+    uint32_t millis_wraps() const { return host::now_ms() / MILLIS_WRAP - this->start_ms / MILLIS_WRAP; }
+
+    void report(uint32_t days)
+    {
+        std::printf("soak: %u days, %u cycles (%u across one of %u millis() wraps), %u reboots, %u warnings\n", days, this->cycles,
+            this->wrapped_cycles, this->millis_wraps(), this->reboots, this->warnings);
+        std::printf("soak: rolling code wrapped %u times, openings %u, %u commands accepted, %u rejected\n",
+            this->rolling_code_wraps, this->board->published.openings, this->gdo.stats.commands, this->gdo.stats.rejected);
+        std::printf("soak: max position error %.3f, durations %.2fs/%.2fs (door %.2fs/%.2fs), max drift %.2fs\n",
+            this->max_position_error, *this->board->ratgdo.opening_duration, *this->board->ratgdo.closing_duration,
+            this->gdo.travel.opening_time / 1e6, this->gdo.travel.closing_time / 1e6, this->max_duration_drift);
+        std::printf("soak: most continuations %zu, timers %zu settled at first, %zu at most, %zu while the door moved\n",
+            this->max_continuations, this->first_timers, this->max_timers, this->max_busy_timers);
+        std::printf("soak: heap blocks grew by %lld at most within a boot\n", (long long)this->max_heap_growth);
+    }
+
+    host::Bus bus;
+    Secplus2Gdo gdo;
+    std::unique_ptr<Board> board;
+    std::mt19937 rng { 1 };
+
+    uint64_t start_ms;
+    uint32_t cycles { 0 };
+    uint32_t runs { 0 }; // full runs of the door, both directions
+    uint32_t wrapped_cycles { 0 };
+    uint32_t reboots { 0 };
+    uint32_t warnings { 0 };
+    uint32_t rolling_code { 0 };
+    uint32_t rolling_code_wraps { 0 };
+    float max_position_error { 0 };
+    float max_duration_drift { 0 };
+    size_t max_continuations { 0 };
+    size_t first_timers { 0 };
+    size_t max_timers { 0 }; // settled
+    size_t max_busy_timers { 0 };
+    // a host reboot leaves the old component's protocol behind, a device
+    // never frees it either: the heap is compared within a boot
+    uint32_t boot_cycles { 0 };
+    int64_t boot_heap_blocks { 0 };
+    int64_t max_heap_growth { 0 };
+
+protected:
+    // skips ms of an idle door, a cycle that would start within a minute
+    // of a millis() wrap starts just before it instead, to cross it
+    void idle(uint64_t ms)
+    {
+        auto now = host::now_ms();
+        auto wrap = (now / MILLIS_WRAP + 1) * MILLIS_WRAP;
+        if (now + ms + 60000 >= wrap && now + WRAP_LEAD < wrap) {
+            ms = wrap - WRAP_LEAD - now;
+            this->wrapped_cycles++;
+        }
+        host::set_clock_us((now + ms) * 1000);
+        this->board->run(1000);
+    }
+
+    void cycle()
+    {
+        auto& board = *this->board;
+        auto& ratgdo = board.ratgdo;
+        bool interrupted = this->rng() % 8 == 0;
+        // a lost OPENING would leave the close with nothing to stop
+        bool noisy = !interrupted && this->rng() % 8 == 0;
+        uint16_t openings = this->gdo.openings;
+        this->cycles++;
+
+        if (noisy) {
+            // the frames of the opening run are garbled or lost, after the
+            // command went out: a lost command is the user's to repeat
+            this->bus.noise(host::now_us() + 1000000, 2000000, 100);
+        }
+        ratgdo.door_open();
+        if (interrupted) {
+            // closed while opening: a stop, then the close once stopped
+            board.run(4000);
+            ratgdo.door_close();
+            this->max_continuations = std::max(this->max_continuations, ratgdo.on_door_state_.size());
+            board.run_until([&board] { return board.published.door == DoorState::CLOSED; }, 30000);
+        } else {
+            board.run_until([&board] { return board.published.door == DoorState::OPEN; }, 30000);
+            EXPECT(board.published.door == DoorState::OPEN);
+            EXPECT(board.published.position == 1.0f);
+            board.run(30000);
+            ratgdo.door_close();
+            board.run_until([&board] { return board.published.door == DoorState::CLOSED; }, 30000);
+            this->runs += 2;
+        }
+        EXPECT(board.published.door == DoorState::CLOSED);
+        EXPECT(board.published.position == 0.0f);
+        EXPECT(this->gdo.travel.state == DoorTravel::State::CLOSED);
+        EXPECT(this->gdo.travel.cycles == this->cycles);
+
+        board.run(SETTLE);
+        EXPECT(this->gdo.openings == uint16_t(openings + 1));
+        EXPECT(board.published.openings == this->gdo.openings);
+        EXPECT(ratgdo.on_door_state_.size() == 0);
+        if (this->calibrated()) {
+            float opening = std::fabs(*ratgdo.opening_duration - this->gdo.travel.opening_time / 1e6f);
+            float closing = std::fabs(*ratgdo.closing_duration - this->gdo.travel.closing_time / 1e6f);
+            this->max_duration_drift = std::max({ this->max_duration_drift, opening, closing });
+        }
+
+        // settled after a cycle, the board holds what it held after the first
+        auto timers = App.scheduler.pending();
+        if (this->cycles == 1) {
+            this->first_timers = timers;
+        }
+        this->max_timers = std::max(this->max_timers, timers);
+        if (this->boot_cycles++ == 0) {
+            this->boot_heap_blocks = heap_blocks;
+        }
+        this->max_heap_growth = std::max(this->max_heap_growth, heap_blocks - this->boot_heap_blocks);
+    }
+};
+
+int main(int argc, char** argv)
+{
+    uint32_t days = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : DAYS;
+    Soak soak;
+    // the warnings of years would drown the report, the first ones show
+    host::set_log_hook([&soak](int, const char* tag, const char* message) {
+        if (soak.warnings++ < WARNINGS_SHOWN) {
+            std::printf("[%s] %s\n", tag, message);
+        }
+    });
+    for (uint32_t day = 0; day < days; day++) {
+        soak.day(day);
+    }
+    soak.report(days);
+
+    EXPECT(soak.millis_wraps() > 0);
+    EXPECT(soak.wrapped_cycles == soak.millis_wraps());
+    EXPECT(days < 30 || soak.rolling_code_wraps == 1);
+    EXPECT(soak.gdo.stats.rejected == 0);
+    EXPECT(soak.max_position_error < 0.02f);
+    EXPECT(soak.max_duration_drift < 0.15f);
+    EXPECT(days < 30 || soak.max_continuations == 1);
+    EXPECT(soak.max_timers == soak.first_timers);
+    // the high-water marks of the containers, a block leaked per cycle
+    // would be thousands
+    EXPECT(soak.max_heap_growth <= 4);
+    return report();
+}
@@ -0,0 +1,216 @@
+// Sec+2 through the real component: frames on the wire are decoded by
+// Secplus2, handled, and published to the subscribers, commands go out as
+// frames the opener decodes
+
+#include "host_board.h"
+#include "secplus2_wire.h"
+
+using namespace host_board;
+
+static const uint8_t STATUS_LIGHT = 1 << 1; // byte2
+static const uint8_t STATUS_LOCK = 1 << 0; // byte2
+static const uint8_t STATUS_OBSTRUCTION_CLEAR = 1 << 6; // byte1
+
+static void test_status_reaches_subscribers()
+{
+    host::Bus bus;
+    Board board(bus);
+    Secplus2Wire gdo(bus);
+    run_for(50);
+
+    gdo.send(CommandType::STATUS, static_cast<uint8_t>(DoorState::OPEN), STATUS_OBSTRUCTION_CLEAR, STATUS_LIGHT | STATUS_LOCK);
+    run_for(30);
+    EXPECT(board.published.door == DoorState::OPEN);
+    EXPECT(board.published.position == 1.0f);
+    EXPECT(board.published.light == LightState::ON);
+    EXPECT(board.published.lock == LockState::LOCKED);
+    EXPECT(board.published.obstruction == ObstructionState::CLEAR);
+
+    gdo.send(CommandType::STATUS, static_cast<uint8_t>(DoorState::CLOSING), STATUS_OBSTRUCTION_CLEAR, 0);
+    run_for(30);
+    EXPECT(board.published.door == DoorState::CLOSING);
+    EXPECT(board.published.light == LightState::OFF);
+    EXPECT(board.published.lock == LockState::UNLOCKED);
+}
+
+static void test_button_edges_are_published()
+{
+    host::Bus bus;
+    Board board(bus);
+    Secplus2Wire gdo(bus);
+    run_for(50);
+
+    // press and release back to back land in the same loop
+    auto end = gdo.send(CommandType::DOOR_ACTION, static_cast<uint8_t>(DoorAction::TOGGLE), 1, 1);
+    gdo.send_at(end, CommandType::DOOR_ACTION, static_cast<uint8_t>(DoorAction::TOGGLE), 0, 1);
+    host::set_clock_us(end + 25000);
+    App.loop();
+    EXPECT(board.published.button_presses == 1);
+    EXPECT(board.published.button_releases == 1);
+}
+
+static void test_openings_and_paired_devices()
+{
+    host::Bus bus;
+    Board board(bus);
+    Secplus2Wire gdo(bus);
+    run_for(50);
+
+    gdo.send(CommandType::OPENINGS, 0, 0x01, 0x2c);
+    run_for(30);
+    EXPECT(board.published.openings == 300);
+
+    gdo.send(CommandType::PAIRED_DEVICES, static_cast<uint8_t>(PairedDevice::ALL), 0, 7);
+    run_for(30);
+    EXPECT(board.published.paired_total == 7);
+}
+
+static void test_motion_and_motor()
+{
+    host::Bus bus;
+    Board board(bus);
+    Secplus2Wire gdo(bus);
+    run_for(50);
+
+    gdo.send(CommandType::MOTOR_ON);
+    run_for(30);
+    EXPECT(board.published.motor == MotorState::ON);
+
+    gdo.send(CommandType::MOTION);
+    run_for(30);
+    EXPECT(board.published.motion == MotionState::DETECTED);
+}
+
+static void test_burst_is_drained_in_one_loop()
+{
+    host::Bus bus;
+    Board board(bus);
+    Secplus2Wire gdo(bus);
+    run_for(50);
+
+    // what the opener sends after a close, all buffered before the next
+    // loop, three frames fit the 64 byte receive buffer
+    auto at = host::now_us();
+    at = gdo.send_at(at, CommandType::STATUS, static_cast<uint8_t>(DoorState::CLOSED), STATUS_OBSTRUCTION_CLEAR, STATUS_LIGHT);
+    at = gdo.send_at(at, CommandType::LIGHT, static_cast<uint8_t>(LightAction::ON));
+    at = gdo.send_at(at, CommandType::MOTION);
+    host::set_clock_us(at + 1000);
+    App.loop();
+    EXPECT(board.published.door == DoorState::CLOSED);
+    EXPECT(board.published.light == LightState::ON);
+    EXPECT(board.published.motion == MotionState::DETECTED);
+    EXPECT(board.serial->bytes_overflowed() == 0);
+}
+
+static void test_own_and_corrupt_frames_are_dropped()
+{
+    host::Bus bus;
+    Board board(bus);
+    Secplus2Wire gdo(bus);
+    run_for(50);
+
+    // a frame carrying the ratgdo's own client ID is an echo of its own command
+    gdo.send_at(host::now_us(), CommandType::STATUS, static_cast<uint8_t>(DoorState::OPEN), 0, 0, 0x539);
+    run_for(30);
+    EXPECT(board.published.door == DoorState::UNKNOWN);
+
+    WirePacket packet;
+    encode_frame(CommandType::STATUS, static_cast<uint8_t>(DoorState::OPEN), 0, 0, 0x200, GDO_ID, packet);
+    packet[10] ^= 0x10;
+    gdo.send_raw(packet, PACKET_LENGTH, host::now_us());
+    run_for(30);
+    EXPECT(board.published.door == DoorState::UNKNOWN);
+
+    // the framer is back in sync for the next frame
+    gdo.send(CommandType::STATUS, static_cast<uint8_t>(DoorState::OPEN));
+    run_for(30);
+    EXPECT(board.published.door == DoorState::OPEN);
+}
+
+static void test_partial_frame_is_discarded()
+{
+    host::Bus bus;
+    Board board(bus);
+    Secplus2Wire gdo(bus);
+    run_for(50);
+
+    WirePacket packet;
+    encode_frame(CommandType::STATUS, static_cast<uint8_t>(DoorState::OPEN), 0, 0, 0x200, GDO_ID, packet);
+    gdo.send_raw(packet, 10, host::now_us());
+    // the rest never comes, the next frame starts after the 100ms timeout
+    run_for(150);
+    gdo.send(CommandType::STATUS, static_cast<uint8_t>(DoorState::CLOSED));
+    run_for(30);
+    EXPECT(board.published.door == DoorState::CLOSED);
+}
+
+static void test_door_command_goes_out()
+{
+    host::Bus bus;
+    Board board(bus);
+    Secplus2Wire gdo(bus);
+    run_for(50);
+    gdo.frames();
+
+    board.ratgdo.door_open();
+    run_for(100);
+    auto press = gdo.frames();
+    EXPECT(press.size() == 1);
+    if (press.size() == 1) {
+        EXPECT(press[0].type() == CommandType::DOOR_ACTION);
+        EXPECT(press[0].nibble() == static_cast<uint8_t>(DoorAction::OPEN));
+        EXPECT(press[0].byte1() == 1);
+        EXPECT(press[0].id() == 0x539);
+    }
+    // the release follows 150ms after the press went out, with the same
+    // rolling code since the press doesn't increment it
+    run_for(150);
+    auto release = gdo.frames();
+    EXPECT(release.size() == 1);
+    if (press.size() == 1 && release.size() == 1) {
+        EXPECT(release[0].type() == CommandType::DOOR_ACTION);
+        EXPECT(release[0].byte1() == 0);
+        EXPECT(release[0].rolling == press[0].rolling);
+    }
+    EXPECT(gdo.undecodable() == 0);
+}
+
+static void test_sync_queries_and_rolling_codes()
+{
+    host::Bus bus;
+    Board board(bus);
+    Secplus2Wire gdo(bus);
+
+    // sync starts a second after setup with the status query
+    run_for(1100);
+    auto frames = gdo.frames();
+    EXPECT(frames.size() >= 1);
+    if (frames.size() >= 1) {
+        EXPECT(frames[0].type() == CommandType::GET_STATUS);
+    }
+    uint32_t rolling = frames.size() >= 1 ? frames[0].rolling : 0;
+    gdo.send(CommandType::STATUS, static_cast<uint8_t>(DoorState::CLOSED), STATUS_OBSTRUCTION_CLEAR);
+    run_for(600);
+    frames = gdo.frames();
+    EXPECT(frames.size() >= 1);
+    for (const auto& frame : frames) {
+        EXPECT(frame.rolling > rolling);
+        EXPECT(frame.type() != CommandType::GET_STATUS);
+        rolling = frame.rolling;
+    }
+    EXPECT(board.published.door == DoorState::CLOSED);
+}
+
+int main()
+{
+    test_status_reaches_subscribers();
+    test_button_edges_are_published();
+    test_openings_and_paired_devices();
+    test_motion_and_motor();
+    test_burst_is_drained_in_one_loop();
+    test_own_and_corrupt_frames_are_dropped();
+    test_partial_frame_is_discarded();
+    test_door_command_goes_out();
+    test_sync_queries_and_rolling_codes();
+    return report();
+}
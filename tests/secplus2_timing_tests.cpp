@@ -0,0 +1,303 @@
+// Sec+2 timing on the virtual clock: the board runs at the device's loop
+// pace with the idle time skipped, so the timeouts, backoffs and fallbacks
+// of minutes of operation are checked against their nominal times
+
+#include "gdo_secplus2.h"
+
+#include <cmath>
+
+using namespace host_board;
+
+static const uint32_t SYNC_START = 1000; // ms after setup
+static const uint8_t STATUS_OBSTRUCTION_CLEAR = 1 << 6; // byte1
+
+static bool synced(RATGDOComponent& ratgdo)
+{
+    return *ratgdo.door_state != DoorState::UNKNOWN && *ratgdo.openings != 0
+        && *ratgdo.paired_total != PAIRED_DEVICES_UNKNOWN && *ratgdo.paired_remotes != PAIRED_DEVICES_UNKNOWN
+        && *ratgdo.paired_keypads != PAIRED_DEVICES_UNKNOWN && *ratgdo.paired_wall_controls != PAIRED_DEVICES_UNKNOWN
+        && *ratgdo.paired_accessories != PAIRED_DEVICES_UNKNOWN;
+}
+
+static void test_sync_backs_off_then_fails()
+{
+    host::Bus bus;
+    Board board(bus);
+    Secplus2Wire gdo(bus);
+    auto start = host::now_ms() + SYNC_START;
+    std::vector<uint32_t> delays;
+    App.scheduler.trace = [&delays](const std::string& name, uint32_t delay) {
+        if (name == "sync") {
+            delays.push_back(delay);
+        }
+    };
+
+    board.run(SYNC_START + secplus2::SYNC_TIMEOUT + 10000);
+
+    // the rounds grow by SYNC_BACKOFF every third one
+    uint32_t expected = secplus2::SYNC_QUERY_DELAY;
+    for (size_t i = 0; i < delays.size(); i++) {
+        if (i % 3 == 0) {
+            expected *= secplus2::SYNC_BACKOFF;
+        }
+        EXPECT(delays[i] == expected);
+    }
+    EXPECT(delays.size() >= 12);
+
+    // failed in the first round past SYNC_TIMEOUT
+    EXPECT(board.published.sync_failed);
+    auto failed = board.published.sync_failed_at / 1000 - start;
+    EXPECT(failed > secplus2::SYNC_TIMEOUT);
+    EXPECT(!delays.empty() && failed <= secplus2::SYNC_TIMEOUT + delays.back() + host::LOOP_INTERVAL / 1000);
+
+    // the status is queried less and less often
+    uint32_t early = 0;
+    uint32_t late = 0;
+    for (const auto& frame : gdo.frames()) {
+        if (frame.type() != CommandType::GET_STATUS) {
+            continue;
+        }
+        auto at = frame.end / 1000 - start;
+        if (at < 10000) {
+            early++;
+        } else if (at >= 20000 && at < 30000) {
+            late++;
+        }
+    }
+    EXPECT(early > late);
+    EXPECT(late > 0);
+}
+
+static void test_sync_completes_quickly()
+{
+    host::Bus bus;
+    Board board(bus);
+    Secplus2Gdo gdo(bus);
+    gdo.openings = 300;
+    board.run(SYNC_START);
+
+    auto took = board.run_until([&board] { return synced(board.ratgdo); }, 10000);
+    EXPECT(synced(board.ratgdo));
+    // seven queries and their answers, each about 20ms on the wire
+    EXPECT(took < 1000);
+    board.run(secplus2::SYNC_TIMEOUT + 5000);
+    EXPECT(!board.published.sync_failed);
+    EXPECT(gdo.undecodable() == 0);
+}
+
+static void test_unanswered_query_is_retried()
+{
+    host::Bus bus;
+    Board board(bus);
+    Secplus2Gdo gdo(bus);
+    gdo.openings = 300;
+    board.run(SYNC_START + 2000);
+    EXPECT(synced(board.ratgdo));
+    gdo.frames();
+
+    // the opener stops answering, a status query is sent QUERY_RETRIES
+    // more times QUERY_TIMEOUT apart
+    bus.detach(&gdo);
+    Secplus2Wire silent(bus);
+    board.ratgdo.query_status();
+    board.run(secplus2::QUERY_TIMEOUT * (secplus2::QUERY_RETRIES + 2));
+    std::vector<uint64_t> sent;
+    for (const auto& frame : silent.frames()) {
+        if (frame.type() == CommandType::GET_STATUS) {
+            sent.push_back(frame.end / 1000);
+        }
+    }
+    EXPECT(sent.size() == 1 + secplus2::QUERY_RETRIES);
+    for (size_t i = 1; i < sent.size(); i++) {
+        EXPECT(sent[i] - sent[i - 1] >= secplus2::QUERY_TIMEOUT);
+        EXPECT(sent[i] - sent[i - 1] <= secplus2::QUERY_TIMEOUT + host::LOOP_INTERVAL / 1000 + 30);
+    }
+}
+
+static void test_sending_blocks_the_loop()
+{
+    host::Bus bus;
+    Board board(bus);
+    Secplus2Gdo gdo(bus);
+    gdo.openings = 300;
+    board.run(SYNC_START + 2000);
+    EXPECT(synced(board.ratgdo));
+
+    // the break, its stop bit and the 19 bytes at 9600 baud go out in
+    // one loop, the loops waiting for the idle line return right away
+    board.ratgdo.light_toggle();
+    uint64_t longest = 0;
+    uint32_t loops = 0;
+    while (gdo.stats.commands == 0 && loops++ < 1000) {
+        auto start = host::now_us();
+        App.loop();
+        longest = std::max(longest, host::now_us() - start);
+        host::set_clock_us(host::now_us() + host::HIGH_FREQUENCY_LOOP_TIME);
+        bus.poll(host::now_us());
+    }
+    EXPECT(gdo.stats.commands == 1);
+    const uint64_t frame = secplus2::BUS_IDLE_TIME + 130 + secplus2::PACKET_LENGTH * board.serial->byte_time();
+    std::printf("sending: longest loop %lluus\n", (unsigned long long)longest);
+    EXPECT(longest >= frame && longest < frame + 100);
+}
+
+// two doors on one board: the first holds its command while a frame
+// from the second door's opener arrives, sending then would lose its bytes
+static void test_send_waits_for_the_other_door()
+{
+    host::Bus bus_a;
+    host::Bus bus_b;
+    Secplus2Wire gdo_a(bus_a);
+    Secplus2Wire gdo_b(bus_b);
+    Board a(bus_a);
+    Board b(bus_b, false, 10);
+    a.run(50);
+
+    auto end = gdo_b.send(CommandType::MOTION);
+    a.run(5);
+    a.ratgdo.light_toggle();
+    a.run(100);
+    EXPECT(b.published.motion == MotionState::DETECTED);
+    auto frames = gdo_a.frames();
+    EXPECT(frames.size() == 1);
+    if (!frames.empty()) {
+        auto start = frames[0].end - secplus2::PACKET_LENGTH * a.serial->byte_time();
+        std::printf("two doors: sent %lluus after the other door's frame\n", (unsigned long long)(start - end));
+        EXPECT(start >= end);
+        EXPECT(start <= end + secplus2::BUS_IDLE_TIME + host::LOOP_INTERVAL + 1000);
+    }
+}
+
+static void test_motion_clears_after_3s()
+{
+    host::Bus bus;
+    Board board(bus);
+    Secplus2Wire gdo(bus);
+    board.run(50);
+
+    uint64_t detected = 0;
+    uint64_t cleared = 0;
+    board.ratgdo.subscribe_motion_state([&](MotionState state) {
+        (state == MotionState::DETECTED ? detected : cleared) = host::now_ms();
+    });
+    auto end = gdo.send(CommandType::MOTION) / 1000;
+    board.run(5000);
+    EXPECT(detected >= end && detected <= end + host::LOOP_INTERVAL / 1000);
+    EXPECT(cleared - detected >= 3000 && cleared - detected <= 3000 + host::LOOP_INTERVAL / 1000);
+    EXPECT(board.published.motion == MotionState::CLEAR);
+}
+
+static void test_door_query_state_fallback()
+{
+    host::Bus bus;
+    Board board(bus);
+    Secplus2Gdo gdo(bus);
+    gdo.openings = 300;
+    gdo.travel.opening_time = 10000000;
+    gdo.drop = { CommandType::STATUS };
+    board.run(50);
+    board.ratgdo.set_opening_duration(10);
+    gdo.send(CommandType::STATUS, static_cast<uint8_t>(DoorState::CLOSED), STATUS_OBSTRUCTION_CLEAR);
+    board.run(SYNC_START + 1000);
+    EXPECT(board.published.door == DoorState::CLOSED);
+    EXPECT(synced(board.ratgdo));
+
+    // the opener moves the door but its status frames are lost, past the
+    // travel time and margin the door is assumed open and queried
+    auto start = host::now_ms();
+    board.ratgdo.door_open();
+    board.run_until([&board] { return board.published.door == DoorState::OPEN; }, 20000);
+    EXPECT(board.published.door == DoorState::OPEN);
+    auto assumed = host::now_ms() - start;
+    EXPECT(assumed >= 12000 && assumed <= 12000 + host::LOOP_INTERVAL / 1000);
+
+    auto queries = gdo.stats.queries;
+    board.run(200);
+    EXPECT(gdo.stats.queries == queries + 1);
+}
+
+static void test_position_reports_follow_the_interval()
+{
+    host::Bus bus;
+    Board board(bus);
+    Secplus2Wire gdo(bus);
+    board.run(50);
+    board.ratgdo.set_opening_duration(10);
+    gdo.send(CommandType::STATUS, static_cast<uint8_t>(DoorState::CLOSED), STATUS_OBSTRUCTION_CLEAR);
+    board.run(100);
+
+    std::vector<std::pair<uint64_t, float>> reports;
+    board.ratgdo.subscribe_door_state([&reports](DoorState state, float position) {
+        if (state == DoorState::OPENING) {
+            reports.emplace_back(host::now_ms(), position);
+        }
+    });
+    gdo.send(CommandType::STATUS, static_cast<uint8_t>(DoorState::OPENING), STATUS_OBSTRUCTION_CLEAR);
+    board.run(5000);
+
+    // every 500ms on the estimate of a 10s travel, late by up to a loop
+    // interval and a sync query the loop blocks sending
+    EXPECT(reports.size() >= 9);
+    for (size_t i = 2; i < reports.size(); i++) {
+        EXPECT(reports[i].first - reports[i - 1].first >= 500);
+        EXPECT(reports[i].first - reports[i - 1].first <= 500 + host::LOOP_INTERVAL / 1000 + 25);
+        EXPECT(reports[i].second > reports[i - 1].second);
+    }
+    if (!reports.empty()) {
+        float expected = (reports.back().first - reports.front().first) / 10000.0f;
+        EXPECT(std::fabs(reports.back().second - expected) < 0.01f);
+    }
+}
+
+// the sensor pulses LOW every 7ms while clear, stops pulsing HIGH when
+// obstructed and LOW when asleep
+static uint64_t pulse_obstruction_sensor(Board& board, int pulses)
+{
+    auto* obst = host::pin(INPUT_OBST);
+    for (int i = 0; i < pulses; i++) {
+        obst->set_level(false);
+        host::set_clock_us(host::now_us() + 500);
+        obst->set_level(true);
+        board.run(7);
+    }
+    return host::now_us();
+}
+
+static void test_obstruction_follows_the_pulses()
+{
+    host::Bus bus;
+    Board board(bus);
+    board.run(1000);
+    pulse_obstruction_sensor(board, 20);
+    EXPECT(board.published.obstruction == ObstructionState::CLEAR);
+
+    // reported OBSTRUCTED once the train has been missing for OBST_MISSING_MIN,
+    // the 50ms the line may take to decay after the sensor falls asleep
+    auto last = pulse_obstruction_sensor(board, 20) - 7000;
+    board.run_until([&board] { return board.published.obstruction == ObstructionState::OBSTRUCTED; }, 1000);
+    auto took = (host::now_us() - last) / 1000;
+    std::printf("obstruction: reported %llums after the last pulse\n", (unsigned long long)took);
+    EXPECT(board.published.obstruction == ObstructionState::OBSTRUCTED);
+    EXPECT(took >= OBST_MISSING_MIN / 1000 && took <= OBST_MISSING_MIN / 1000 + host::LOOP_INTERVAL / 1000 + 1);
+
+    // a line going LOW is the sensor falling asleep
+    pulse_obstruction_sensor(board, 20);
+    EXPECT(board.published.obstruction == ObstructionState::CLEAR);
+    host::pin(INPUT_OBST)->set_level(false);
+    board.run(2000);
+    EXPECT(board.published.obstruction == ObstructionState::CLEAR);
+}
+
+int main()
+{
+    test_sync_backs_off_then_fails();
+    test_sync_completes_quickly();
+    test_unanswered_query_is_retried();
+    test_sending_blocks_the_loop();
+    test_send_waits_for_the_other_door();
+    test_motion_clears_after_3s();
+    test_door_query_state_fallback();
+    test_position_reports_follow_the_interval();
+    test_obstruction_follows_the_pulses();
+    return report();
+}
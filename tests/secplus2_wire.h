@@ -0,0 +1,118 @@
+#pragma once
+// The opener's end of a Sec+2 line: sends frames onto a host::Bus and
+// reassembles the frames the ratgdo sent
+
+#include "secplus2.h"
+
+#include "host.h"
+
+#include <vector>
+
+extern "C" {
+#include "secplus.h"
+}
+
+namespace host_board {
+
+using esphome::ratgdo::secplus2::CommandType;
+using esphome::ratgdo::secplus2::PACKET_LENGTH;
+using esphome::ratgdo::secplus2::WirePacket;
+
+const uint32_t GDO_ID = 0x2c5a1d; // fixed field of the opener's own frames
+
+struct Frame {
+    uint32_t rolling;
+    uint64_t fixed;
+    uint32_t data;
+    uint64_t end; // us, when its last byte arrived
+
+    uint16_t command() const { return ((this->fixed >> 24) & 0xf00) | (this->data & 0xff); }
+    CommandType type() const { return static_cast<CommandType>(this->command()); }
+    uint8_t nibble() const { return (this->data >> 8) & 0xf; }
+    uint8_t byte1() const { return (this->data >> 16) & 0xff; }
+    uint8_t byte2() const { return (this->data >> 24) & 0xff; }
+    uint32_t id() const { return this->fixed & 0xffffffff; }
+};
+
+inline void encode_frame(CommandType type, uint8_t nibble, uint8_t byte1, uint8_t byte2, uint32_t rolling, uint32_t id, WirePacket& packet)
+{
+    uint16_t cmd = static_cast<uint16_t>(type);
+    uint64_t fixed = (uint64_t(cmd & ~0xff) << 24) | id;
+    uint32_t data = (uint32_t(byte2) << 24) | (uint32_t(byte1) << 16) | (uint32_t(nibble) << 8) | (cmd & 0xff);
+    encode_wireline(rolling, fixed, data, packet);
+}
+
+class Secplus2Wire : public esphome::host::SerialEndpoint {
+public:
+    explicit Secplus2Wire(esphome::host::Bus& bus)
+        : bus_(bus)
+    {
+        this->configure(9600, false);
+        this->echo = false;
+        bus.attach(this);
+    }
+
+    // returns when the frame has been sent, us
+    uint64_t send(CommandType type, uint8_t nibble = 0, uint8_t byte1 = 0, uint8_t byte2 = 0)
+    {
+        return this->send_at(esphome::host::now_us(), type, nibble, byte1, byte2);
+    }
+
+    uint64_t send_at(uint64_t at, CommandType type, uint8_t nibble = 0, uint8_t byte1 = 0, uint8_t byte2 = 0, uint32_t id = GDO_ID)
+    {
+        WirePacket packet;
+        encode_frame(type, nibble, byte1, byte2, this->rolling_++, id, packet);
+        return this->bus_.send(this, packet, PACKET_LENGTH, at);
+    }
+
+    uint64_t send_raw(const uint8_t* data, size_t len, uint64_t at)
+    {
+        return this->bus_.send(this, data, len, at);
+    }
+
+    // frames the ratgdo has finished sending by now, in order
+    std::vector<Frame> frames()
+    {
+        esphome::host::WireByte byte;
+        while (this->receive(byte)) {
+            this->window_ = ((this->window_ << 8) | byte.value) & 0xffffff;
+            if (this->length_ == 0) {
+                if (this->window_ == 0x550100) {
+                    this->packet_[0] = 0x55;
+                    this->packet_[1] = 0x01;
+                    this->packet_[2] = 0x00;
+                    this->length_ = 3;
+                }
+                continue;
+            }
+            this->packet_[this->length_++] = byte.value;
+            if (this->length_ == PACKET_LENGTH) {
+                this->length_ = 0;
+                this->window_ = 0;
+                Frame frame;
+                frame.end = byte.end;
+                if (decode_wireline(this->packet_, &frame.rolling, &frame.fixed, &frame.data) == 0) {
+                    this->received_.push_back(frame);
+                } else {
+                    this->undecodable_++;
+                }
+            }
+        }
+        auto frames = std::move(this->received_);
+        this->received_.clear();
+        return frames;
+    }
+
+    uint32_t undecodable() const { return this->undecodable_; }
+
+protected:
+    esphome::host::Bus& bus_;
+    uint32_t rolling_ { 0x100 };
+    uint32_t window_ { 0 };
+    uint8_t length_ { 0 };
+    WirePacket packet_;
+    std::vector<Frame> received_;
+    uint32_t undecodable_ { 0 };
+};
+
+} // namespace host_board
@@ -0,0 +1,66 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+
+#include "host.h"
+
+// Host stand-in for espsoftwareserial, an endpoint on a host::Bus. The
+// receive buffer holds 64 bytes like the library's default, write() blocks
+// the virtual clock for as long as the bytes take on the wire and, with
+// enableIntTx(false), turns interrupts off for the other software serials
+enum SoftwareSerialConfig {
+    SWSERIAL_8N1,
+    SWSERIAL_8E1,
+};
+
+class SoftwareSerial : public esphome::host::SerialEndpoint {
+public:
+    ~SoftwareSerial() override;
+
+    void begin(uint32_t baud, SoftwareSerialConfig config, int8_t rx_pin, int8_t tx_pin, bool invert, int buffer_capacity = 64);
+    void end();
+    void enableIntTx(bool on) { this->int_tx_ = on; }
+    void enableAutoBaud(bool on) { this->auto_baud_ = on; }
+
+    int available();
+    int read();
+    size_t write(uint8_t byte) { return this->write(&byte, 1); }
+    size_t write(const uint8_t* buffer, size_t size);
+    uint32_t baudRate() const { return this->baud(); }
+    bool readParity() const { return this->last_parity_; }
+    bool overflow();
+
+    static bool parityEven(uint8_t byte)
+    {
+        byte ^= byte >> 4;
+        byte &= 0xf;
+        return (0x6996 >> byte) & 1;
+    }
+
+    // host only
+    static SoftwareSerial* on_pin(int8_t rx_pin);
+    // ends every serial, part of a reboot
+    static void end_all();
+    int8_t rx_pin() const { return this->rx_pin_; }
+    int8_t tx_pin() const { return this->tx_pin_; }
+    bool int_tx() const { return this->int_tx_; }
+    uint32_t bytes_lost() const { return this->lost_; } // while interrupts were off
+    uint32_t bytes_overflowed() const { return this->overflowed_; }
+    uint32_t bytes_written() const { return this->written_; }
+
+protected:
+    void fill();
+
+    std::deque<esphome::host::WireByte> buffer_;
+    size_t capacity_ { 64 };
+    int8_t rx_pin_ { -1 };
+    int8_t tx_pin_ { -1 };
+    bool int_tx_ { true };
+    bool auto_baud_ { false };
+    bool last_parity_ { false };
+    bool overflow_ { false };
+    uint32_t lost_ { 0 };
+    uint32_t overflowed_ { 0 };
+    uint32_t written_ { 0 };
+};
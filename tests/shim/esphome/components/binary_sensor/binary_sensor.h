@@ -0,0 +1,31 @@
+#pragma once
+#include <functional>
+#include <utility>
+
+#include "esphome/core/helpers.h"
+
+namespace esphome {
+namespace binary_sensor {
+
+    class BinarySensor {
+    public:
+        void add_on_state_callback(std::function<void(bool)>&& callback) { this->state_callback_.add(std::move(callback)); }
+        void publish_state(bool state)
+        {
+            if (this->has_state_ && state == this->state) {
+                return;
+            }
+            this->has_state_ = true;
+            this->state = state;
+            this->state_callback_.call(state);
+        }
+
+        bool state { false };
+
+    protected:
+        bool has_state_ { false };
+        CallbackManager<void(bool)> state_callback_;
+    };
+
+} // namespace binary_sensor
+} // namespace esphome
@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "esphome/core/component.h"
+#include "esphome/core/scheduler.h"
+
+namespace esphome {
+
+class Application {
+public:
+    void register_component(Component* component) { this->components_.push_back(component); }
+    // sets up the components registered since the last call, a second
+    // board joins the running first one
+    void setup();
+    // one pass of the main loop: due timers, then every component's loop()
+    void loop();
+
+    uint32_t get_loop_component_start_time() const { return this->loop_start_; }
+
+    // A device reboots and never returns, on the host the preferences are
+    // synced like on a clean reboot and the request is counted, the test
+    // decides when to reboot the board with host::reboot()
+    void safe_reboot();
+    uint32_t reboot_requests() const { return this->reboot_requests_; }
+
+    // forgets the components and timers, the start of a reboot
+    void reset();
+
+    Scheduler scheduler;
+
+protected:
+    std::vector<Component*> components_;
+    size_t set_up_ { 0 };
+    uint32_t loop_start_ { 0 };
+    uint32_t reboot_requests_ { 0 };
+};
+
+extern Application App; // NOLINT
+
+} // namespace esphome
@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "esphome/core/hal.h"
+#include "esphome/core/helpers.h"
+#include "esphome/core/optional.h"
+
+namespace esphome {
+
+namespace setup_priority {
+    extern const float BUS;
+    extern const float IO;
+    extern const float HARDWARE;
+    extern const float DATA;
+    extern const float PROCESSOR;
+    extern const float AFTER_WIFI;
+} // namespace setup_priority
+
+class Component {
+public:
+    virtual ~Component() = default;
+
+    virtual void setup() { }
+    virtual void loop() { }
+    virtual void dump_config() { }
+    virtual float get_setup_priority() const { return 0; }
+
+protected:
+    void set_timeout(const std::string& name, uint32_t timeout, std::function<void()>&& f);
+    void set_timeout(uint32_t timeout, std::function<void()>&& f);
+    bool cancel_timeout(const std::string& name);
+    void set_interval(const std::string& name, uint32_t interval, std::function<void()>&& f);
+    void set_interval(uint32_t interval, std::function<void()>&& f);
+    bool cancel_interval(const std::string& name);
+    void defer(const std::string& name, std::function<void()>&& f);
+    void defer(std::function<void()>&& f);
+};
+
+} // namespace esphome
@@ -0,0 +1,4 @@
+#pragma once
+
+// The device build generates this from the configuration, on the host the
+// protocol and the RATGDO_* options are set per target in tests/CMakeLists.txt
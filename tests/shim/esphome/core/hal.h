@@ -0,0 +1,22 @@
+#pragma once
+#include <cinttypes>
+#include <cstdint>
+
+#define IRAM_ATTR
+#define ICACHE_RAM_ATTR
+#define HOT
+
+namespace esphome {
+
+// on the virtual clock of the host, see host.h
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+// wall clock nanoseconds, so profiling on the host measures the real work
+uint32_t arch_get_cpu_cycle_count();
+uint32_t arch_get_cpu_freq_hz();
+void arch_feed_wdt();
+
+} // namespace esphome
@@ -0,0 +1,77 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace esphome {
+
+template <typename T>
+const T& clamp(const T& value, const T& min, const T& max)
+{
+    return value < min ? min : max < value ? max : value;
+}
+
+uint32_t random_uint32();
+uint16_t crc16(const uint8_t* data, uint16_t len, uint16_t crc = 0xffff, uint16_t reverse_poly = 0xa001, bool refin = false, bool refout = false);
+uint32_t fnv1_hash(const std::string& str);
+std::string format_hex(const uint8_t* data, size_t length);
+
+template <typename T>
+class Parented {
+public:
+    Parented() { }
+    Parented(T* parent)
+        : parent_(parent)
+    {
+    }
+
+    T* get_parent() const { return this->parent_; }
+    void set_parent(T* parent) { this->parent_ = parent; }
+
+protected:
+    T* parent_ { nullptr };
+};
+
+// While any requester is started the loop runs back to back, the host
+// loop driver skips no time then
+class HighFrequencyLoopRequester {
+public:
+    void start();
+    void stop();
+    static bool is_high_frequency();
+    // host only, the requesters of a board are gone after a reboot
+    static void reset();
+
+protected:
+    bool started_ { false };
+    static uint8_t num_requests; // NOLINT
+};
+
+class InterruptLock {
+public:
+    InterruptLock() { }
+    ~InterruptLock() { }
+};
+
+template <typename... X>
+class CallbackManager;
+
+template <typename... Ts>
+class CallbackManager<void(Ts...)> {
+public:
+    void add(std::function<void(Ts...)>&& callback) { this->callbacks_.push_back(std::move(callback)); }
+    void call(Ts... args)
+    {
+        for (auto& cb : this->callbacks_) {
+            cb(args...);
+        }
+    }
+
+protected:
+    std::vector<std::function<void(Ts...)>> callbacks_;
+};
+
+} // namespace esphome
@@ -0,0 +1,12 @@
+#pragma once
+#include <optional>
+
+namespace esphome {
+
+template <typename T>
+class optional : public std::optional<T> {
+public:
+    using std::optional<T>::optional;
+};
+
+} // namespace esphome
@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "esphome/core/component.h"
+#include "esphome/core/optional.h"
+
+namespace esphome {
+
+// Timeouts and intervals per component and name on the virtual clock.
+// Like the device scheduler, a named timeout replaces the previous one of
+// the same component and name, anonymous ones ("") never replace anything,
+// and items added while call() runs are first run by the next call()
+class Scheduler {
+public:
+    void set_timeout(Component* component, const std::string& name, uint32_t timeout, std::function<void()> func);
+    bool cancel_timeout(Component* component, const std::string& name);
+    void set_interval(Component* component, const std::string& name, uint32_t interval, std::function<void()> func);
+    bool cancel_interval(Component* component, const std::string& name);
+
+    // ms until the next item is due, none when nothing is scheduled
+    optional<uint32_t> next_schedule_in();
+    void call();
+
+    // host only
+    size_t pending() const;
+    size_t pending(const Component* component) const;
+    void clear();
+    // sees every timeout and interval added, with its name and delay in ms
+    std::function<void(const std::string& name, uint32_t delay)> trace;
+
+protected:
+    struct Item {
+        Component* component;
+        std::string name;
+        bool interval;
+        uint32_t period; // ms
+        uint64_t next; // ms on the 64 bit virtual clock
+        uint64_t id; // insertion order, breaks ties
+        std::function<void()> func;
+        bool removed;
+    };
+
+    void add(Component* component, const std::string& name, bool interval, uint32_t delay, std::function<void()>&& func);
+    bool cancel(Component* component, const std::string& name, bool interval);
+    void cleanup();
+
+    std::vector<std::unique_ptr<Item>> items_;
+    uint64_t next_id_ { 0 };
+};
+
+} // namespace esphome
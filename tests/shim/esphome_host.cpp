@@ -0,0 +1,611 @@
+#include "host.h"
+
+#include "SoftwareSerial.h"
+#include "esphome/core/application.h"
+#include "esphome/core/component.h"
+#include "esphome/core/hal.h"
+#include "esphome/core/helpers.h"
+#include "esphome/core/log.h"
+#include "esphome/core/preferences.h"
+#include "esphome/core/scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace esphome {
+
+/*************************** CLOCK ***************************/
+
+namespace host {
+
+    static uint64_t clock_us = 0;
+
+    uint64_t now_us() { return clock_us; }
+    uint64_t now_ms() { return clock_us / 1000; }
+    void advance_us(uint64_t us) { clock_us += us; }
+    void advance_ms(uint64_t ms) { clock_us += ms * 1000; }
+    void set_clock_us(uint64_t us) { clock_us = us; }
+
+} // namespace host
+
+uint32_t millis() { return static_cast<uint32_t>(host::clock_us / 1000); }
+uint32_t micros() { return static_cast<uint32_t>(host::clock_us); }
+void delay(uint32_t ms) { host::advance_ms(ms); }
+void delayMicroseconds(uint32_t us) { host::advance_us(us); }
+
+uint32_t arch_get_cpu_cycle_count()
+{
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+}
+uint32_t arch_get_cpu_freq_hz() { return 1000000000; }
+void arch_feed_wdt() { }
+
+/*************************** LOG ***************************/
+
+namespace host {
+
+    // ESPHOME_LOG_LEVEL=5 in the environment shows the debug log of a test
+    static int initial_log_level()
+    {
+        const char* level = getenv("ESPHOME_LOG_LEVEL");
+        return level != nullptr ? atoi(level) : ESPHOME_LOG_LEVEL_WARN;
+    }
+
+    int log_level = initial_log_level();
+    static LogHook log_hook;
+
+    void set_log_hook(LogHook hook) { log_hook = std::move(hook); }
+
+} // namespace host
+
+void esp_log_printf_(int level, const char* tag, int line, const char* format, ...)
+{
+    char message[512];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    if (host::log_hook) {
+        host::log_hook(level, tag, message);
+        return;
+    }
+    static const char letters[] = "-EWICDVV";
+    fprintf(stderr, "[%9.3f][%c][%s:%d]: %s\n", host::clock_us / 1e6, letters[level & 7], tag, line, message);
+}
+
+/*************************** HELPERS ***************************/
+
+uint32_t random_uint32()
+{
+    static uint32_t state = 0x12345678;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+uint16_t crc16(const uint8_t* data, uint16_t len, uint16_t crc, uint16_t reverse_poly, bool refin, bool refout)
+{
+    if (refin) {
+        crc ^= 0xffff;
+    }
+    while (len--) {
+        crc ^= *data++;
+        for (uint8_t i = 0; i < 8; i++) {
+            if (crc & 0x0001) {
+                crc = (crc >> 1) ^ reverse_poly;
+            } else {
+                crc >>= 1;
+            }
+        }
+    }
+    return refout ? (crc ^ 0xffff) : crc;
+}
+
+uint32_t fnv1_hash(const std::string& str)
+{
+    uint32_t hash = 2166136261UL;
+    for (char c : str) {
+        hash *= 16777619UL;
+        hash ^= c;
+    }
+    return hash;
+}
+
+std::string format_hex(const uint8_t* data, size_t length)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string result;
+    result.resize(length * 2);
+    for (size_t i = 0; i < length; i++) {
+        result[2 * i] = digits[data[i] >> 4];
+        result[2 * i + 1] = digits[data[i] & 0xf];
+    }
+    return result;
+}
+
+uint8_t HighFrequencyLoopRequester::num_requests = 0; // NOLINT
+
+void HighFrequencyLoopRequester::start()
+{
+    if (this->started_) {
+        return;
+    }
+    num_requests++;
+    this->started_ = true;
+}
+
+void HighFrequencyLoopRequester::stop()
+{
+    if (!this->started_) {
+        return;
+    }
+    num_requests--;
+    this->started_ = false;
+}
+
+bool HighFrequencyLoopRequester::is_high_frequency() { return num_requests > 0; }
+
+void HighFrequencyLoopRequester::reset() { num_requests = 0; }
+
+/*************************** SCHEDULER ***************************/
+
+static const uint32_t SCHEDULER_DONT_RUN = 4294967295UL;
+
+void Scheduler::add(Component* component, const std::string& name, bool interval, uint32_t delay, std::function<void()>&& func)
+{
+    if (!name.empty()) {
+        this->cancel(component, name, interval);
+    }
+    if (delay == SCHEDULER_DONT_RUN) {
+        return;
+    }
+    if (this->trace) {
+        this->trace(name, delay);
+    }
+    auto item = std::make_unique<Item>();
+    item->component = component;
+    item->name = name;
+    item->interval = interval;
+    item->period = delay;
+    item->next = host::now_ms() + delay;
+    item->id = this->next_id_++;
+    item->func = std::move(func);
+    item->removed = false;
+    this->items_.push_back(std::move(item));
+}
+
+bool Scheduler::cancel(Component* component, const std::string& name, bool interval)
+{
+    bool found = false;
+    for (auto& item : this->items_) {
+        if (!item->removed && item->component == component && item->interval == interval && item->name == name) {
+            item->removed = true;
+            found = true;
+        }
+    }
+    return found;
+}
+
+void Scheduler::set_timeout(Component* component, const std::string& name, uint32_t timeout, std::function<void()> func)
+{
+    this->add(component, name, false, timeout, std::move(func));
+}
+
+bool Scheduler::cancel_timeout(Component* component, const std::string& name)
+{
+    return this->cancel(component, name, false);
+}
+
+void Scheduler::set_interval(Component* component, const std::string& name, uint32_t interval, std::function<void()> func)
+{
+    this->add(component, name, true, interval, std::move(func));
+}
+
+bool Scheduler::cancel_interval(Component* component, const std::string& name)
+{
+    return this->cancel(component, name, true);
+}
+
+optional<uint32_t> Scheduler::next_schedule_in()
+{
+    uint64_t now = host::now_ms();
+    optional<uint32_t> next;
+    for (const auto& item : this->items_) {
+        if (item->removed) {
+            continue;
+        }
+        uint32_t in = item->next > now ? static_cast<uint32_t>(item->next - now) : 0;
+        if (!next || in < *next) {
+            next = in;
+        }
+    }
+    return next;
+}
+
+void Scheduler::call()
+{
+    // items added by the callbacks run from the next call on
+    const uint64_t last_id = this->next_id_;
+    while (true) {
+        uint64_t now = host::now_ms();
+        Item* due = nullptr;
+        for (auto& item : this->items_) {
+            if (item->removed || item->id >= last_id || item->next > now) {
+                continue;
+            }
+            if (due == nullptr || item->next < due->next || (item->next == due->next && item->id < due->id)) {
+                due = item.get();
+            }
+        }
+        if (due == nullptr) {
+            break;
+        }
+        if (due->interval) {
+            due->next = std::max(due->next + due->period, now);
+            // an interval runs at most once per call
+            due->id = this->next_id_++;
+            due->func();
+        } else {
+            due->removed = true;
+            auto func = std::move(due->func);
+            func();
+        }
+    }
+    this->cleanup();
+}
+
+void Scheduler::cleanup()
+{
+    this->items_.erase(std::remove_if(this->items_.begin(), this->items_.end(), [](const std::unique_ptr<Item>& item) { return item->removed; }),
+        this->items_.end());
+}
+
+size_t Scheduler::pending() const
+{
+    return std::count_if(this->items_.begin(), this->items_.end(), [](const std::unique_ptr<Item>& item) { return !item->removed; });
+}
+
+size_t Scheduler::pending(const Component* component) const
+{
+    return std::count_if(this->items_.begin(), this->items_.end(),
+        [component](const std::unique_ptr<Item>& item) { return !item->removed && item->component == component; });
+}
+
+void Scheduler::clear()
+{
+    this->items_.clear();
+    this->trace = nullptr;
+}
+
+/*************************** COMPONENT ***************************/
+
+namespace setup_priority {
+    const float BUS = 1000.0f;
+    const float IO = 900.0f;
+    const float HARDWARE = 800.0f;
+    const float DATA = 600.0f;
+    const float PROCESSOR = 400.0f;
+    const float AFTER_WIFI = 200.0f;
+} // namespace setup_priority
+
+void Component::set_timeout(const std::string& name, uint32_t timeout, std::function<void()>&& f)
+{
+    App.scheduler.set_timeout(this, name, timeout, std::move(f));
+}
+
+void Component::set_timeout(uint32_t timeout, std::function<void()>&& f)
+{
+    App.scheduler.set_timeout(this, "", timeout, std::move(f));
+}
+
+bool Component::cancel_timeout(const std::string& name)
+{
+    return App.scheduler.cancel_timeout(this, name);
+}
+
+void Component::set_interval(const std::string& name, uint32_t interval, std::function<void()>&& f)
+{
+    App.scheduler.set_interval(this, name, interval, std::move(f));
+}
+
+void Component::set_interval(uint32_t interval, std::function<void()>&& f)
+{
+    App.scheduler.set_interval(this, "", interval, std::move(f));
+}
+
+bool Component::cancel_interval(const std::string& name)
+{
+    return App.scheduler.cancel_interval(this, name);
+}
+
+void Component::defer(const std::string& name, std::function<void()>&& f)
+{
+    App.scheduler.set_timeout(this, name, 0, std::move(f));
+}
+
+void Component::defer(std::function<void()>&& f)
+{
+    App.scheduler.set_timeout(this, "", 0, std::move(f));
+}
+
+/*************************** APPLICATION ***************************/
+
+Application App; // NOLINT
+
+void Application::setup()
+{
+    auto first = this->components_.begin() + this->set_up_;
+    std::stable_sort(first, this->components_.end(),
+        [](Component* a, Component* b) { return a->get_setup_priority() > b->get_setup_priority(); });
+    for (auto it = first; it != this->components_.end(); ++it) {
+        (*it)->setup();
+    }
+    this->set_up_ = this->components_.size();
+}
+
+void Application::loop()
+{
+    this->loop_start_ = millis();
+    this->scheduler.call();
+    for (auto* component : this->components_) {
+        component->loop();
+    }
+}
+
+void Application::safe_reboot()
+{
+    this->reboot_requests_++;
+    global_preferences->sync();
+}
+
+void Application::reset()
+{
+    this->components_.clear();
+    this->set_up_ = 0;
+    this->scheduler.clear();
+    this->reboot_requests_ = 0;
+}
+
+/*************************** PINS ***************************/
+
+namespace host {
+
+    static std::map<uint8_t, HostGPIOPin*>& pins()
+    {
+        static std::map<uint8_t, HostGPIOPin*> pins;
+        return pins;
+    }
+
+    HostGPIOPin::HostGPIOPin(uint8_t pin, bool inverted)
+        : pin_(pin)
+        , inverted_(inverted)
+    {
+        pins()[pin] = this;
+    }
+
+    HostGPIOPin::~HostGPIOPin()
+    {
+        auto it = pins().find(this->pin_);
+        if (it != pins().end() && it->second == this) {
+            pins().erase(it);
+        }
+    }
+
+    bool HostGPIOPin::digital_read()
+    {
+        return this->read_hook ? this->read_hook() : this->level_;
+    }
+
+    void HostGPIOPin::digital_write(bool value)
+    {
+        this->level_ = value;
+        this->writes_++;
+        if (this->write_hook) {
+            this->write_hook(value);
+        }
+    }
+
+    std::string HostGPIOPin::dump_summary() const
+    {
+        return "GPIO" + std::to_string(this->pin_);
+    }
+
+    void HostGPIOPin::attach_interrupt(void (*func)(void*), void* arg, gpio::InterruptType type) const
+    {
+        this->isr_ = func;
+        this->isr_arg_ = arg;
+        this->isr_type_ = type;
+    }
+
+    void HostGPIOPin::detach_interrupt() const
+    {
+        this->isr_ = nullptr;
+        this->isr_arg_ = nullptr;
+    }
+
+    ISRInternalGPIOPin HostGPIOPin::to_isr() const
+    {
+        return ISRInternalGPIOPin(const_cast<HostGPIOPin*>(this));
+    }
+
+    void HostGPIOPin::set_level(bool level)
+    {
+        if (level == this->level_) {
+            return;
+        }
+        this->level_ = level;
+        if (this->isr_ == nullptr) {
+            return;
+        }
+        bool rising = level;
+        if (this->isr_type_ == gpio::INTERRUPT_ANY_EDGE || (rising && this->isr_type_ == gpio::INTERRUPT_RISING_EDGE)
+            || (!rising && this->isr_type_ == gpio::INTERRUPT_FALLING_EDGE)) {
+            this->isr_(this->isr_arg_);
+        }
+    }
+
+    HostGPIOPin* pin(uint8_t number)
+    {
+        auto it = pins().find(number);
+        return it != pins().end() ? it->second : nullptr;
+    }
+
+} // namespace host
+
+bool ISRInternalGPIOPin::digital_read()
+{
+    return static_cast<host::HostGPIOPin*>(this->arg_)->digital_read();
+}
+
+void ISRInternalGPIOPin::digital_write(bool value)
+{
+    static_cast<host::HostGPIOPin*>(this->arg_)->digital_write(value);
+}
+
+/*************************** PREFERENCES ***************************/
+
+namespace host {
+
+    class HostPreferenceBackend : public ESPPreferenceBackend {
+    public:
+        HostPreferenceBackend(HostPreferences* preferences, uint32_t key)
+            : preferences_(preferences)
+            , key_(key)
+        {
+        }
+
+        bool save(const uint8_t* data, size_t len) override
+        {
+            this->preferences_->ram_[this->key_].assign(data, data + len);
+            this->preferences_->saves_++;
+            return true;
+        }
+
+        bool load(uint8_t* data, size_t len) override
+        {
+            auto it = this->preferences_->ram_.find(this->key_);
+            if (it == this->preferences_->ram_.end() || it->second.size() != len) {
+                return false;
+            }
+            memcpy(data, it->second.data(), len);
+            return true;
+        }
+
+    protected:
+        HostPreferences* preferences_;
+        uint32_t key_;
+    };
+
+    ESPPreferenceObject HostPreferences::make_preference(size_t length, uint32_t type, bool in_flash)
+    {
+        auto& backend = this->backends_[type];
+        if (!backend) {
+            backend = std::make_unique<HostPreferenceBackend>(this, type);
+        }
+        return ESPPreferenceObject(backend.get());
+    }
+
+    ESPPreferenceObject HostPreferences::make_preference(size_t length, uint32_t type)
+    {
+        return this->make_preference(length, type, false);
+    }
+
+    bool HostPreferences::sync()
+    {
+        for (const auto& record : this->ram_) {
+            auto& stored = this->flash_[record.first];
+            if (stored != record.second) {
+                stored = record.second;
+                this->flash_writes_++;
+            }
+        }
+        return true;
+    }
+
+    bool HostPreferences::reset()
+    {
+        this->ram_.clear();
+        this->flash_.clear();
+        return true;
+    }
+
+    void HostPreferences::power_loss()
+    {
+        this->ram_ = this->flash_;
+    }
+
+    HostPreferences& preferences()
+    {
+        static HostPreferences preferences;
+        return preferences;
+    }
+
+} // namespace host
+
+ESPPreferences* global_preferences = &host::preferences(); // NOLINT
+
+/*************************** BOARD ***************************/
+
+namespace host {
+
+    // when the main loop next runs, kept across calls so that running in
+    // slices doesn't change the pace
+    static uint64_t next_loop = 0;
+
+    void reboot(bool power_loss)
+    {
+        if (power_loss) {
+            preferences().power_loss();
+        } else {
+            preferences().sync();
+        }
+        App.reset();
+        HighFrequencyLoopRequester::reset();
+        for (auto& entry : pins()) {
+            entry.second->detach_interrupt();
+        }
+        SoftwareSerial::end_all();
+        next_loop = 0;
+    }
+
+    uint32_t run_until(uint64_t until_us, Bus* bus)
+    {
+        uint32_t loops = 0;
+        while (now_us() < until_us) {
+            uint64_t next = until_us;
+            if (bus != nullptr) {
+                next = std::min(next, bus->poll(now_us()));
+            }
+            if (now_us() >= next_loop) {
+                App.loop();
+                loops++;
+                // a loop that blocked (a serial write) has moved the clock on
+                uint64_t sleep = HighFrequencyLoopRequester::is_high_frequency() ? HIGH_FREQUENCY_LOOP_TIME : LOOP_INTERVAL;
+                auto timer = App.scheduler.next_schedule_in();
+                if (timer.has_value()) {
+                    // the scheduler counts whole ms, wake at the start of the due one
+                    uint64_t due = (now_ms() + *timer) * 1000;
+                    sleep = std::min(sleep, due > now_us() ? due - now_us() : 0);
+                }
+                next_loop = now_us() + std::max<uint64_t>(sleep, 1);
+                if (bus != nullptr) {
+                    next = std::min(next, bus->poll(now_us()));
+                }
+            }
+            next = std::min(next, next_loop);
+            if (next > now_us()) {
+                set_clock_us(next);
+            }
+        }
+        return loops;
+    }
+
+} // namespace host
+
+} // namespace esphome
@@ -0,0 +1,225 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "esphome/core/gpio.h"
+#include "esphome/core/preferences.h"
+
+// Host side of the shim: the virtual clock behind millis()/micros(), pins
+// a test can drive, the serial line between the ratgdo and whatever is on
+// the other end, and preferences that survive a simulated reboot
+namespace esphome {
+namespace host {
+
+    /*************************** CLOCK ***************************/
+
+    // Time only moves when a test advances it or the code under test
+    // blocks (delayMicroseconds(), a serial write), so runs are deterministic
+    uint64_t now_us();
+    uint64_t now_ms();
+    void advance_us(uint64_t us);
+    void advance_ms(uint64_t ms);
+    // for starting right before the millis() or micros() wrap
+    void set_clock_us(uint64_t us);
+
+    /*************************** LOG ***************************/
+
+    using LogHook = std::function<void(int level, const char* tag, const char* message)>;
+    // replaces printing to stderr, an empty hook restores it
+    void set_log_hook(LogHook hook);
+
+    /*************************** PINS ***************************/
+
+    class HostGPIOPin : public InternalGPIOPin {
+    public:
+        explicit HostGPIOPin(uint8_t pin, bool inverted = false);
+        ~HostGPIOPin() override;
+
+        void setup() override { }
+        void pin_mode(gpio::Flags flags) override { this->flags_ = flags; }
+        bool digital_read() override;
+        void digital_write(bool value) override;
+        std::string dump_summary() const override;
+        void detach_interrupt() const override;
+        ISRInternalGPIOPin to_isr() const override;
+        uint8_t get_pin() const override { return this->pin_; }
+        bool is_inverted() const override { return this->inverted_; }
+
+        // drives an input from outside, runs the attached interrupt on an edge
+        void set_level(bool level);
+        bool level() const { return this->level_; }
+        gpio::Flags flags() const { return this->flags_; }
+        uint32_t writes() const { return this->writes_; }
+
+        // a read hook takes over digital_read(), a write hook sees every write
+        std::function<bool()> read_hook;
+        std::function<void(bool)> write_hook;
+
+    protected:
+        void attach_interrupt(void (*func)(void*), void* arg, gpio::InterruptType type) const override;
+
+        uint8_t pin_;
+        bool inverted_;
+        bool level_ { false };
+        gpio::Flags flags_ { gpio::FLAG_NONE };
+        uint32_t writes_ { 0 };
+        mutable void (*isr_)(void*) { nullptr };
+        mutable void* isr_arg_ { nullptr };
+        mutable gpio::InterruptType isr_type_ { gpio::INTERRUPT_ANY_EDGE };
+    };
+
+    HostGPIOPin* pin(uint8_t number);
+
+    /*************************** SERIAL LINE ***************************/
+
+    struct WireByte {
+        uint8_t value;
+        bool parity; // parity bit as received, 8E1 only
+        uint64_t start; // us, start bit
+        uint64_t end; // us, end of the stop bit
+    };
+
+    class Bus;
+
+    // One device's UART on a bus. Bytes are queued with the time they finish
+    // arriving, receive() hands out the ones that have by now
+    class SerialEndpoint {
+    public:
+        virtual ~SerialEndpoint();
+
+        void configure(uint32_t baud, bool parity);
+        uint32_t baud() const { return this->baud_; }
+        bool has_parity() const { return this->parity_; }
+        // us per byte including start, parity and stop bits
+        uint32_t byte_time() const { return (this->parity_ ? 11 : 10) * 1000000 / this->baud_; }
+
+        bool receive(WireByte& byte);
+        size_t in_flight() const { return this->rx_.size(); }
+        void deliver(const WireByte& byte);
+
+        // A device that acts on its own (an opener, a wall panel) says when
+        // it next has something to do, run_until() stops the clock there
+        // and polls it, also while the board sleeps between loops. poll()
+        // has to move next_poll() past the current time
+        virtual uint64_t next_poll() const { return UINT64_MAX; }
+        virtual void poll() { }
+        // when the first queued byte finishes arriving, us
+        uint64_t next_arrival() const { return this->rx_.empty() ? UINT64_MAX : this->rx_.front().end; }
+
+        Bus* bus() const { return this->bus_; }
+        // whether the endpoint hears its own transmissions
+        bool echo { true };
+
+    protected:
+        friend class Bus;
+        uint32_t baud_ { 9600 };
+        bool parity_ { false };
+        std::deque<WireByte> rx_;
+        Bus* bus_ { nullptr };
+    };
+
+    // The single wire shared by the GDO, wall panels and the ratgdo. Every
+    // byte reaches every endpoint, an endpoint on a different baud rate or
+    // frame format receives the garbage its UART would make of it
+    class Bus {
+    public:
+        explicit Bus(uint32_t seed = 1);
+        ~Bus();
+
+        // rx and tx are the pins of the endpoint, when given the rx pin
+        // reads the line busy and the tx pin pulls it into a break
+        void attach(SerialEndpoint* endpoint, HostGPIOPin* rx = nullptr, HostGPIOPin* tx = nullptr);
+        void detach(SerialEndpoint* endpoint);
+
+        // sends len bytes back to back from start, returns when the last one ends
+        uint64_t send(SerialEndpoint* from, const uint8_t* data, size_t len, uint64_t start);
+        // count random bytes spread over span us from start, at every endpoint's own baud rate
+        void noise(uint64_t start, uint64_t span, size_t count);
+        // each byte sent is corrupted with this probability from now on
+        void set_error_rate(float rate) { this->error_rate_ = rate; }
+
+        bool busy(uint64_t now) const;
+        // polls the endpoints that are due by now, returns when the next is due
+        uint64_t poll(uint64_t now);
+        uint64_t next_poll() const;
+        uint64_t bytes_sent() const { return this->bytes_sent_; }
+        uint64_t bytes_corrupted() const { return this->bytes_corrupted_; }
+        uint64_t collisions() const { return this->collisions_; }
+        uint32_t random();
+
+    protected:
+        void line_break(SerialEndpoint* from, bool low);
+        void mark_busy(uint64_t start, uint64_t end);
+        uint8_t garble(uint8_t value);
+
+        struct Attached {
+            SerialEndpoint* endpoint;
+            HostGPIOPin* rx;
+            HostGPIOPin* tx;
+        };
+        std::vector<Attached> attached_;
+        std::deque<std::pair<uint64_t, uint64_t>> busy_;
+        std::map<SerialEndpoint*, uint64_t> break_start_;
+        uint32_t state_;
+        float error_rate_ { 0 };
+        uint64_t bytes_sent_ { 0 };
+        uint64_t bytes_corrupted_ { 0 };
+        uint64_t collisions_ { 0 };
+    };
+
+    // Software serial on an ESP turns interrupts off while it sends, which
+    // every other software serial of the board misses bytes during
+    void interrupts_off(uint64_t start, uint64_t end);
+    bool interrupts_were_off(uint64_t start, uint64_t end);
+
+    /*************************** PREFERENCES ***************************/
+
+    // Saved records live in RAM until sync() writes them to flash, a power
+    // loss drops what wasn't synced
+    class HostPreferences : public ESPPreferences {
+    public:
+        ESPPreferenceObject make_preference(size_t length, uint32_t type, bool in_flash) override;
+        ESPPreferenceObject make_preference(size_t length, uint32_t type) override;
+        bool sync() override;
+        bool reset() override;
+
+        void power_loss();
+        uint32_t saves() const { return this->saves_; }
+        uint32_t flash_writes() const { return this->flash_writes_; }
+
+    protected:
+        friend class HostPreferenceBackend;
+        std::map<uint32_t, std::vector<uint8_t>> ram_;
+        std::map<uint32_t, std::vector<uint8_t>> flash_;
+        std::map<uint32_t, std::unique_ptr<ESPPreferenceBackend>> backends_;
+        uint32_t saves_ { 0 };
+        uint32_t flash_writes_ { 0 };
+    };
+
+    HostPreferences& preferences();
+
+    /*************************** BOARD ***************************/
+
+    // Forgets the components and timers of App, what a reboot does to RAM.
+    // With power_loss unsynced preferences are lost too, otherwise they are
+    // synced first like a clean reboot does. The clock keeps running
+    void reboot(bool power_loss = false);
+
+    const uint64_t LOOP_INTERVAL = 16000; // us, ESPHome's default loop interval
+    const uint64_t HIGH_FREQUENCY_LOOP_TIME = 200; // us a loop takes while it doesn't sleep
+
+    // Runs App like a device's main loop until the clock reaches until_us:
+    // a loop, then a sleep until the next timer is due or the loop interval
+    // has passed, no sleep while a component requests a high frequency loop.
+    // The clock jumps over the sleeps, stopping for the endpoints of bus
+    // when they are due. Returns the number of loops run
+    uint32_t run_until(uint64_t until_us, Bus* bus = nullptr);
+
+} // namespace host
+} // namespace esphome
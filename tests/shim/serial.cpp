@@ -0,0 +1,412 @@
+#include "SoftwareSerial.h"
+#include "host.h"
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+namespace esphome {
+namespace host {
+
+    static const uint64_t HISTORY = 1000000; // us of bus and interrupt history kept
+
+    static bool parity_even(uint8_t value)
+    {
+        value ^= value >> 4;
+        value &= 0xf;
+        return (0x6996 >> value) & 1;
+    }
+
+    /*************************** ENDPOINT ***************************/
+
+    SerialEndpoint::~SerialEndpoint()
+    {
+        if (this->bus_ != nullptr) {
+            this->bus_->detach(this);
+        }
+    }
+
+    void SerialEndpoint::configure(uint32_t baud, bool parity)
+    {
+        this->baud_ = baud;
+        this->parity_ = parity;
+    }
+
+    bool SerialEndpoint::receive(WireByte& byte)
+    {
+        if (this->rx_.empty() || this->rx_.front().end > now_us()) {
+            return false;
+        }
+        byte = this->rx_.front();
+        this->rx_.pop_front();
+        return true;
+    }
+
+    void SerialEndpoint::deliver(const WireByte& byte)
+    {
+        auto it = std::upper_bound(this->rx_.begin(), this->rx_.end(), byte,
+            [](const WireByte& a, const WireByte& b) { return a.end < b.end; });
+        this->rx_.insert(it, byte);
+    }
+
+    /*************************** BUS ***************************/
+
+    Bus::Bus(uint32_t seed)
+        : state_(seed != 0 ? seed : 1)
+    {
+    }
+
+    Bus::~Bus()
+    {
+        while (!this->attached_.empty()) {
+            this->detach(this->attached_.back().endpoint);
+        }
+    }
+
+    void Bus::attach(SerialEndpoint* endpoint, HostGPIOPin* rx, HostGPIOPin* tx)
+    {
+        if (endpoint->bus_ != nullptr) {
+            endpoint->bus_->detach(endpoint);
+        }
+        endpoint->bus_ = this;
+        this->attached_.push_back({ endpoint, rx, tx });
+        if (rx != nullptr) {
+            rx->read_hook = [this]() { return this->busy(now_us()); };
+        }
+        if (tx != nullptr) {
+            tx->write_hook = [this, endpoint](bool low) { this->line_break(endpoint, low); };
+        }
+    }
+
+    void Bus::detach(SerialEndpoint* endpoint)
+    {
+        for (auto it = this->attached_.begin(); it != this->attached_.end(); ++it) {
+            if (it->endpoint != endpoint) {
+                continue;
+            }
+            if (it->rx != nullptr) {
+                it->rx->read_hook = nullptr;
+            }
+            if (it->tx != nullptr) {
+                it->tx->write_hook = nullptr;
+            }
+            this->attached_.erase(it);
+            break;
+        }
+        this->break_start_.erase(endpoint);
+        endpoint->bus_ = nullptr;
+    }
+
+    uint64_t Bus::send(SerialEndpoint* from, const uint8_t* data, size_t len, uint64_t start)
+    {
+        const uint64_t byte_time = from->byte_time();
+        const uint64_t end = start + len * byte_time;
+        std::vector<uint8_t> sent(data, data + len);
+
+        // bytes already on the line and the ones sent now corrupt each other
+        bool collided = false;
+        for (const auto& span : this->busy_) {
+            if (span.first < end && start < span.second) {
+                collided = true;
+                break;
+            }
+        }
+        for (size_t i = 0; i < len; i++) {
+            uint64_t byte_start = start + i * byte_time;
+            bool hit = false;
+            if (collided) {
+                for (const auto& span : this->busy_) {
+                    if (span.first < byte_start + byte_time && byte_start < span.second) {
+                        hit = true;
+                        break;
+                    }
+                }
+            }
+            if (hit) {
+                this->collisions_++;
+                sent[i] = this->garble(sent[i]);
+            } else if (this->error_rate_ > 0 && this->random() < this->error_rate_ * 4294967295.0f) {
+                this->bytes_corrupted_++;
+                sent[i] = this->garble(sent[i]);
+            }
+        }
+        if (collided) {
+            for (const auto& attached : this->attached_) {
+                for (auto& queued : attached.endpoint->rx_) {
+                    if (queued.start < end && start < queued.end) {
+                        queued.value = this->garble(queued.value);
+                    }
+                }
+            }
+        }
+
+        for (const auto& attached : this->attached_) {
+            auto* to = attached.endpoint;
+            if (to == from && !from->echo) {
+                continue;
+            }
+            if (to->baud_ == from->baud_) {
+                for (size_t i = 0; i < len; i++) {
+                    uint64_t byte_start = start + i * byte_time;
+                    // an 8E1 receiver reads the stop bit of an 8N1 byte as parity
+                    bool parity = from->parity_ ? parity_even(sent[i]) : true;
+                    to->deliver({ sent[i], parity, byte_start, byte_start + byte_time });
+                }
+                continue;
+            }
+            // a UART on another baud rate decodes the edges into garbage, a
+            // slower one fewer bytes than were sent, a faster one several per byte
+            const uint64_t to_time = to->byte_time();
+            size_t count = to_time > byte_time ? std::max<size_t>(1, (end - start) / to_time)
+                                               : std::min<size_t>(len * 3, (end - start) / to_time);
+            for (size_t i = 0; i < count; i++) {
+                uint64_t byte_start = start + i * (end - start) / count;
+                uint32_t noise = this->random();
+                to->deliver({ uint8_t(noise), bool(noise & 0x100), byte_start, byte_start + to_time });
+            }
+        }
+        this->mark_busy(start, end);
+        this->bytes_sent_ += len;
+        return end;
+    }
+
+    void Bus::noise(uint64_t start, uint64_t span, size_t count)
+    {
+        for (size_t i = 0; i < count; i++) {
+            uint64_t at = start + (span > 0 ? this->random() % span : 0);
+            uint32_t noise = this->random();
+            uint64_t end = at;
+            for (const auto& attached : this->attached_) {
+                uint64_t to_end = at + attached.endpoint->byte_time();
+                attached.endpoint->deliver({ uint8_t(noise), bool(noise & 0x100), at, to_end });
+                end = std::max(end, to_end);
+            }
+            this->mark_busy(at, end);
+        }
+    }
+
+    bool Bus::busy(uint64_t now) const
+    {
+        for (const auto& span : this->busy_) {
+            if (span.first <= now && now < span.second) {
+                return true;
+            }
+        }
+        for (const auto& pending : this->break_start_) {
+            if (pending.second <= now) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    uint64_t Bus::poll(uint64_t now)
+    {
+        // an endpoint may answer another one's bytes, poll until none is due
+        uint64_t next;
+        while ((next = this->next_poll()) <= now) {
+            for (auto& attached : this->attached_) {
+                if (attached.endpoint->next_poll() <= now) {
+                    attached.endpoint->poll();
+                }
+            }
+        }
+        return next;
+    }
+
+    uint64_t Bus::next_poll() const
+    {
+        uint64_t next = UINT64_MAX;
+        for (const auto& attached : this->attached_) {
+            next = std::min(next, attached.endpoint->next_poll());
+        }
+        return next;
+    }
+
+    uint32_t Bus::random()
+    {
+        this->state_ ^= this->state_ << 13;
+        this->state_ ^= this->state_ >> 17;
+        this->state_ ^= this->state_ << 5;
+        return this->state_;
+    }
+
+    // The tx pin drives the transistor that pulls the line low, holding it
+    // high is a break every UART on the line receives as a 0x00
+    void Bus::line_break(SerialEndpoint* from, bool low)
+    {
+        uint64_t now = now_us();
+        if (low) {
+            this->break_start_.emplace(from, now);
+            return;
+        }
+        auto it = this->break_start_.find(from);
+        if (it == this->break_start_.end()) {
+            return;
+        }
+        uint64_t start = it->second;
+        this->break_start_.erase(it);
+        for (const auto& attached : this->attached_) {
+            if (attached.endpoint != from || from->echo) {
+                attached.endpoint->deliver({ 0x00, false, start, now });
+            }
+        }
+        this->mark_busy(start, now);
+    }
+
+    void Bus::mark_busy(uint64_t start, uint64_t end)
+    {
+        uint64_t now = now_us();
+        while (!this->busy_.empty() && this->busy_.front().second + HISTORY < now) {
+            this->busy_.pop_front();
+        }
+        this->busy_.emplace_back(start, end);
+    }
+
+    uint8_t Bus::garble(uint8_t value)
+    {
+        return value ^ (1 << (this->random() % 8));
+    }
+
+    /*************************** INTERRUPTS ***************************/
+
+    static std::deque<std::pair<uint64_t, uint64_t>>& interrupt_windows()
+    {
+        static std::deque<std::pair<uint64_t, uint64_t>> windows;
+        return windows;
+    }
+
+    void interrupts_off(uint64_t start, uint64_t end)
+    {
+        auto& windows = interrupt_windows();
+        while (!windows.empty() && windows.front().second + HISTORY < start) {
+            windows.pop_front();
+        }
+        windows.emplace_back(start, end);
+    }
+
+    bool interrupts_were_off(uint64_t start, uint64_t end)
+    {
+        for (const auto& window : interrupt_windows()) {
+            if (window.first < end && start < window.second) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+} // namespace host
+} // namespace esphome
+
+/*************************** SOFTWARE SERIAL ***************************/
+
+using namespace esphome;
+
+static std::map<int8_t, SoftwareSerial*>& serials()
+{
+    static std::map<int8_t, SoftwareSerial*> serials;
+    return serials;
+}
+
+SoftwareSerial::~SoftwareSerial()
+{
+    this->end();
+}
+
+void SoftwareSerial::begin(uint32_t baud, SoftwareSerialConfig config, int8_t rx_pin, int8_t tx_pin, bool invert, int buffer_capacity)
+{
+    this->configure(baud, config == SWSERIAL_8E1);
+    this->rx_pin_ = rx_pin;
+    this->tx_pin_ = tx_pin;
+    this->capacity_ = buffer_capacity;
+    serials()[rx_pin] = this;
+}
+
+void SoftwareSerial::end()
+{
+    auto it = serials().find(this->rx_pin_);
+    if (it != serials().end() && it->second == this) {
+        serials().erase(it);
+    }
+    if (this->bus_ != nullptr) {
+        this->bus_->detach(this);
+    }
+    this->rx_.clear();
+    this->buffer_.clear();
+}
+
+void SoftwareSerial::end_all()
+{
+    auto all = serials();
+    for (auto& entry : all) {
+        entry.second->end();
+    }
+}
+
+SoftwareSerial* SoftwareSerial::on_pin(int8_t rx_pin)
+{
+    auto it = serials().find(rx_pin);
+    return it != serials().end() ? it->second : nullptr;
+}
+
+// moves the bytes that have arrived by now into the receive buffer the
+// way the receive interrupt would have
+void SoftwareSerial::fill()
+{
+    host::WireByte byte;
+    while (this->receive(byte)) {
+        if (host::interrupts_were_off(byte.start, byte.end)) {
+            this->lost_++;
+            continue;
+        }
+        if (this->buffer_.size() >= this->capacity_) {
+            this->overflow_ = true;
+            this->overflowed_++;
+            continue;
+        }
+        this->buffer_.push_back(byte);
+    }
+}
+
+int SoftwareSerial::available()
+{
+    this->fill();
+    return this->buffer_.size();
+}
+
+int SoftwareSerial::read()
+{
+    this->fill();
+    if (this->buffer_.empty()) {
+        return -1;
+    }
+    auto byte = this->buffer_.front();
+    this->buffer_.pop_front();
+    this->last_parity_ = byte.parity;
+    return byte.value;
+}
+
+bool SoftwareSerial::overflow()
+{
+    bool overflow = this->overflow_;
+    this->overflow_ = false;
+    return overflow;
+}
+
+// Bit banging blocks the caller for the whole write, without intTx the
+// interrupts stay off as long
+size_t SoftwareSerial::write(const uint8_t* buffer, size_t size)
+{
+    uint64_t start = host::now_us();
+    uint64_t end = start + size * this->byte_time();
+    if (this->bus_ != nullptr) {
+        this->echo = this->int_tx_;
+        end = this->bus_->send(this, buffer, size, start);
+    }
+    if (!this->int_tx_) {
+        host::interrupts_off(start, end);
+    }
+    host::set_clock_us(end);
+    this->written_ += size;
+    return size;
+}
@@ -0,0 +1,64 @@
+// Replays a capture from a device into a board of the protocol the binary
+// is built for and prints what the board publishes, to reproduce an
+// install's behavior offline:
+//
+//   wire_replay_secplus2 device.log
+//   ESPHOME_LOG_LEVEL=5 wire_replay_secplus1 < device.log
+//
+// The log holds the lines dump_wire_capture() wrote, anything else in it
+// is skipped. The host time the replay took is printed per received byte
+
+#include "wire_replay.h"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+
+using namespace host_board;
+
+int main(int argc, char** argv)
+{
+    std::vector<WireRecord> records;
+    if (argc > 1) {
+        std::ifstream log(argv[1]);
+        if (!log) {
+            std::fprintf(stderr, "can't read %s\n", argv[1]);
+            return EXIT_FAILURE;
+        }
+        records = parse_wire_capture(log);
+    } else {
+        records = parse_wire_capture(std::cin);
+    }
+    size_t received = 0;
+    for (const auto& record : records) {
+        received += (record.flags & WIRE_TX) == 0;
+    }
+    if (received == 0) {
+        std::fprintf(stderr, "no received bytes in the capture\n");
+        return EXIT_FAILURE;
+    }
+
+    host::Bus bus;
+    Board board(bus);
+    auto start = host::now_us();
+    auto at = [start] { return (host::now_us() - start) / 1e6; };
+    board.ratgdo.subscribe_door_state([&at](DoorState state, float position) {
+        std::printf("%9.3f door %s %.3f\n", at(), DoorState_to_string(state), position);
+    });
+    board.ratgdo.subscribe_light_state([&at](LightState state) { std::printf("%9.3f light %s\n", at(), LightState_to_string(state)); });
+    board.ratgdo.subscribe_lock_state([&at](LockState state) { std::printf("%9.3f lock %s\n", at(), LockState_to_string(state)); });
+    board.ratgdo.subscribe_obstruction_state([&at](ObstructionState state) {
+        std::printf("%9.3f obstruction %s\n", at(), ObstructionState_to_string(state));
+    });
+    board.ratgdo.subscribe_motor_state([&at](MotorState state) { std::printf("%9.3f motor %s\n", at(), MotorState_to_string(state)); });
+    board.ratgdo.subscribe_motion_state([&at](MotionState state) { std::printf("%9.3f motion %s\n", at(), MotionState_to_string(state)); });
+    board.ratgdo.subscribe_openings([&at](uint16_t openings) { std::printf("%9.3f openings %u\n", at(), openings); });
+
+    auto host_start = std::chrono::steady_clock::now();
+    auto end = replay_wire_capture(records, board.serial, host::now_us());
+    board.run((end - host::now_us()) / 1000 + 1000);
+    auto host_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - host_start).count();
+    std::printf("%zu records, %zu received over %.3fs of wire time, %.0f ns per received byte\n",
+        records.size(), received, (end - start) / 1e6, double(host_ns) / received);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,64 @@
+#pragma once
+// A wire capture as dump_wire_capture() logs it, replayed into a board: the
+// bytes the captured board received reach the serial at their captured
+// spacing and go through the real read_command, decode_packet and
+// handle_command
+
+#include "host_board.h"
+
+#include <istream>
+#include <string>
+#include <vector>
+
+namespace host_board {
+
+struct WireRecord {
+    uint32_t time; // us, micros() when the byte was read or sent
+    uint32_t flags; // WIRE_*
+    uint8_t byte;
+};
+
+// the records of the "Wire capture NNNN: <hex>" lines of a log, with or
+// without the logger's prefix, anything else is skipped
+inline std::vector<WireRecord> parse_wire_capture(std::istream& log)
+{
+    std::vector<WireRecord> records;
+    std::string line;
+    while (std::getline(log, line)) {
+        auto at = line.find("Wire capture ");
+        auto colon = at == std::string::npos ? std::string::npos : line.find(": ", at);
+        if (colon == std::string::npos) {
+            continue;
+        }
+        std::vector<uint8_t> data;
+        for (size_t i = colon + 2; i + 1 < line.size() && std::isxdigit(line[i]) && std::isxdigit(line[i + 1]); i += 2) {
+            data.push_back(std::stoul(line.substr(i, 2), nullptr, 16));
+        }
+        for (size_t i = 0; i + 5 <= data.size(); i += 5) {
+            uint32_t time = data[i] | data[i + 1] << 8 | data[i + 2] << 16 | uint32_t(data[i + 3]) << 24;
+            records.push_back({ time & ~WIRE_FLAGS, time & WIRE_FLAGS, data[i + 4] });
+        }
+    }
+    return records;
+}
+
+// delivers the received records to serial from start on, the sent ones
+// only keep the spacing, returns when the last byte has arrived
+inline uint64_t replay_wire_capture(const std::vector<WireRecord>& records, SoftwareSerial* serial, uint64_t start)
+{
+    uint64_t at = start + serial->byte_time();
+    for (size_t i = 0; i < records.size(); i++) {
+        // micros() wraps every 71 minutes, the differences don't
+        if (i > 0) {
+            at += uint32_t(records[i].time - records[i - 1].time);
+        }
+        if (records[i].flags & WIRE_TX) {
+            continue;
+        }
+        bool parity = SoftwareSerial::parityEven(records[i].byte) != bool(records[i].flags & WIRE_PARITY_ERROR);
+        serial->deliver({ records[i].byte, parity, at - serial->byte_time(), at });
+    }
+    return at;
+}
+
+} // namespace host_board